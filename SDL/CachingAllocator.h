@@ -0,0 +1,202 @@
+#ifndef CachingAllocator_cuh
+#define CachingAllocator_cuh
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+
+// Included from Constants.h when compiled with SDL_CACHE_ALLOC, after the buffer types are defined.
+
+namespace SDL
+{
+    // Caching allocator for builds without the CMSSW caching allocator.
+    // Blocks are rounded up to power-of-two size classes and go back to the cache when their buffer is destroyed.
+    // A device block is reused right away by the queue that released it, since work on that queue is ordered.
+    // Other queues only get it once the work enqueued before the release has completed. Host blocks always wait
+    // for that work, because the host writes them as soon as they are handed out, outside of the queue order.
+    template<typename TDev, typename TQueue>
+    class cachingAllocator
+    {
+    public:
+        static constexpr unsigned int minBin = 8;   // 256 B
+        static constexpr unsigned int maxBin = 30;  // 1 GiB, larger requests are not cached
+
+        static cachingAllocator& getInstance()
+        {
+            static cachingAllocator instance;
+            return instance;
+        }
+
+        cachingAllocator(const cachingAllocator&) = delete;
+        cachingAllocator& operator=(const cachingAllocator&) = delete;
+
+        void* allocate(TDev const& dev, TQueue const& queue, size_t nBytes)
+        {
+            unsigned int bin = sizeToBin(nBytes);
+            size_t blockBytes = bin > maxBin ? nBytes : (size_t(1) << bin);
+
+            std::lock_guard<std::mutex> guard(mutex);
+            if (bin <= maxBin)
+            {
+                auto range = cachedBlocks.equal_range(bin);
+                auto reuse = range.second;
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    if constexpr (not std::is_same_v<TDev, alpaka::DevCpu>)
+                    {
+                        if (it->second.queue == queue)
+                        {
+                            reuse = it;
+                            break;
+                        }
+                    }
+                    if (reuse == range.second && alpaka::isComplete(*it->second.event))
+                        reuse = it;
+                }
+                if (reuse != range.second)
+                {
+                    block cached = std::move(reuse->second);
+                    cachedBlocks.erase(reuse);
+                    cachedBytes -= cached.bytes;
+                    addLiveBytes(cached.bytes);
+                    cached.queue = queue;
+                    void* ptr = alpaka::getPtrNative(*cached.buf);
+                    liveBlocks.emplace(ptr, std::move(cached));
+                    return ptr;
+                }
+            }
+
+            std::optional<Buf<TDev, char>> buf;
+            try
+            {
+                buf.emplace(alpaka::allocBuf<char, Idx>(dev, Vec1d(static_cast<Idx>(blockBytes))));
+            }
+            catch (std::exception const&)
+            {
+                // Out of memory, release the idle cached blocks and try once more.
+                releaseIdleBlocks();
+                buf.emplace(alpaka::allocBuf<char, Idx>(dev, Vec1d(static_cast<Idx>(blockBytes))));
+            }
+            void* ptr = alpaka::getPtrNative(*buf);
+            addLiveBytes(blockBytes);
+            liveBlocks.emplace(ptr, block{std::move(*buf), alpaka::Event<TQueue>(alpaka::getDev(queue)), queue, bin, blockBytes});
+            return ptr;
+        }
+
+        void free(void* ptr)
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            auto it = liveBlocks.find(ptr);
+            if (it == liveBlocks.end())
+                return;
+            block released = std::move(it->second);
+            liveBlocks.erase(it);
+            liveBytes -= released.bytes;
+            // Blocks above the largest size class are released to the device right away.
+            if (released.bin > maxBin)
+                return;
+            alpaka::enqueue(released.queue, *released.event);
+            cachedBytes += released.bytes;
+            cachedBlocks.emplace(released.bin, std::move(released));
+        }
+
+        // Releases the cached blocks that no queue is still using.
+        void freeIdleBlocks()
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            releaseIdleBlocks();
+        }
+
+        // Waits for the work using the cached blocks and releases all of them. Blocks still held by buffers are kept.
+        void freeCachedBlocks()
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            for (auto& cached : cachedBlocks)
+                alpaka::wait(*cached.second.event);
+            cachedBlocks.clear();
+            cachedBytes = 0;
+        }
+
+        size_t getCachedBytes() const
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            return cachedBytes;
+        }
+
+        // Largest number of bytes handed out at the same time.
+        size_t getPeakLiveBytes() const
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            return peakLiveBytes;
+        }
+
+    private:
+        struct block
+        {
+            std::optional<Buf<TDev, char>> buf;
+            std::optional<alpaka::Event<TQueue>> event;
+            TQueue queue;
+            unsigned int bin;
+            size_t bytes;
+        };
+
+        cachingAllocator(): cachedBytes(0), liveBytes(0), peakLiveBytes(0) {}
+
+        void addLiveBytes(size_t nBytes)
+        {
+            liveBytes += nBytes;
+            peakLiveBytes = std::max(peakLiveBytes, liveBytes);
+        }
+
+        void releaseIdleBlocks()
+        {
+            for (auto it = cachedBlocks.begin(); it != cachedBlocks.end();)
+            {
+                if (alpaka::isComplete(*it->second.event))
+                {
+                    cachedBytes -= it->second.bytes;
+                    it = cachedBlocks.erase(it);
+                }
+                else
+                    ++it;
+            }
+        }
+
+        static unsigned int sizeToBin(size_t nBytes)
+        {
+            unsigned int bin = minBin;
+            while (bin <= maxBin && (size_t(1) << bin) < nBytes)
+                bin++;
+            return bin;
+        }
+
+        mutable std::mutex mutex;
+        std::multimap<unsigned int, block> cachedBlocks;
+        std::unordered_map<void*, block> liveBlocks;
+        size_t cachedBytes;
+        size_t liveBytes;
+        size_t peakLiveBytes;
+    };
+
+    template<typename T, typename TDev, typename TQueue>
+    ALPAKA_FN_HOST ALPAKA_FN_INLINE Buf<TDev, T> allocCachedBuf(TDev const& dev, TQueue const& queue, size_t nElements)
+    {
+        auto& allocator = cachingAllocator<TDev, TQueue>::getInstance();
+        T* ptr = static_cast<T*>(allocator.allocate(dev, queue, std::max(nElements * sizeof(T), (size_t) 1)));
+        return wrapBuf<T>(dev, ptr, [&allocator](T* p) { allocator.free(p); }, nElements);
+    }
+
+    // Releases the blocks cached for the device and for the host. Call once the events are deleted and before the
+    // device is torn down, the allocators themselves are only destroyed at exit.
+    ALPAKA_FN_HOST ALPAKA_FN_INLINE void freeCachedBlocks()
+    {
+        using DevAcc = std::decay_t<decltype(devAcc)>;
+        cachingAllocator<DevAcc, QueueAcc>::getInstance().freeCachedBlocks();
+        if constexpr (not std::is_same_v<DevAcc, alpaka::DevCpu>)
+            cachingAllocator<alpaka::DevCpu, QueueAcc>::getInstance().freeCachedBlocks();
+    }
+}
+#endif
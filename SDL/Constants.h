@@ -2,6 +2,8 @@
 #define Constants_cuh
 
 #include <alpaka/alpaka.hpp>
+#include <type_traits>
+#include <cstring>
 
 #ifdef CACHE_ALLOC
 #include "HeterogeneousCore/AlpakaInterface/interface/CachedBufAlloc.h"
@@ -12,10 +14,12 @@
 #endif
 
 // Half precision wrapper functions.
+// With FP16_Base the FPX columns are stored as SDL::half on every backend.
 #if defined(FP16_Base)
-#define __F2H __float2half
-#define __H2F __half2float
-typedef __half float FPX;
+#include "HalfPrecision.h"
+#define __F2H SDL::half
+#define __H2F float
+typedef SDL::half FPX;
 #else
 #define __F2H
 #define __H2F
@@ -36,6 +40,24 @@ using WorkDiv = alpaka::WorkDivMembers<Dim, Idx>;
 
 Vec const elementsPerThread(Vec::all(static_cast<Idx>(1)));
 
+// Candidates tried per thread in one batch by the pair loops of the MD, segment and triplet kernels.
+// The CPU backends evaluate the leading cut over a batch of this many elements, which the compiler can vectorise,
+// the GPU backends keep one candidate per thread.
+#if defined(ALPAKA_ACC_GPU_CUDA_ENABLED) || defined(ALPAKA_ACC_GPU_HIP_ENABLED)
+constexpr unsigned int candidateBatchSize = 1;
+#else
+constexpr unsigned int candidateBatchSize = 16;
+#endif
+Vec const candidateElementsPerThread(static_cast<Idx>(1), static_cast<Idx>(1), static_cast<Idx>(candidateBatchSize));
+
+// Elements per thread of the launch along the innermost dimension, bounded by candidateBatchSize.
+template<typename TAcc>
+ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned int candidateBatch(TAcc const & acc)
+{
+    unsigned int nElements = alpaka::getWorkDiv<alpaka::Thread, alpaka::Elems>(acc)[2];
+    return nElements < candidateBatchSize ? nElements : candidateBatchSize;
+}
+
 // - AccGpuCudaRt
 // - AccCpuThreads
 // - AccCpuSerial
@@ -69,10 +91,137 @@ using QueueAcc = alpaka::Queue<Acc, QueueProperty>;
 template<typename TAcc, typename TData>
 using Buf = alpaka::Buf<TAcc, TData, Dim1d, Idx>;
 
+namespace SDL
+{
+    // Wraps memory owned elsewhere in a buffer. The deleter is called when the last copy of the buffer is destroyed.
+    template<typename T, typename TDev, typename TDeleter>
+    ALPAKA_FN_HOST ALPAKA_FN_INLINE Buf<TDev, T> wrapBuf(TDev const& dev, T* ptr, TDeleter deleter, size_t nElements)
+    {
+        if constexpr (std::is_same_v<TDev, alpaka::DevCpu>)
+        {
+            return alpaka::BufCpu<T, Dim1d, Idx>(dev, ptr, std::move(deleter), Vec1d(static_cast<Idx>(nElements)));
+        }
+        else
+        {
+#if defined(ALPAKA_ACC_GPU_CUDA_ENABLED)
+            return alpaka::BufCudaRt<T, Dim1d, Idx>(dev, ptr, std::move(deleter), static_cast<Idx>(nElements * sizeof(T)), Vec1d(static_cast<Idx>(nElements)));
+#elif defined(ALPAKA_ACC_GPU_HIP_ENABLED)
+            return alpaka::BufHipRt<T, Dim1d, Idx>(dev, ptr, std::move(deleter), static_cast<Idx>(nElements * sizeof(T)), Vec1d(static_cast<Idx>(nElements)));
+#endif
+        }
+    }
+
+    // Bump allocator for the per-event device buffers, used by allocBufWrapper when compiled with ARENA_ALLOC.
+    // All SoA buffers of an event are carved out of one allocation that is kept across events. Requests that
+    // do not fit fall back to a regular allocation and the arena grows to the new high-water mark at the next reset.
+    // The buffers are still cleared and copied to the host per field: the fields need different fill values, the
+    // slab is much larger than the fields that are cleared, and the host mirrors are separate allocations.
+    class bufferArena
+    {
+    public:
+        static constexpr size_t alignment = 128;
+
+        bufferArena(): slab(nullptr), capacity(0), offset(0), overflow(0) {}
+        bufferArena(const bufferArena&) = delete;
+        bufferArena& operator=(const bufferArena&) = delete;
+        ~bufferArena()
+        {
+            if (slab != nullptr) delete slab;
+        }
+
+        template<typename T>
+        T* allocate(size_t nElements)
+        {
+            size_t nBytes = (nElements * sizeof(T) + alignment - 1) / alignment * alignment;
+            if (slab == nullptr || offset + nBytes > capacity)
+            {
+                overflow += nBytes;
+                return nullptr;
+            }
+            T* ptr = reinterpret_cast<T*>(alpaka::getPtrNative(*slab) + offset);
+            offset += nBytes;
+            return ptr;
+        }
+
+        // Releases every buffer carved in the current event at once. Only call after all of them are destroyed.
+        void reset()
+        {
+            size_t needed = offset + overflow;
+            if (needed > capacity)
+            {
+                if (slab != nullptr) delete slab;
+                capacity = needed + needed / 8;
+                slab = new Buf<Acc, char>(alpaka::allocBuf<char, Idx>(devAcc, Vec1d(static_cast<Idx>(capacity))));
+            }
+            offset = 0;
+            overflow = 0;
+        }
+
+        size_t getCapacity() const { return capacity; }
+        size_t getUsed() const { return offset; }
+
+    private:
+        Buf<Acc, char>* slab;
+        size_t capacity;
+        size_t offset;
+        size_t overflow;
+    };
+
+    // Arena used by allocBufWrapper on the calling thread, set by arenaScope. The event opens it only around the
+    // construction of its buffer structs, so scratch buffers of the build steps do not take space in the slab.
+    inline thread_local bufferArena* currentArena = nullptr;
+
+    struct arenaScope
+    {
+        bufferArena* previous;
+        arenaScope(bufferArena& arena): previous(currentArena) { currentArena = &arena; }
+        ~arenaScope() { currentArena = previous; }
+    };
+
+    // Non-owning buffer over arena memory, the arena frees it on reset.
+    template<typename T>
+    ALPAKA_FN_HOST ALPAKA_FN_INLINE Buf<Acc, T> arenaBuf(T* ptr, size_t nElements)
+    {
+        return wrapBuf<T>(devAcc, ptr, [](T*) {}, nElements);
+    }
+}
+
+#ifdef SDL_CACHE_ALLOC
+#include "CachingAllocator.h"
+#endif
+
+namespace SDL
+{
+    // Bytes requested through allocBufWrapper on the calling thread while an allocationCounter is alive.
+    inline thread_local size_t* currentAllocationCount = nullptr;
+
+    struct allocationCounter
+    {
+        size_t* previous;
+        allocationCounter(size_t& count): previous(currentAllocationCount) { currentAllocationCount = &count; }
+        ~allocationCounter() { currentAllocationCount = previous; }
+    };
+}
+
 // Allocation wrapper function to make integration of the caching allocator easier and reduce code boilerplate.
 template<typename T, typename TAcc, typename TSize, typename TQueue>
 ALPAKA_FN_HOST ALPAKA_FN_INLINE Buf<TAcc, T> allocBufWrapper(TAcc const & devAccIn, TSize nElements, TQueue queue) {
-#ifdef CACHE_ALLOC
+    if (SDL::currentAllocationCount != nullptr)
+        *SDL::currentAllocationCount += static_cast<size_t>(nElements) * sizeof(T);
+#ifdef ARENA_ALLOC
+    if constexpr (std::is_same_v<TAcc, std::decay_t<decltype(devAcc)>>)
+    {
+        if (SDL::currentArena != nullptr)
+        {
+            T* ptr = SDL::currentArena->allocate<T>(static_cast<size_t>(nElements));
+            if (ptr != nullptr)
+                return SDL::arenaBuf<T>(ptr, static_cast<size_t>(nElements));
+        }
+    }
+#endif
+#if defined(SDL_CACHE_ALLOC)
+    return SDL::allocCachedBuf<T>(devAccIn, queue, static_cast<size_t>(nElements));
+#elif defined(CACHE_ALLOC)
     return cms::alpakatools::allocCachedBuf<T, Idx>(devAccIn, queue, Vec1d(static_cast<Idx>(nElements)));
 #else
     return alpaka::allocBuf<T, Idx>(devAccIn, Vec1d(static_cast<Idx>(nElements)));
@@ -85,6 +234,17 @@ ALPAKA_FN_HOST ALPAKA_FN_INLINE Buf<TAcc, T> allocBufWrapper(TAcc const & devAcc
     return alpaka::allocBuf<T, Idx>(devAccIn, Vec1d(static_cast<Idx>(nElements)));
 }
 
+// Page-locked host allocation for buffers that are transferred to the device every event.
+// CPU backends share the host memory, so a regular host buffer is returned there.
+template<typename T, typename TSize>
+ALPAKA_FN_HOST ALPAKA_FN_INLINE Buf<alpaka::DevCpu, T> allocPinnedBufWrapper(TSize nElements) {
+#if defined(ALPAKA_ACC_GPU_CUDA_ENABLED) || defined(ALPAKA_ACC_GPU_HIP_ENABLED)
+    return alpaka::allocMappedBuf<alpaka::Pltf<alpaka::Dev<Acc>>, T, Idx>(devHost, Vec1d(static_cast<Idx>(nElements)));
+#else
+    return alpaka::allocBuf<T, Idx>(devHost, Vec1d(static_cast<Idx>(nElements)));
+#endif
+}
+
 // Wrapper function to reduce code boilerplate for defining grid/block sizes.
 ALPAKA_FN_HOST ALPAKA_FN_INLINE Vec createVec(int x, int y, int z)
 {
@@ -121,7 +281,6 @@ constexpr float PT_CUT = 0.8f;
 #endif
 
 const unsigned int MAX_BLOCKS = 80;
-const unsigned int MAX_CONNECTED_MODULES = 40;
 
 const unsigned int N_MAX_PIXEL_SEGMENTS_PER_MODULE = 50000;
 
@@ -130,6 +289,9 @@ const unsigned int N_MAX_PIXEL_MD_PER_MODULES = 2*N_MAX_PIXEL_SEGMENTS_PER_MODUL
 const unsigned int N_MAX_PIXEL_TRIPLETS = 5000;
 const unsigned int N_MAX_PIXEL_QUINTUPLETS = 15000;
 
+// Duplicate removal key of an object that no overlapping object beats
+const unsigned long long noDupCompetitor = 0xFFFFFFFFFFFFFFFFull;
+
 const unsigned int N_MAX_PIXEL_TRACK_CANDIDATES = 30000;
 const unsigned int N_MAX_NONPIXEL_TRACK_CANDIDATES = 1000;
 
@@ -160,6 +322,90 @@ namespace SDL
     ALPAKA_STATIC_ACC_MEM_GLOBAL const float magnetic_field = 3.8112;
     // Since C++ can't represent infinity, SDL_INF = 123456789 was used to represent infinity in the data table
     ALPAKA_STATIC_ACC_MEM_GLOBAL const float SDL_INF = 123456789;
+
+    // Maps a float score to an unsigned int with the same ordering, to pack it into atomic keys
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE uint32_t orderedScoreBits(float score)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &score, sizeof(bits));
+        return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    }
+
+    // Atomic increment of counters[index] by the threads with predicate set, returns the previous value or -1.
+    // Called by all threads at the same point with their predicate. On CUDA the requesting lanes of the warp are
+    // grouped by index within the one mask taken at entry: the lowest lane of a group adds the group size with a
+    // single atomic and hands the previous value to the group, each lane adding its rank in the group. The other
+    // backends do one atomic per thread.
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE int atomicIncrementAggregated(TAcc const & acc, int* counters, int index, bool predicate)
+    {
+#if defined(ALPAKA_ACC_GPU_CUDA_ENABLED) && defined(__CUDA_ARCH__) && (__CUDA_ARCH__ >= 700)
+        auto const blockThreadIdx = alpaka::getIdx<alpaka::Block, alpaka::Threads>(acc);
+        auto const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
+        unsigned int const lane = alpaka::mapIdx<1u>(blockThreadIdx, blockThreadExtent)[0] % 32;
+
+        unsigned int const active = __activemask();
+        unsigned int const requesting = __ballot_sync(active, predicate);
+        if(not predicate)
+            return -1;
+        unsigned int const group = __match_any_sync(requesting, index);
+        unsigned int const leader = __ffs(group) - 1;
+        int previous = 0;
+        if(lane == leader)
+        {
+            previous = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &counters[index], __popc(group));
+        }
+        previous = __shfl_sync(group, previous, leader);
+        return previous + __popc(group & ((1u << lane) - 1));
+#else
+        return predicate ? alpaka::atomicOp<alpaka::AtomicAdd>(acc, &counters[index], 1) : -1;
+#endif
+    }
+
+    // Largest number of objects of a module sorted in shared memory by blockBitonicSort
+    constexpr unsigned int blockSortCapacity = 1024;
+
+    // Sort key of an object by phi, ties broken by index
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned long long phiSortKey(float phi, unsigned int index)
+    {
+        return (static_cast<unsigned long long>(orderedScoreBits(phi)) << 32) | index;
+    }
+
+    // Sorts keys[0, n) in increasing order with a bitonic sort over the next power of two, n at most
+    // blockSortCapacity. Called by all threads of the block, keys is in shared memory.
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void blockBitonicSort(TAcc const & acc, unsigned long long* keys, unsigned int n)
+    {
+        auto const blockThreadIdx = alpaka::getIdx<alpaka::Block, alpaka::Threads>(acc);
+        auto const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
+        unsigned int const blockThread = alpaka::mapIdx<1u>(blockThreadIdx, blockThreadExtent)[0];
+        unsigned int const nThreads = blockThreadExtent.prod();
+
+        unsigned int size = 1;
+        while(size < n)
+            size <<= 1;
+        for(unsigned int i = n + blockThread; i < size; i += nThreads)
+            keys[i] = ~0ull;
+        alpaka::syncBlockThreads(acc);
+
+        for(unsigned int k = 2; k <= size; k <<= 1)
+        {
+            for(unsigned int j = k >> 1; j > 0; j >>= 1)
+            {
+                for(unsigned int i = blockThread; i < size; i += nThreads)
+                {
+                    unsigned int partner = i ^ j;
+                    if(partner > i and ((keys[i] > keys[partner]) == ((i & k) == 0)))
+                    {
+                        unsigned long long key = keys[i];
+                        keys[i] = keys[partner];
+                        keys[partner] = key;
+                    }
+                }
+                alpaka::syncBlockThreads(acc);
+            }
+        }
+    }
 }
 
 namespace T5DNN
@@ -1,3 +1,7 @@
+#include <sys/resource.h>
+#include <optional>
+#include <numeric>
+
 #include "Event.h"
 
 SDL::modules* SDL::modulesInGPU = new SDL::modules();
@@ -31,6 +35,17 @@ void SDL::Event::init(bool verbose)
     pixelTripletsInCPU = nullptr;
     pixelQuintupletsInCPU = nullptr;
 
+    packedInputHost = nullptr;
+    packedInputDevice = nullptr;
+    packedInputCapacity = 0;
+
+    deviceBytes.fill(0);
+    hostBytes.fill(0);
+    peakEventDeviceBytes = 0;
+    hitsCapacity = 0;
+    outerHitIdxRange = 0;
+    pixelHitIdxRange = 0;
+
     //reset the arrays
     for(int i = 0; i < 6; i++)
     {
@@ -58,6 +73,20 @@ SDL::Event::Event(bool verbose): queue(alpaka::getDevByIdx<Acc>(0u))
     init(verbose);
 }
 
+SDL::Event::~Event()
+{
+    if(packedInputHost != nullptr)
+    {
+        delete packedInputHost;
+        packedInputHost = nullptr;
+    }
+    if(packedInputDevice != nullptr)
+    {
+        delete packedInputDevice;
+        packedInputDevice = nullptr;
+    }
+}
+
 void SDL::Event::resetEvent()
 {
     //reset the arrays
@@ -97,6 +126,13 @@ void SDL::Event::resetEvent()
       pixelTripletsInGPU = nullptr;}
     if(pixelQuintupletsInGPU){delete pixelQuintupletsInGPU; delete pixelQuintupletsBuffers;
       pixelQuintupletsInGPU = nullptr;}
+    arena.reset();
+    peakEventDeviceBytes = std::max(peakEventDeviceBytes, std::accumulate(deviceBytes.begin(), deviceBytes.end(), size_t(0)));
+    deviceBytes.fill(0);
+    hostBytes.fill(0);
+    hitsCapacity = 0;
+    outerHitIdxRange = 0;
+    pixelHitIdxRange = 0;
 
     if(hitsInCPU != nullptr)
     {
@@ -159,9 +195,6 @@ void SDL::initModules(const char* moduleMetaDataFilePath)
 {
     QueueAcc queue(devAcc);
 
-    // Set the relevant data pointers.
-    modulesInGPU->setData(*modulesBuffers);
-
     // nModules gets filled here
     loadModulesFromFile(modulesInGPU,
                         modulesBuffers,
@@ -170,6 +203,16 @@ void SDL::initModules(const char* moduleMetaDataFilePath)
                         *pixelMapping,
                         queue,
                         moduleMetaDataFilePath);
+
+    // Set the relevant data pointers, after the module map has been sized.
+    modulesInGPU->setData(*modulesBuffers);
+
+    // Compiled-in T5 DNN weights, unless a weight file was loaded before
+    createT5DNNWeights();
+    if (not t5DNNWeights->loaded)
+    {
+        t5DNNWeights->loadBuiltin();
+    }
 }
 
 // Temporary solution to the global variables. Should be freed with shared_ptr.
@@ -187,6 +230,31 @@ void SDL::freeModules()
     }
 }
 
+// Packs the host input columns into the pinned staging buffer and sends it to the device with a single copy.
+// Returns the device address of the packed input, which is the staging buffer itself on CPU backends.
+char* SDL::Event::uploadPackedInput(const SDL::packedInputLayout& layout)
+{
+    if (packedInputHost == nullptr || layout.nBytes > packedInputCapacity)
+    {
+        if (packedInputHost != nullptr) delete packedInputHost;
+        if (packedInputDevice != nullptr) delete packedInputDevice;
+        packedInputCapacity = std::max(layout.nBytes, (size_t) 1);
+        packedInputHost = new Buf<alpaka::DevCpu, char>(allocPinnedBufWrapper<char>(packedInputCapacity));
+#if defined(ALPAKA_ACC_GPU_CUDA_ENABLED) || defined(ALPAKA_ACC_GPU_HIP_ENABLED)
+        packedInputDevice = new Buf<Acc, char>(allocBufWrapper<char>(devAcc, packedInputCapacity));
+#endif
+    }
+
+    layout.pack(alpaka::getPtrNative(*packedInputHost));
+
+#if defined(ALPAKA_ACC_GPU_CUDA_ENABLED) || defined(ALPAKA_ACC_GPU_HIP_ENABLED)
+    alpaka::memcpy(queue, *packedInputDevice, *packedInputHost, layout.nBytes);
+    return alpaka::getPtrNative(*packedInputDevice);
+#else
+    return alpaka::getPtrNative(*packedInputHost);
+#endif
+}
+
 void SDL::Event::addHitToEvent(std::vector<float> x, std::vector<float> y, std::vector<float> z, std::vector<unsigned int> detId, std::vector<unsigned int> idxInNtuple)
 {
     // Use the actual number of hits instead of a max.
@@ -196,29 +264,151 @@ void SDL::Event::addHitToEvent(std::vector<float> x, std::vector<float> y, std::
     if (hitsInGPU == nullptr)
     {
         hitsInGPU = new SDL::hits();
+        allocationCounter counter(deviceBytes[hitsMemory]);
+        arenaScope scope(arena);
         hitsBuffers = new SDL::hitsBuffer<Acc>(nModules, nHits, devAcc, queue);
+        hitsCapacity = nHits;
         hitsInGPU->setData(*hitsBuffers);
     }
 
     if (rangesInGPU == nullptr)
     {
         rangesInGPU = new SDL::objectRanges();
+        allocationCounter counter(deviceBytes[rangesMemory]);
+        arenaScope scope(arena);
         rangesBuffers = new SDL::objectRangesBuffer<Acc>(nModules, nLowerModules, devAcc, queue);
         rangesInGPU->setData(*rangesBuffers);
     }
 
-    // Need a view here before transferring to the device.
-    auto nHits_view = alpaka::createView(devHost, &nHits, (Idx) 1u);
+    // The pixel pseudo-hits (detId 1) carry the ntuple index of a pixel hit, the other hits that of an outer tracker hit.
+    for (unsigned int ihit = 0; ihit < nHits; ihit++)
+    {
+        unsigned int& idxRange = (detId[ihit] == 1) ? pixelHitIdxRange : outerHitIdxRange;
+        idxRange = std::max(idxRange, idxInNtuple[ihit] + 1);
+    }
+
+    // Copy the host arrays to the GPU in one transfer, then unpack them on the device.
+    SDL::packedInputLayout layout;
+    size_t const nHits_offset = layout.add(&nHits, 1);
+    size_t const x_offset = layout.add(x);
+    size_t const y_offset = layout.add(y);
+    size_t const z_offset = layout.add(z);
+    size_t const detId_offset = layout.add(detId);
+    size_t const idxInNtuple_offset = layout.add(idxInNtuple);
+    char* packedInput = uploadPackedInput(layout);
+
+    copyFromPackedInput<unsigned int>(hitsBuffers->nHits_buf, packedInput, nHits_offset, 1);
+    bucketHitsByModule(packedColumn<float>(packedInput, x_offset),
+                       packedColumn<float>(packedInput, y_offset),
+                       packedColumn<float>(packedInput, z_offset),
+                       packedColumn<unsigned int>(packedInput, detId_offset),
+                       packedColumn<unsigned int>(packedInput, idxInNtuple_offset),
+                       nHits);
+    alpaka::wait(queue);
+
+    computeHitQuantities(nHits);
+}
 
-    // Copy the host arrays to the GPU.
-    alpaka::memcpy(queue, hitsBuffers->xs_buf, x, nHits);
-    alpaka::memcpy(queue, hitsBuffers->ys_buf, y, nHits);
-    alpaka::memcpy(queue, hitsBuffers->zs_buf, z, nHits);
-    alpaka::memcpy(queue, hitsBuffers->detid_buf, detId, nHits);
-    alpaka::memcpy(queue, hitsBuffers->idxs_buf, idxInNtuple, nHits);
-    alpaka::memcpy(queue, hitsBuffers->nHits_buf, nHits_view, 1);
+// Counting sort of the input hits by module into the hit arrays. Also fills hitRanges.
+void SDL::Event::bucketHitsByModule(float* xs, float* ys, float* zs, unsigned int* detIds, unsigned int* idxs, unsigned int nInputHits)
+{
+    uint16_t pixelModuleIndex = (*detIdToIndex)[1];
+
+    auto inputModuleIndices_buf = allocBufWrapper<uint16_t>(devAcc, std::max(nInputHits, 1u), queue);
+    auto moduleCounts_buf = allocBufWrapper<unsigned int>(devAcc, nModules, queue);
+    auto moduleCursors_buf = allocBufWrapper<unsigned int>(devAcc, nModules, queue);
+    alpaka::memset(queue, moduleCounts_buf, 0, nModules);
+
+    Vec const threadsPerBlockCount = createVec(1,1,256);
+    Vec const blocksPerGridCount = createVec(1,1,MAX_BLOCKS);
+    WorkDiv const countHits_workDiv = createWorkDiv(blocksPerGridCount, threadsPerBlockCount, elementsPerThread);
+
+    SDL::countHitsPerModuleKernel countHits_kernel;
+    auto const countHitsTask(alpaka::createTaskKernel<Acc>(
+        countHits_workDiv,
+        countHits_kernel,
+        *modulesInGPU,
+        (unsigned int) nModules,
+        detIds,
+        nInputHits,
+        alpaka::getPtrNative(inputModuleIndices_buf),
+        alpaka::getPtrNative(moduleCounts_buf)));
+
+    alpaka::enqueue(queue, countHitsTask);
+
+    Vec const threadsPerBlockOffsets = createVec(1,1,1024);
+    Vec const blocksPerGridOffsets = createVec(1,1,1);
+    WorkDiv const moduleHitOffsets_workDiv = createWorkDiv(blocksPerGridOffsets, threadsPerBlockOffsets, elementsPerThread);
+
+    SDL::moduleHitOffsetsKernel moduleHitOffsets_kernel;
+    auto const moduleHitOffsetsTask(alpaka::createTaskKernel<Acc>(
+        moduleHitOffsets_workDiv,
+        moduleHitOffsets_kernel,
+        *hitsInGPU,
+        alpaka::getPtrNative(moduleCounts_buf),
+        alpaka::getPtrNative(moduleCursors_buf),
+        (unsigned int) nModules,
+        pixelModuleIndex));
+
+    alpaka::enqueue(queue, moduleHitOffsetsTask);
+
+    // The scatter only records where each input hit went, the hits are then written in a fixed order within their
+    // module: by phi with PHI_SORTED_HITS, by input position otherwise.
+    auto bucketedInputs_buf = allocBufWrapper<unsigned int>(devAcc, std::max(nInputHits, 1u), queue);
+    unsigned int* bucketedInputs = alpaka::getPtrNative(bucketedInputs_buf);
+#ifdef PHI_SORTED_HITS
+    auto bucketedPhis_buf = allocBufWrapper<float>(devAcc, std::max(nInputHits, 1u), queue);
+    float* bucketedPhis = alpaka::getPtrNative(bucketedPhis_buf);
+#else
+    float* bucketedPhis = nullptr;
+#endif
+
+    SDL::scatterHitsKernel scatterHits_kernel;
+    auto const scatterHitsTask(alpaka::createTaskKernel<Acc>(
+        countHits_workDiv,
+        scatterHits_kernel,
+        *hitsInGPU,
+        xs,
+        ys,
+        alpaka::getPtrNative(inputModuleIndices_buf),
+        alpaka::getPtrNative(moduleCounts_buf),
+        alpaka::getPtrNative(moduleCursors_buf),
+        nInputHits,
+        pixelModuleIndex,
+        bucketedInputs,
+        bucketedPhis));
+
+    alpaka::enqueue(queue, scatterHitsTask);
+
+    Vec const threadsPerBlockOrderHits = createVec(1,1,128);
+    Vec const blocksPerGridOrderHits = createVec(1,MAX_BLOCKS,1);
+    WorkDiv const orderBucketedHits_workDiv = createWorkDiv(blocksPerGridOrderHits, threadsPerBlockOrderHits, elementsPerThread);
+
+    SDL::orderBucketedHitsKernel orderBucketedHits_kernel;
+    auto const orderBucketedHitsTask(alpaka::createTaskKernel<Acc>(
+        orderBucketedHits_workDiv,
+        orderBucketedHits_kernel,
+        *hitsInGPU,
+        xs,
+        ys,
+        zs,
+        detIds,
+        idxs,
+        alpaka::getPtrNative(inputModuleIndices_buf),
+        bucketedInputs,
+        bucketedPhis,
+        nInputHits,
+        (unsigned int) nModules,
+        pixelModuleIndex));
+
+    alpaka::enqueue(queue, orderBucketedHitsTask);
+
+    // The scratch buffers are released when this function returns.
     alpaka::wait(queue);
+}
 
+void SDL::Event::computeHitQuantities(unsigned int nHits)
+{
     Vec const threadsPerBlock1 = createVec(1,1,256);
     Vec const blocksPerGrid1 = createVec(1,1,MAX_BLOCKS);
     WorkDiv const hit_loop_workdiv = createWorkDiv(blocksPerGrid1, threadsPerBlock1, elementsPerThread);
@@ -229,10 +419,6 @@ void SDL::Event::addHitToEvent(std::vector<float> x, std::vector<float> y, std::
         hit_loop_kernel,
         Endcap,
         TwoS,
-        nModules,
-        SDL::endcapGeometry->nEndCapMap,
-        alpaka::getPtrNative(SDL::endcapGeometry->geoMapDetId_buf),
-        alpaka::getPtrNative(SDL::endcapGeometry->geoMapPhi_buf),
         *modulesInGPU,
         *hitsInGPU,
         nHits));
@@ -272,9 +458,54 @@ void SDL::Event::addPixelSegmentToEvent(std::vector<unsigned int> hitIndices0,st
         size = N_MAX_PIXEL_SEGMENTS_PER_MODULE;
     }
 
-    int mdSize = 2 * size;
-    uint16_t pixelModuleIndex = (*detIdToIndex)[1];
+    createPixelSegmentMemory();
+
+    SDL::packedInputLayout layout;
+    size_t const hitIndices0_offset = layout.add(hitIndices0.data(), size);
+    size_t const hitIndices1_offset = layout.add(hitIndices1.data(), size);
+    size_t const hitIndices2_offset = layout.add(hitIndices2.data(), size);
+    size_t const hitIndices3_offset = layout.add(hitIndices3.data(), size);
+    size_t const dPhiChange_offset = layout.add(dPhiChange.data(), size);
+    size_t const ptIn_offset = layout.add(ptIn.data(), size);
+    size_t const ptErr_offset = layout.add(ptErr.data(), size);
+    size_t const px_offset = layout.add(px.data(), size);
+    size_t const py_offset = layout.add(py.data(), size);
+    size_t const pz_offset = layout.add(pz.data(), size);
+    size_t const etaErr_offset = layout.add(etaErr.data(), size);
+    size_t const isQuad_offset = layout.add(isQuad.data(), size);
+    size_t const eta_offset = layout.add(eta.data(), size);
+    size_t const phi_offset = layout.add(phi.data(), size);
+    size_t const charge_offset = layout.add(charge.data(), size);
+    size_t const seedIdx_offset = layout.add(seedIdx.data(), size);
+    size_t const superbin_offset = layout.add(superbin.data(), size);
+    size_t const pixelType_offset = layout.add(pixelType.data(), size);
+    char* packedInput = uploadPackedInput(layout);
+
+    copyFromPackedInput<float>(segmentsBuffers->ptIn_buf, packedInput, ptIn_offset, size);
+    copyFromPackedInput<float>(segmentsBuffers->ptErr_buf, packedInput, ptErr_offset, size);
+    copyFromPackedInput<float>(segmentsBuffers->px_buf, packedInput, px_offset, size);
+    copyFromPackedInput<float>(segmentsBuffers->py_buf, packedInput, py_offset, size);
+    copyFromPackedInput<float>(segmentsBuffers->pz_buf, packedInput, pz_offset, size);
+    copyFromPackedInput<float>(segmentsBuffers->etaErr_buf, packedInput, etaErr_offset, size);
+    copyFromPackedInput<char>(segmentsBuffers->isQuad_buf, packedInput, isQuad_offset, size);
+    copyFromPackedInput<float>(segmentsBuffers->eta_buf, packedInput, eta_offset, size);
+    copyFromPackedInput<float>(segmentsBuffers->phi_buf, packedInput, phi_offset, size);
+    copyFromPackedInput<int>(segmentsBuffers->charge_buf, packedInput, charge_offset, size);
+    copyFromPackedInput<unsigned int>(segmentsBuffers->seedIdx_buf, packedInput, seedIdx_offset, size);
+    copyFromPackedInput<int>(segmentsBuffers->superbin_buf, packedInput, superbin_offset, size);
+    copyFromPackedInput<int8_t>(segmentsBuffers->pixelType_buf, packedInput, pixelType_offset, size);
+
+    // The hit indices and dPhiChange are read in place from the packed input.
+    addPixelSegmentsFromDevice(packedColumn<unsigned int>(packedInput, hitIndices0_offset),
+                               packedColumn<unsigned int>(packedInput, hitIndices1_offset),
+                               packedColumn<unsigned int>(packedInput, hitIndices2_offset),
+                               packedColumn<unsigned int>(packedInput, hitIndices3_offset),
+                               packedColumn<float>(packedInput, dPhiChange_offset),
+                               size);
+}
 
+void SDL::Event::createPixelSegmentMemory()
+{
     if(mdsInGPU == nullptr)
     {
         // Create a view for the element nLowerModules inside rangesBuffers->miniDoubletModuleOccupancy
@@ -310,8 +541,11 @@ void SDL::Event::addPixelSegmentToEvent(std::vector<unsigned int> hitIndices0,st
         nTotalMDs += N_MAX_PIXEL_MD_PER_MODULES;
 
         mdsInGPU = new SDL::miniDoublets();
+        allocationCounter counter(deviceBytes[miniDoubletsMemory]);
+        arenaScope scope(arena);
         miniDoubletsBuffers = new SDL::miniDoubletsBuffer<Acc>(nTotalMDs, nLowerModules, devAcc, queue);
         mdsInGPU->setData(*miniDoubletsBuffers);
+        mdsInGPU->setHitData(*hitsInGPU);
 
         alpaka::memcpy(queue, miniDoubletsBuffers->nMemoryLocations_buf, nTotalMDs_view);
         alpaka::wait(queue);
@@ -344,38 +578,20 @@ void SDL::Event::addPixelSegmentToEvent(std::vector<unsigned int> hitIndices0,st
         nTotalSegments += N_MAX_PIXEL_SEGMENTS_PER_MODULE;
 
         segmentsInGPU = new SDL::segments();
+        allocationCounter counter(deviceBytes[segmentsMemory]);
+        arenaScope scope(arena);
         segmentsBuffers = new SDL::segmentsBuffer<Acc>(nTotalSegments, nLowerModules, N_MAX_PIXEL_SEGMENTS_PER_MODULE, devAcc, queue);
         segmentsInGPU->setData(*segmentsBuffers);
 
         alpaka::memcpy(queue, segmentsBuffers->nMemoryLocations_buf, nTotalSegments_view);
         alpaka::wait(queue);
     }
+}
 
-    auto hitIndices0_dev = allocBufWrapper<unsigned int>(devAcc, size, queue);
-    auto hitIndices1_dev = allocBufWrapper<unsigned int>(devAcc, size, queue);
-    auto hitIndices2_dev = allocBufWrapper<unsigned int>(devAcc, size, queue);
-    auto hitIndices3_dev = allocBufWrapper<unsigned int>(devAcc, size, queue);
-    auto dPhiChange_dev = allocBufWrapper<float>(devAcc, size, queue);
-
-    alpaka::memcpy(queue, hitIndices0_dev, hitIndices0, size);
-    alpaka::memcpy(queue, hitIndices1_dev, hitIndices1, size);
-    alpaka::memcpy(queue, hitIndices2_dev, hitIndices2, size);
-    alpaka::memcpy(queue, hitIndices3_dev, hitIndices3, size);
-    alpaka::memcpy(queue, dPhiChange_dev, dPhiChange, size);
-
-    alpaka::memcpy(queue, segmentsBuffers->ptIn_buf, ptIn, size);
-    alpaka::memcpy(queue, segmentsBuffers->ptErr_buf, ptErr, size);
-    alpaka::memcpy(queue, segmentsBuffers->px_buf, px, size);
-    alpaka::memcpy(queue, segmentsBuffers->py_buf, py, size);
-    alpaka::memcpy(queue, segmentsBuffers->pz_buf, pz, size);
-    alpaka::memcpy(queue, segmentsBuffers->etaErr_buf, etaErr, size);
-    alpaka::memcpy(queue, segmentsBuffers->isQuad_buf, isQuad, size);
-    alpaka::memcpy(queue, segmentsBuffers->eta_buf, eta, size);
-    alpaka::memcpy(queue, segmentsBuffers->phi_buf, phi, size);
-    alpaka::memcpy(queue, segmentsBuffers->charge_buf, charge, size);
-    alpaka::memcpy(queue, segmentsBuffers->seedIdx_buf, seedIdx, size);
-    alpaka::memcpy(queue, segmentsBuffers->superbin_buf, superbin, size);
-    alpaka::memcpy(queue, segmentsBuffers->pixelType_buf, pixelType, size);
+void SDL::Event::addPixelSegmentsFromDevice(unsigned int* hitIndices0, unsigned int* hitIndices1, unsigned int* hitIndices2, unsigned int* hitIndices3, float* dPhiChange, int size)
+{
+    int mdSize = 2 * size;
+    uint16_t pixelModuleIndex = (*detIdToIndex)[1];
 
     // Create source views for size and mdSize
     auto src_view_size = alpaka::createView(devHost, &size, (Idx) 1u);
@@ -408,11 +624,11 @@ void SDL::Event::addPixelSegmentToEvent(std::vector<unsigned int> hitIndices0,st
         *hitsInGPU,
         *mdsInGPU,
         *segmentsInGPU,
-        alpaka::getPtrNative(hitIndices0_dev),
-        alpaka::getPtrNative(hitIndices1_dev),
-        alpaka::getPtrNative(hitIndices2_dev),
-        alpaka::getPtrNative(hitIndices3_dev),
-        alpaka::getPtrNative(dPhiChange_dev),
+        hitIndices0,
+        hitIndices1,
+        hitIndices2,
+        hitIndices3,
+        dPhiChange,
         pixelModuleIndex,
         size));
 
@@ -420,6 +636,197 @@ void SDL::Event::addPixelSegmentToEvent(std::vector<unsigned int> hitIndices0,st
     alpaka::wait(queue);
 }
 
+void SDL::Event::addHitAndPixelSeedToEvent(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z, const std::vector<unsigned int>& detId,
+                                            const std::vector<float>& see_px, const std::vector<float>& see_py, const std::vector<float>& see_pz,
+                                            const std::vector<float>& see_dxy, const std::vector<float>& see_dz, const std::vector<float>& see_ptErr, const std::vector<float>& see_etaErr,
+                                            const std::vector<float>& see_stateTrajGlbX, const std::vector<float>& see_stateTrajGlbY, const std::vector<float>& see_stateTrajGlbZ,
+                                            const std::vector<float>& see_stateTrajGlbPx, const std::vector<float>& see_stateTrajGlbPy, const std::vector<float>& see_stateTrajGlbPz,
+                                            const std::vector<int>& see_q, const std::vector<std::vector<int>>& see_hitIdx, const std::vector<unsigned int>& seedIdx,
+                                            bool cmsswDeltaPhiChange)
+{
+    unsigned int nOuterHits = x.size();
+    unsigned int nSeeds = see_px.size();
+
+    // Each seed adds at most 4 pseudo-hits after the outer tracker hits.
+    if (hitsInGPU == nullptr)
+    {
+        hitsInGPU = new SDL::hits();
+        allocationCounter counter(deviceBytes[hitsMemory]);
+        arenaScope scope(arena);
+        hitsBuffers = new SDL::hitsBuffer<Acc>(nModules, nOuterHits + 4 * nSeeds, devAcc, queue);
+        hitsCapacity = nOuterHits + 4 * nSeeds;
+        hitsInGPU->setData(*hitsBuffers);
+    }
+
+    if (rangesInGPU == nullptr)
+    {
+        rangesInGPU = new SDL::objectRanges();
+        allocationCounter counter(deviceBytes[rangesMemory]);
+        arenaScope scope(arena);
+        rangesBuffers = new SDL::objectRangesBuffer<Acc>(nModules, nLowerModules, devAcc, queue);
+        rangesInGPU->setData(*rangesBuffers);
+    }
+
+    createPixelSegmentMemory();
+
+    // The seed hit lists are ragged, so they are flattened to 4 entries per seed before the transfer.
+    std::vector<unsigned int> seedHitIdxs(4 * nSeeds);
+    std::vector<char> isQuad(nSeeds);
+    for (unsigned int iSeed = 0; iSeed < nSeeds; iSeed++)
+    {
+        const std::vector<int>& hitIdx = see_hitIdx[iSeed];
+        isQuad[iSeed] = hitIdx.size() > 3;
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            seedHitIdxs[4 * iSeed + i] = hitIdx[std::min<size_t>(i, hitIdx.size() - 1)];
+            pixelHitIdxRange = std::max(pixelHitIdxRange, seedHitIdxs[4 * iSeed + i] + 1);
+        }
+    }
+    // The outer tracker hits are indexed by their position in the input.
+    outerHitIdxRange = nOuterHits;
+
+    // All hit and seed inputs go to the device in one transfer.
+    SDL::packedInputLayout layout;
+    size_t const seedOffsets[18] = {
+        layout.add(&nSeeds, 1),
+        layout.add(see_px),
+        layout.add(see_py),
+        layout.add(see_pz),
+        layout.add(see_dxy),
+        layout.add(see_dz),
+        layout.add(see_ptErr),
+        layout.add(see_etaErr),
+        layout.add(see_stateTrajGlbX),
+        layout.add(see_stateTrajGlbY),
+        layout.add(see_stateTrajGlbZ),
+        layout.add(see_stateTrajGlbPx),
+        layout.add(see_stateTrajGlbPy),
+        layout.add(see_stateTrajGlbPz),
+        layout.add(see_q),
+        layout.add(seedIdx),
+        layout.add(seedHitIdxs),
+        layout.add(isQuad)};
+    size_t const x_offset = layout.add(x);
+    size_t const y_offset = layout.add(y);
+    size_t const z_offset = layout.add(z);
+    size_t const detId_offset = layout.add(detId);
+    char* packedInput = uploadPackedInput(layout);
+
+    SDL::pixelSeeds seedsInGPU;
+    SDL::pixelSeedsBuffer<Acc> seedsBuffers(nSeeds, devAcc, queue);
+    seedsInGPU.setData(seedsBuffers);
+    seedsInGPU.setInputs(packedInput, seedOffsets);
+
+    Vec const threadsPerBlockSelect = createVec(1,1,1024);
+    Vec const blocksPerGridSelect = createVec(1,1,1);
+    WorkDiv const selectPixelSeeds_workDiv = createWorkDiv(blocksPerGridSelect, threadsPerBlockSelect, elementsPerThread);
+
+    SDL::selectPixelSeedsKernel selectPixelSeeds_kernel;
+    auto const selectPixelSeedsTask(alpaka::createTaskKernel<Acc>(
+        selectPixelSeeds_workDiv,
+        selectPixelSeeds_kernel,
+        *hitsInGPU,
+        seedsInGPU,
+        nOuterHits));
+
+    alpaka::enqueue(queue, selectPixelSeedsTask);
+
+    Vec const threadsPerBlockPrepare = createVec(1,1,256);
+    Vec const blocksPerGridPrepare = createVec(1,1,MAX_BLOCKS);
+    WorkDiv const preparePixelSeeds_workDiv = createWorkDiv(blocksPerGridPrepare, threadsPerBlockPrepare, elementsPerThread);
+
+    SDL::preparePixelSeedsKernel preparePixelSeeds_kernel;
+    auto const preparePixelSeedsTask(alpaka::createTaskKernel<Acc>(
+        preparePixelSeeds_workDiv,
+        preparePixelSeeds_kernel,
+        *hitsInGPU,
+        *segmentsInGPU,
+        seedsInGPU,
+        nOuterHits,
+        (uint16_t) (*detIdToIndex)[1],
+        cmsswDeltaPhiChange));
+
+    alpaka::enqueue(queue, preparePixelSeedsTask);
+
+    // The outer tracker hits are bucketed by module in front of the pixel pseudo-hits.
+    bucketHitsByModule(packedColumn<float>(packedInput, x_offset),
+                       packedColumn<float>(packedInput, y_offset),
+                       packedColumn<float>(packedInput, z_offset),
+                       packedColumn<unsigned int>(packedInput, detId_offset),
+                       nullptr,
+                       nOuterHits);
+
+    unsigned int nHits;
+    auto nHits_view = alpaka::createView(devHost, &nHits, (Idx) 1u);
+    alpaka::memcpy(queue, nHits_view, hitsBuffers->nHits_buf);
+
+    unsigned int nPixelSegments;
+    auto nPixelSegments_view = alpaka::createView(devHost, &nPixelSegments, (Idx) 1u);
+    alpaka::memcpy(queue, nPixelSegments_view, seedsBuffers.nPixelSegments_buf);
+    alpaka::wait(queue);
+
+    computeHitQuantities(nHits);
+
+    int size = nPixelSegments;
+    if (size > N_MAX_PIXEL_SEGMENTS_PER_MODULE)
+    {
+        printf(
+               "*********************************************************\n"
+               "* Warning: Pixel line segments will be truncated.       *\n"
+               "* You need to increase N_MAX_PIXEL_SEGMENTS_PER_MODULE. *\n"
+               "*********************************************************\n"
+               );
+        size = N_MAX_PIXEL_SEGMENTS_PER_MODULE;
+    }
+
+    addPixelSegmentsFromDevice(seedsInGPU.hitIndices0,
+                               seedsInGPU.hitIndices1,
+                               seedsInGPU.hitIndices2,
+                               seedsInGPU.hitIndices3,
+                               seedsInGPU.dPhiChange,
+                               size);
+}
+
+// Fills the device side list of the lower modules with work in a stage, from the per module counts of its input objects.
+template<typename TCount>
+void SDL::Event::createActiveModuleList(SDL::ActiveModuleStage stage, const TCount* nInner, const TCount* nOuter)
+{
+    Vec const threadsPerBlockActiveModules = createVec(1,1,1024);
+    Vec const blocksPerGridActiveModules = createVec(1,1,1);
+    WorkDiv const createActiveModuleListInGPU_workDiv = createWorkDiv(blocksPerGridActiveModules, threadsPerBlockActiveModules, elementsPerThread);
+
+    SDL::createActiveModuleListInGPU createActiveModuleListInGPU_kernel;
+    auto const createActiveModuleListInGPUTask(alpaka::createTaskKernel<Acc>(
+        createActiveModuleListInGPU_workDiv,
+        createActiveModuleListInGPU_kernel,
+        *modulesInGPU,
+        *rangesInGPU,
+        stage,
+        nInner,
+        nOuter));
+
+    alpaka::enqueue(queue, createActiveModuleListInGPUTask);
+}
+
+// Sets the per module object counts of a stage from the occupancy counters its build kernel incremented.
+void SDL::Event::setObjectCounts(const int* totOccupancy, const int* occupancy, int* nObjects)
+{
+    Vec const threadsPerBlockObjectCounts = createVec(1,1,1024);
+    Vec const blocksPerGridObjectCounts = createVec(1,1,1);
+    WorkDiv const setModuleObjectCounts_workDiv = createWorkDiv(blocksPerGridObjectCounts, threadsPerBlockObjectCounts, elementsPerThread);
+
+    SDL::setModuleObjectCounts setModuleObjectCounts_kernel;
+    auto const setModuleObjectCountsTask(alpaka::createTaskKernel<Acc>(
+        setModuleObjectCounts_workDiv,
+        setModuleObjectCounts_kernel,
+        *modulesInGPU,
+        totOccupancy,
+        occupancy,
+        nObjects));
+
+    alpaka::enqueue(queue, setModuleObjectCountsTask);
+}
+
 void SDL::Event::createMiniDoublets()
 {
     // Create a view for the element nLowerModules inside rangesBuffers->miniDoubletModuleOccupancy
@@ -458,13 +865,18 @@ void SDL::Event::createMiniDoublets()
     if(mdsInGPU == nullptr)
     {
         mdsInGPU = new SDL::miniDoublets();
+        allocationCounter counter(deviceBytes[miniDoubletsMemory]);
+        arenaScope scope(arena);
         miniDoubletsBuffers = new SDL::miniDoubletsBuffer<Acc>(nTotalMDs, nLowerModules, devAcc, queue);
         mdsInGPU->setData(*miniDoubletsBuffers);
+        mdsInGPU->setHitData(*hitsInGPU);
     }
 
+    createActiveModuleList(SDL::MDStage, hitsInGPU->hitRangesnLower, hitsInGPU->hitRangesnUpper);
+
     Vec const threadsPerBlockCreateMDInGPU = createVec(1,16,32);
     Vec const blocksPerGridCreateMDInGPU = createVec(1,nLowerModules/threadsPerBlockCreateMDInGPU[1],1);
-    WorkDiv const createMiniDoubletsInGPUv2_workDiv = createWorkDiv(blocksPerGridCreateMDInGPU, threadsPerBlockCreateMDInGPU, elementsPerThread);
+    WorkDiv const createMiniDoubletsInGPUv2_workDiv = createWorkDiv(blocksPerGridCreateMDInGPU, threadsPerBlockCreateMDInGPU, candidateElementsPerThread);
 
     SDL::createMiniDoubletsInGPUv2 createMiniDoubletsInGPUv2_kernel;
     auto const createMiniDoubletsInGPUv2Task(alpaka::createTaskKernel<Acc>(
@@ -476,6 +888,23 @@ void SDL::Event::createMiniDoublets()
         *rangesInGPU));
 
     alpaka::enqueue(queue, createMiniDoubletsInGPUv2Task);
+    setObjectCounts(mdsInGPU->totOccupancyMDs, rangesInGPU->miniDoubletModuleOccupancy, mdsInGPU->nMDs);
+
+#ifdef PHI_SORTED_MDS
+    Vec const threadsPerBlockSortMDs = createVec(1,1,64);
+    Vec const blocksPerGridSortMDs = createVec(1,MAX_BLOCKS,1);
+    WorkDiv const sortMDsByPhi_workDiv = createWorkDiv(blocksPerGridSortMDs, threadsPerBlockSortMDs, elementsPerThread);
+
+    SDL::sortMDsByPhiKernel sortMDsByPhi_kernel;
+    auto const sortMDsByPhiTask(alpaka::createTaskKernel<Acc>(
+        sortMDsByPhi_workDiv,
+        sortMDsByPhi_kernel,
+        *modulesInGPU,
+        *mdsInGPU,
+        *rangesInGPU));
+
+    alpaka::enqueue(queue, sortMDsByPhiTask);
+#endif
 
     Vec const threadsPerBlockAddMD = createVec(1,1,1024);
     Vec const blocksPerGridAddMD = createVec(1,1,1);
@@ -504,13 +933,17 @@ void SDL::Event::createSegmentsWithModuleMap()
     if(segmentsInGPU == nullptr)
     {
         segmentsInGPU = new SDL::segments();
+        allocationCounter counter(deviceBytes[segmentsMemory]);
+        arenaScope scope(arena);
         segmentsBuffers = new SDL::segmentsBuffer<Acc>(nTotalSegments, nLowerModules, N_MAX_PIXEL_SEGMENTS_PER_MODULE, devAcc, queue);
         segmentsInGPU->setData(*segmentsBuffers);
     }
 
+    createActiveModuleList(SDL::SegmentStage, mdsInGPU->nMDs);
+
     Vec const threadsPerBlockCreateSeg = createVec(1,1,64);
     Vec const blocksPerGridCreateSeg = createVec(1,1,nLowerModules);
-    WorkDiv const createSegmentsInGPUv2_workDiv = createWorkDiv(blocksPerGridCreateSeg, threadsPerBlockCreateSeg, elementsPerThread);
+    WorkDiv const createSegmentsInGPUv2_workDiv = createWorkDiv(blocksPerGridCreateSeg, threadsPerBlockCreateSeg, candidateElementsPerThread);
 
     SDL::createSegmentsInGPUv2 createSegmentsInGPUv2_kernel;
     auto const createSegmentsInGPUv2Task(alpaka::createTaskKernel<Acc>(
@@ -522,6 +955,22 @@ void SDL::Event::createSegmentsWithModuleMap()
         *rangesInGPU));
 
     alpaka::enqueue(queue, createSegmentsInGPUv2Task);
+    setObjectCounts(segmentsInGPU->totOccupancySegments, rangesInGPU->segmentModuleOccupancy, segmentsInGPU->nSegments);
+
+    Vec const threadsPerBlockOutgoingSeg = createVec(1,1,256);
+    Vec const blocksPerGridOutgoingSeg = createVec(1,1,MAX_BLOCKS);
+    WorkDiv const buildOutgoingSegmentIndex_workDiv = createWorkDiv(blocksPerGridOutgoingSeg, threadsPerBlockOutgoingSeg, elementsPerThread);
+
+    SDL::buildOutgoingSegmentIndex buildOutgoingSegmentIndex_kernel;
+    auto const buildOutgoingSegmentIndexTask(alpaka::createTaskKernel<Acc>(
+        buildOutgoingSegmentIndex_workDiv,
+        buildOutgoingSegmentIndex_kernel,
+        *modulesInGPU,
+        *mdsInGPU,
+        *segmentsInGPU,
+        *rangesInGPU));
+
+    alpaka::enqueue(queue, buildOutgoingSegmentIndexTask);
 
     Vec const threadsPerBlockAddSeg = createVec(1,1,1024);
     Vec const blocksPerGridAddSeg = createVec(1,1,1);
@@ -570,6 +1019,8 @@ void SDL::Event::createTriplets()
         alpaka::wait(queue);
 
         tripletsInGPU = new SDL::triplets();
+        allocationCounter counter(deviceBytes[tripletsMemory]);
+        arenaScope scope(arena);
         tripletsBuffers = new SDL::tripletsBuffer<Acc>(*alpaka::getPtrNative(maxTriplets_buf), nLowerModules, devAcc, queue);
         tripletsInGPU->setData(*tripletsBuffers);
 
@@ -577,49 +1028,11 @@ void SDL::Event::createTriplets()
         alpaka::wait(queue);
     }
 
-    uint16_t nonZeroModules = 0;
-    unsigned int max_InnerSeg = 0;
-
-    // Allocate host index
-    auto index_buf = allocBufWrapper<uint16_t>(devHost, nLowerModules, queue);
-    uint16_t *index = alpaka::getPtrNative(index_buf);
-
-    // Allocate device index
-    auto index_gpu_buf = allocBufWrapper<uint16_t>(devAcc, nLowerModules, queue);
-
-    // Allocate and copy nSegments from device to host
-    auto nSegments_buf = allocBufWrapper<int>(devHost, nLowerModules, queue);
-    alpaka::memcpy(queue, nSegments_buf, segmentsBuffers->nSegments_buf, nLowerModules);
-    alpaka::wait(queue);
-
-    int *nSegments = alpaka::getPtrNative(nSegments_buf);
-
-    // Allocate and copy module_nConnectedModules from device to host
-    auto module_nConnectedModules_buf = allocBufWrapper<uint16_t>(devHost, nLowerModules, queue);
-    alpaka::memcpy(queue, module_nConnectedModules_buf, modulesBuffers->nConnectedModules_buf, nLowerModules);
-    alpaka::wait(queue);
-
-    uint16_t* module_nConnectedModules = alpaka::getPtrNative(module_nConnectedModules_buf);
-
-    for (uint16_t innerLowerModuleIndex = 0; innerLowerModuleIndex < nLowerModules; innerLowerModuleIndex++)
-    {
-        uint16_t nConnectedModules = module_nConnectedModules[innerLowerModuleIndex];
-        unsigned int nInnerSegments = nSegments[innerLowerModuleIndex];
-        if (nConnectedModules != 0 and nInnerSegments != 0) 
-        {
-            index[nonZeroModules] = innerLowerModuleIndex;
-            nonZeroModules++;
-        }
-        max_InnerSeg = std::max(max_InnerSeg, nInnerSegments);
-    }
-
-    // Copy index from host to device
-    alpaka::memcpy(queue, index_gpu_buf, index_buf, nonZeroModules);
-    alpaka::wait(queue);
+    createActiveModuleList(SDL::TripletStage, segmentsInGPU->nSegments);
 
     Vec const threadsPerBlockCreateTrip = createVec(1,16,16);
     Vec const blocksPerGridCreateTrip = createVec(MAX_BLOCKS,1,1);
-    WorkDiv const createTripletsInGPUv2_workDiv = createWorkDiv(blocksPerGridCreateTrip, threadsPerBlockCreateTrip, elementsPerThread);
+    WorkDiv const createTripletsInGPUv2_workDiv = createWorkDiv(blocksPerGridCreateTrip, threadsPerBlockCreateTrip, candidateElementsPerThread);
 
     SDL::createTripletsInGPUv2 createTripletsInGPUv2_kernel;
     auto const createTripletsInGPUv2Task(alpaka::createTaskKernel<Acc>(
@@ -629,11 +1042,25 @@ void SDL::Event::createTriplets()
         *mdsInGPU,
         *segmentsInGPU,
         *tripletsInGPU,
-        *rangesInGPU,
-        alpaka::getPtrNative(index_gpu_buf),
-        nonZeroModules));
+        *rangesInGPU));
 
     alpaka::enqueue(queue, createTripletsInGPUv2Task);
+    setObjectCounts(tripletsInGPU->totOccupancyTriplets, rangesInGPU->tripletModuleOccupancy, tripletsInGPU->nTriplets);
+
+    Vec const threadsPerBlockOutgoingTrip = createVec(1,1,256);
+    Vec const blocksPerGridOutgoingTrip = createVec(1,1,MAX_BLOCKS);
+    WorkDiv const buildOutgoingTripletIndex_workDiv = createWorkDiv(blocksPerGridOutgoingTrip, threadsPerBlockOutgoingTrip, elementsPerThread);
+
+    SDL::buildOutgoingTripletIndex buildOutgoingTripletIndex_kernel;
+    auto const buildOutgoingTripletIndexTask(alpaka::createTaskKernel<Acc>(
+        buildOutgoingTripletIndex_workDiv,
+        buildOutgoingTripletIndex_kernel,
+        *modulesInGPU,
+        *segmentsInGPU,
+        *tripletsInGPU,
+        *rangesInGPU));
+
+    alpaka::enqueue(queue, buildOutgoingTripletIndexTask);
 
     Vec const threadsPerBlockAddTrip = createVec(1,1,1024);
     Vec const blocksPerGridAddTrip = createVec(1,1,1);
@@ -661,6 +1088,8 @@ void SDL::Event::createTrackCandidates()
     if(trackCandidatesInGPU == nullptr)
     {
         trackCandidatesInGPU = new SDL::trackCandidates();
+        allocationCounter counter(deviceBytes[trackCandidatesMemory]);
+        arenaScope scope(arena);
         trackCandidatesBuffers = new SDL::trackCandidatesBuffer<Acc>(N_MAX_NONPIXEL_TRACK_CANDIDATES + N_MAX_PIXEL_TRACK_CANDIDATES, devAcc, queue);
         trackCandidatesInGPU->setData(*trackCandidatesBuffers);
     }
@@ -671,21 +1100,67 @@ void SDL::Event::createTrackCandidates()
     alpaka::wait(queue);
     uint16_t nEligibleModules = *alpaka::getPtrNative(nEligibleModules_buf);
 
-    Vec const threadsPerBlock_crossCleanpT3 = createVec(1,16,64);
-    Vec const blocksPerGrid_crossCleanpT3 = createVec(1,4,20);
-    WorkDiv const crossCleanpT3_workDiv = createWorkDiv(blocksPerGrid_crossCleanpT3, threadsPerBlock_crossCleanpT3, elementsPerThread);
+    // One owner key per ntuple hit index for the hit ownership selection, the pixel hits after the outer tracker ones
+    unsigned int nHitOwners = outerHitIdxRange + pixelHitIdxRange;
+    auto hitOwners_buf = allocBufWrapper<unsigned long long>(devAcc, hitOwnershipTC ? std::max(nHitOwners, 1u) : 1, queue);
+    if(hitOwnershipTC)
+    {
+        alpaka::memset(queue, hitOwners_buf, 0, nHitOwners);
 
-    SDL::crossCleanpT3 crossCleanpT3_kernel;
-    auto const crossCleanpT3Task(alpaka::createTaskKernel<Acc>(
-        crossCleanpT3_workDiv,
-        crossCleanpT3_kernel,
-        *modulesInGPU,
-        *rangesInGPU,
-        *pixelTripletsInGPU,
-        *segmentsInGPU,
-        *pixelQuintupletsInGPU));
+        Vec const threadsPerBlock_hitOwnership = createVec(1,8,128);
+        Vec const blocksPerGrid_hitOwnership = createVec(1,MAX_BLOCKS,1);
+        WorkDiv const hitOwnership_workDiv = createWorkDiv(blocksPerGrid_hitOwnership, threadsPerBlock_hitOwnership, elementsPerThread);
+
+        SDL::claimHitsInGPU claimHitsInGPU_kernel;
+        auto const claimHitsInGPUTask(alpaka::createTaskKernel<Acc>(
+            hitOwnership_workDiv,
+            claimHitsInGPU_kernel,
+            *modulesInGPU,
+            *rangesInGPU,
+            *pixelQuintupletsInGPU,
+            *pixelTripletsInGPU,
+            *quintupletsInGPU,
+            *segmentsInGPU,
+            *hitsInGPU,
+            outerHitIdxRange,
+            alpaka::getPtrNative(hitOwners_buf)));
+
+        alpaka::enqueue(queue, claimHitsInGPUTask);
+
+        SDL::selectTrackCandidatesByHitOwnershipInGPU selectTrackCandidatesByHitOwnershipInGPU_kernel;
+        auto const selectTrackCandidatesByHitOwnershipInGPUTask(alpaka::createTaskKernel<Acc>(
+            hitOwnership_workDiv,
+            selectTrackCandidatesByHitOwnershipInGPU_kernel,
+            *modulesInGPU,
+            *rangesInGPU,
+            *pixelQuintupletsInGPU,
+            *pixelTripletsInGPU,
+            *quintupletsInGPU,
+            *segmentsInGPU,
+            *hitsInGPU,
+            outerHitIdxRange,
+            alpaka::getPtrNative(hitOwners_buf)));
+
+        alpaka::enqueue(queue, selectTrackCandidatesByHitOwnershipInGPUTask);
+    }
+    else
+    {
+        Vec const threadsPerBlock_crossCleanpT3 = createVec(1,16,64);
+        Vec const blocksPerGrid_crossCleanpT3 = createVec(1,4,20);
+        WorkDiv const crossCleanpT3_workDiv = createWorkDiv(blocksPerGrid_crossCleanpT3, threadsPerBlock_crossCleanpT3, elementsPerThread);
+
+        SDL::crossCleanpT3 crossCleanpT3_kernel;
+        auto const crossCleanpT3Task(alpaka::createTaskKernel<Acc>(
+            crossCleanpT3_workDiv,
+            crossCleanpT3_kernel,
+            *modulesInGPU,
+            *rangesInGPU,
+            *pixelTripletsInGPU,
+            *segmentsInGPU,
+            *pixelQuintupletsInGPU));
 
-    alpaka::enqueue(queue, crossCleanpT3Task);
+        alpaka::enqueue(queue, crossCleanpT3Task);
+    }
 
     Vec const threadsPerBlock_addpT3asTrackCandidatesInGPU = createVec(1,1,512);
     Vec const blocksPerGrid_addpT3asTrackCandidatesInGPU = createVec(1,1,1);
@@ -703,34 +1178,51 @@ void SDL::Event::createTrackCandidates()
 
     alpaka::enqueue(queue, addpT3asTrackCandidatesInGPUTask);
 
-    Vec const threadsPerBlockRemoveDupQuints = createVec(1,16,32);
-    Vec const blocksPerGridRemoveDupQuints = createVec(1,std::max(nEligibleModules/16,1),std::max(nEligibleModules/32,1));
-    WorkDiv const removeDupQuintupletsInGPUBeforeTC_workDiv = createWorkDiv(blocksPerGridRemoveDupQuints, threadsPerBlockRemoveDupQuints, elementsPerThread);
+    if(not hitOwnershipTC)
+    {
+        Vec const threadsPerBlockRemoveDupQuints = createVec(1,16,32);
+        Vec const blocksPerGridRemoveDupQuints = createVec(1,std::max(nEligibleModules/16,1),std::max(nEligibleModules/32,1));
+        WorkDiv const removeDupQuintupletsInGPUBeforeTC_workDiv = createWorkDiv(blocksPerGridRemoveDupQuints, threadsPerBlockRemoveDupQuints, elementsPerThread);
+
+        SDL::removeDupQuintupletsInGPUBeforeTC removeDupQuintupletsInGPUBeforeTC_kernel;
+        auto const removeDupQuintupletsInGPUBeforeTCTask(alpaka::createTaskKernel<Acc>(
+            removeDupQuintupletsInGPUBeforeTC_workDiv,
+            removeDupQuintupletsInGPUBeforeTC_kernel,
+            *quintupletsInGPU,
+            *rangesInGPU));
 
-    SDL::removeDupQuintupletsInGPUBeforeTC removeDupQuintupletsInGPUBeforeTC_kernel;
-    auto const removeDupQuintupletsInGPUBeforeTCTask(alpaka::createTaskKernel<Acc>(
-        removeDupQuintupletsInGPUBeforeTC_workDiv,
-        removeDupQuintupletsInGPUBeforeTC_kernel,
-        *quintupletsInGPU,
-        *rangesInGPU));
+        alpaka::enqueue(queue, removeDupQuintupletsInGPUBeforeTCTask);
 
-    alpaka::enqueue(queue, removeDupQuintupletsInGPUBeforeTCTask);
+        Vec const threadsPerBlockFlagDupQuints = createVec(1,1,128);
+        Vec const blocksPerGridFlagDupQuints = createVec(1,MAX_BLOCKS*4,1);
+        WorkDiv const flagDupQuintupletsInGPU_workDiv = createWorkDiv(blocksPerGridFlagDupQuints, threadsPerBlockFlagDupQuints, elementsPerThread);
 
-    Vec const threadsPerBlock_crossCleanT5 = createVec(32,1,32);
-    Vec const blocksPerGrid_crossCleanT5 = createVec((13296/32) + 1,1,MAX_BLOCKS);
-    WorkDiv const crossCleanT5_workDiv = createWorkDiv(blocksPerGrid_crossCleanT5, threadsPerBlock_crossCleanT5, elementsPerThread);
+        SDL::flagDupQuintupletsInGPU flagDupQuintupletsInGPU_kernel;
+        auto const flagDupQuintupletsInGPUTask(alpaka::createTaskKernel<Acc>(
+            flagDupQuintupletsInGPU_workDiv,
+            flagDupQuintupletsInGPU_kernel,
+            *modulesInGPU,
+            *quintupletsInGPU,
+            *rangesInGPU));
 
-    SDL::crossCleanT5 crossCleanT5_kernel;
-    auto const crossCleanT5Task(alpaka::createTaskKernel<Acc>(
-        crossCleanT5_workDiv,
-        crossCleanT5_kernel,
-        *modulesInGPU,
-        *quintupletsInGPU,
-        *pixelQuintupletsInGPU,
-        *pixelTripletsInGPU,
-        *rangesInGPU));
+        alpaka::enqueue(queue, flagDupQuintupletsInGPUTask);
 
-    alpaka::enqueue(queue, crossCleanT5Task);
+        Vec const threadsPerBlock_crossCleanT5 = createVec(32,1,32);
+        Vec const blocksPerGrid_crossCleanT5 = createVec((13296/32) + 1,1,MAX_BLOCKS);
+        WorkDiv const crossCleanT5_workDiv = createWorkDiv(blocksPerGrid_crossCleanT5, threadsPerBlock_crossCleanT5, elementsPerThread);
+
+        SDL::crossCleanT5 crossCleanT5_kernel;
+        auto const crossCleanT5Task(alpaka::createTaskKernel<Acc>(
+            crossCleanT5_workDiv,
+            crossCleanT5_kernel,
+            *modulesInGPU,
+            *quintupletsInGPU,
+            *pixelQuintupletsInGPU,
+            *pixelTripletsInGPU,
+            *rangesInGPU));
+
+        alpaka::enqueue(queue, crossCleanT5Task);
+    }
 
     Vec const threadsPerBlock_addT5asTrackCandidateInGPU = createVec(1,8,128);
     Vec const blocksPerGrid_addT5asTrackCandidateInGPU = createVec(1,8,10);
@@ -748,21 +1240,26 @@ void SDL::Event::createTrackCandidates()
     alpaka::enqueue(queue, addT5asTrackCandidateInGPUTask);
 
 #ifndef NOPLSDUPCLEAN
-    Vec const threadsPerBlockCheckHitspLS = createVec(1,16,16);
-    Vec const blocksPerGridCheckHitspLS = createVec(1,MAX_BLOCKS*4,MAX_BLOCKS/4);
-    WorkDiv const checkHitspLS_workDiv = createWorkDiv(blocksPerGridCheckHitspLS, threadsPerBlockCheckHitspLS, elementsPerThread);
-
-    SDL::checkHitspLS checkHitspLS_kernel;
-    auto const checkHitspLSTask(alpaka::createTaskKernel<Acc>(
-        checkHitspLS_workDiv,
-        checkHitspLS_kernel,
-        *modulesInGPU,
-        *segmentsInGPU,
-        true));
+    if(not hitOwnershipTC)
+    {
+        Vec const threadsPerBlockCheckHitspLS = createVec(1,16,16);
+        Vec const blocksPerGridCheckHitspLS = createVec(1,MAX_BLOCKS*4,MAX_BLOCKS/4);
+        WorkDiv const checkHitspLS_workDiv = createWorkDiv(blocksPerGridCheckHitspLS, threadsPerBlockCheckHitspLS, elementsPerThread);
+
+        SDL::checkHitspLS checkHitspLS_kernel;
+        auto const checkHitspLSTask(alpaka::createTaskKernel<Acc>(
+            checkHitspLS_workDiv,
+            checkHitspLS_kernel,
+            *modulesInGPU,
+            *segmentsInGPU,
+            true));
 
-    alpaka::enqueue(queue, checkHitspLSTask);
+        alpaka::enqueue(queue, checkHitspLSTask);
+    }
 #endif
 
+    // Also run with the hit ownership selection: a pLS and a T5 share no hits,
+    // their overlap is only found by the eta/phi matching done here.
     Vec const threadsPerBlock_crossCleanpLS = createVec(1,16,32);
     Vec const blocksPerGrid_crossCleanpLS = createVec(1,4,20);
     WorkDiv const crossCleanpLS_workDiv = createWorkDiv(blocksPerGrid_crossCleanpLS, threadsPerBlock_crossCleanpLS, elementsPerThread);
@@ -829,6 +1326,8 @@ void SDL::Event::createPixelTriplets()
     if(pixelTripletsInGPU == nullptr)
     {
         pixelTripletsInGPU = new SDL::pixelTriplets();
+        allocationCounter counter(deviceBytes[pixelTripletsMemory]);
+        arenaScope scope(arena);
         pixelTripletsBuffers = new SDL::pixelTripletsBuffer<Acc>(N_MAX_PIXEL_TRIPLETS, devAcc, queue);
         pixelTripletsInGPU->setData(*pixelTripletsBuffers);
     }
@@ -932,8 +1431,7 @@ void SDL::Event::createPixelTriplets()
 
     //pT3s can be cleaned here because they're not used in making pT5s!
     Vec const threadsPerBlockDupPixTrip = createVec(1,16,16);
-    //seems like more blocks lead to conflicting writes
-    Vec const blocksPerGridDupPixTrip = createVec(1,40,1);
+    Vec const blocksPerGridDupPixTrip = createVec(1,MAX_BLOCKS,1);
     WorkDiv const removeDupPixelTripletsInGPUFromMap_workDiv = createWorkDiv(blocksPerGridDupPixTrip, threadsPerBlockDupPixTrip, elementsPerThread);
 
     SDL::removeDupPixelTripletsInGPUFromMap removeDupPixelTripletsInGPUFromMap_kernel;
@@ -944,6 +1442,18 @@ void SDL::Event::createPixelTriplets()
         false));
 
     alpaka::enqueue(queue, removeDupPixelTripletsInGPUFromMapTask);
+
+    Vec const threadsPerBlockFlagDupPixTrip = createVec(1,1,256);
+    Vec const blocksPerGridFlagDupPixTrip = createVec(1,1,MAX_BLOCKS);
+    WorkDiv const flagDupPixelTripletsInGPU_workDiv = createWorkDiv(blocksPerGridFlagDupPixTrip, threadsPerBlockFlagDupPixTrip, elementsPerThread);
+
+    SDL::flagDupPixelTripletsInGPU flagDupPixelTripletsInGPU_kernel;
+    auto const flagDupPixelTripletsInGPUTask(alpaka::createTaskKernel<Acc>(
+        flagDupPixelTripletsInGPU_workDiv,
+        flagDupPixelTripletsInGPU_kernel,
+        *pixelTripletsInGPU));
+
+    alpaka::enqueue(queue, flagDupPixelTripletsInGPUTask);
     alpaka::wait(queue);
 }
 
@@ -977,6 +1487,8 @@ void SDL::Event::createQuintuplets()
     if(quintupletsInGPU == nullptr)
     {
         quintupletsInGPU = new SDL::quintuplets();
+        allocationCounter counter(deviceBytes[quintupletsMemory]);
+        arenaScope scope(arena);
         quintupletsBuffers = new SDL::quintupletsBuffer<Acc>(nTotalQuintuplets, nLowerModules, devAcc, queue);
         quintupletsInGPU->setData(*quintupletsBuffers);
 
@@ -984,6 +1496,18 @@ void SDL::Event::createQuintuplets()
         alpaka::wait(queue);
     }
 
+    // With the deferred T5 DNN the candidates passing the other cuts are staged here and evaluated in one batch.
+    SDL::t5DNNCandidates t5DNNCandidatesInGPU{};
+    std::optional<SDL::t5DNNCandidatesBuffer<Acc>> t5DNNCandidatesBuffers;
+    if constexpr (SDL::deferredT5DNN)
+    {
+        t5DNNCandidatesBuffers.emplace(nTotalQuintuplets, devAcc, queue);
+        t5DNNCandidatesInGPU.setData(*t5DNNCandidatesBuffers);
+        alpaka::memcpy(queue, t5DNNCandidatesBuffers->nMemoryLocations_buf, nTotalQuintuplets_buf, 1);
+    }
+
+    createActiveModuleList(SDL::QuintupletStage, tripletsInGPU->nTriplets);
+
     Vec const threadsPerBlockQuints = createVec(1,8,32);
     Vec const blocksPerGridQuints = createVec(std::max((int) nEligibleT5Modules, 1),1,1);
     WorkDiv const createQuintupletsInGPUv2_workDiv = createWorkDiv(blocksPerGridQuints, threadsPerBlockQuints, elementsPerThread);
@@ -998,10 +1522,43 @@ void SDL::Event::createQuintuplets()
         *tripletsInGPU,
         *quintupletsInGPU,
         *rangesInGPU,
-        nEligibleT5Modules));
+        t5DNNCandidatesInGPU,
+        SDL::t5DNNWeights->getWeights()));
 
     alpaka::enqueue(queue, createQuintupletsInGPUv2Task);
 
+    if constexpr (SDL::deferredT5DNN)
+    {
+        Vec const threadsPerBlockT5DNN = createVec(1,1,256);
+        Vec const blocksPerGridT5DNN = createVec(1,1,MAX_BLOCKS);
+        WorkDiv const runT5DNNInGPU_workDiv = createWorkDiv(blocksPerGridT5DNN, threadsPerBlockT5DNN, elementsPerThread);
+
+        // Only the layers of the active path are copied to shared memory, so the kernel is chosen by the weights
+        auto runT5DNN = [&](auto runT5DNNInGPU_kernel)
+        {
+            auto const runT5DNNInGPUTask(alpaka::createTaskKernel<Acc>(
+                runT5DNNInGPU_workDiv,
+                runT5DNNInGPU_kernel,
+                *modulesInGPU,
+                *mdsInGPU,
+                *segmentsInGPU,
+                *tripletsInGPU,
+                *quintupletsInGPU,
+                *rangesInGPU,
+                t5DNNCandidatesInGPU,
+                SDL::t5DNNWeights->getWeights()));
+
+            alpaka::enqueue(queue, runT5DNNInGPUTask);
+        };
+        if (SDL::t5DNNWeights->isQuantised())
+            runT5DNN(SDL::runT5DNNInGPU<T5DNN::quantisedLayers>{});
+        else
+            runT5DNN(SDL::runT5DNNInGPU<T5DNN::denseLayers>{});
+    }
+
+    // After the deferred DNN, which stores the T5s it accepts
+    setObjectCounts(quintupletsInGPU->totOccupancyQuintuplets, rangesInGPU->quintupletModuleOccupancy, quintupletsInGPU->nQuintuplets);
+
     Vec const threadsPerBlockDupQuint = createVec(1,16,16);
     Vec const blocksPerGridDupQuint = createVec(MAX_BLOCKS,1,1);
     WorkDiv const removeDupQuintupletsInGPUAfterBuild_workDiv = createWorkDiv(blocksPerGridDupQuint, threadsPerBlockDupQuint, elementsPerThread);
@@ -1016,6 +1573,20 @@ void SDL::Event::createQuintuplets()
 
     alpaka::enqueue(queue, removeDupQuintupletsInGPUAfterBuildTask);
 
+    Vec const threadsPerBlockFlagDupQuint = createVec(1,1,128);
+    Vec const blocksPerGridFlagDupQuint = createVec(1,MAX_BLOCKS*4,1);
+    WorkDiv const flagDupQuintupletsInGPU_workDiv = createWorkDiv(blocksPerGridFlagDupQuint, threadsPerBlockFlagDupQuint, elementsPerThread);
+
+    SDL::flagDupQuintupletsInGPU flagDupQuintupletsInGPU_kernel;
+    auto const flagDupQuintupletsInGPUTask(alpaka::createTaskKernel<Acc>(
+        flagDupQuintupletsInGPU_workDiv,
+        flagDupQuintupletsInGPU_kernel,
+        *modulesInGPU,
+        *quintupletsInGPU,
+        *rangesInGPU));
+
+    alpaka::enqueue(queue, flagDupQuintupletsInGPUTask);
+
     Vec const threadsPerBlockAddQuint = createVec(1,1,1024);
     Vec const blocksPerGridAddQuint = createVec(1,1,1);
     WorkDiv const addQuintupletRangesToEventExplicit_workDiv = createWorkDiv(blocksPerGridAddQuint, threadsPerBlockAddQuint, elementsPerThread);
@@ -1062,12 +1633,16 @@ void SDL::Event::createPixelQuintuplets()
     if(pixelQuintupletsInGPU == nullptr)
     {
         pixelQuintupletsInGPU = new SDL::pixelQuintuplets();
+        allocationCounter counter(deviceBytes[pixelQuintupletsMemory]);
+        arenaScope scope(arena);
         pixelQuintupletsBuffers = new SDL::pixelQuintupletsBuffer<Acc>(N_MAX_PIXEL_QUINTUPLETS, devAcc, queue);
         pixelQuintupletsInGPU->setData(*pixelQuintupletsBuffers);
     }
     if(trackCandidatesInGPU == nullptr)
     {
         trackCandidatesInGPU = new SDL::trackCandidates();
+        allocationCounter counter(deviceBytes[trackCandidatesMemory]);
+        arenaScope scope(arena);
         trackCandidatesBuffers = new SDL::trackCandidatesBuffer<Acc>(N_MAX_NONPIXEL_TRACK_CANDIDATES + N_MAX_PIXEL_TRACK_CANDIDATES, devAcc, queue);
         trackCandidatesInGPU->setData(*trackCandidatesBuffers);
     }
@@ -1172,6 +1747,18 @@ void SDL::Event::createPixelQuintuplets()
 
     alpaka::enqueue(queue, removeDupPixelQuintupletsInGPUFromMapTask);
 
+    Vec const threadsPerBlockFlagDupPix = createVec(1,1,256);
+    Vec const blocksPerGridFlagDupPix = createVec(1,1,MAX_BLOCKS);
+    WorkDiv const flagDupPixelQuintupletsInGPU_workDiv = createWorkDiv(blocksPerGridFlagDupPix, threadsPerBlockFlagDupPix, elementsPerThread);
+
+    SDL::flagDupPixelQuintupletsInGPU flagDupPixelQuintupletsInGPU_kernel;
+    auto const flagDupPixelQuintupletsInGPUTask(alpaka::createTaskKernel<Acc>(
+        flagDupPixelQuintupletsInGPU_workDiv,
+        flagDupPixelQuintupletsInGPU_kernel,
+        *pixelQuintupletsInGPU));
+
+    alpaka::enqueue(queue, flagDupPixelQuintupletsInGPUTask);
+
     Vec const threadsPerBlockAddpT5asTrackCan = createVec(1,1,256);
     Vec const blocksPerGridAddpT5asTrackCan = createVec(1,1,1);
     WorkDiv const addpT5asTrackCandidateInGPU_workDiv = createWorkDiv(blocksPerGridAddpT5asTrackCan, threadsPerBlockAddpT5asTrackCan, elementsPerThread);
@@ -1611,6 +2198,7 @@ SDL::hitsBuffer<alpaka::DevCpu>* SDL::Event::getHits() //std::shared_ptr should
         alpaka::wait(queue);
 
         unsigned int nHits = *alpaka::getPtrNative(nHits_buf);
+        allocationCounter counter(hostBytes[hitsMemory]);
         hitsInCPU = new SDL::hitsBuffer<alpaka::DevCpu>(nModules, nHits, devHost, queue);
         hitsInCPU->setData(*hitsInCPU);
 
@@ -1635,6 +2223,7 @@ SDL::hitsBuffer<alpaka::DevCpu>* SDL::Event::getHitsInCMSSW()
         alpaka::wait(queue);
 
         unsigned int nHits = *alpaka::getPtrNative(nHits_buf);
+        allocationCounter counter(hostBytes[hitsMemory]);
         hitsInCPU = new SDL::hitsBuffer<alpaka::DevCpu>(nModules, nHits, devHost, queue);
         hitsInCPU->setData(*hitsInCPU);
 
@@ -1649,6 +2238,7 @@ SDL::objectRangesBuffer<alpaka::DevCpu>* SDL::Event::getRanges()
 {
     if(rangesInCPU == nullptr)
     {
+        allocationCounter counter(hostBytes[rangesMemory]);
         rangesInCPU = new SDL::objectRangesBuffer<alpaka::DevCpu>(nModules, nLowerModules, devHost, queue);
         rangesInCPU->setData(*rangesInCPU);
 
@@ -1672,6 +2262,7 @@ SDL::miniDoubletsBuffer<alpaka::DevCpu>* SDL::Event::getMiniDoublets()
         alpaka::wait(queue);
 
         unsigned int nMemHost = *alpaka::getPtrNative(nMemHost_buf);
+        allocationCounter counter(hostBytes[miniDoubletsMemory]);
         mdsInCPU = new SDL::miniDoubletsBuffer<alpaka::DevCpu>(nMemHost, nLowerModules, devHost, queue);
         mdsInCPU->setData(*mdsInCPU);
 
@@ -1696,6 +2287,7 @@ SDL::segmentsBuffer<alpaka::DevCpu>* SDL::Event::getSegments()
         alpaka::wait(queue);
 
         unsigned int nMemHost = *alpaka::getPtrNative(nMemHost_buf);
+        allocationCounter counter(hostBytes[segmentsMemory]);
         segmentsInCPU = new SDL::segmentsBuffer<alpaka::DevCpu>(nMemHost, nLowerModules, N_MAX_PIXEL_SEGMENTS_PER_MODULE, devHost, queue);
         segmentsInCPU->setData(*segmentsInCPU);
 
@@ -1727,6 +2319,7 @@ SDL::tripletsBuffer<alpaka::DevCpu>* SDL::Event::getTriplets()
         alpaka::wait(queue);
 
         unsigned int nMemHost = *alpaka::getPtrNative(nMemHost_buf);
+        allocationCounter counter(hostBytes[tripletsMemory]);
         tripletsInCPU = new SDL::tripletsBuffer<alpaka::DevCpu>(nMemHost, nLowerModules, devHost, queue);
         tripletsInCPU->setData(*tripletsInCPU);
 
@@ -1768,6 +2361,7 @@ SDL::quintupletsBuffer<alpaka::DevCpu>* SDL::Event::getQuintuplets()
         alpaka::wait(queue);
 
         unsigned int nMemHost = *alpaka::getPtrNative(nMemHost_buf);
+        allocationCounter counter(hostBytes[quintupletsMemory]);
         quintupletsInCPU = new SDL::quintupletsBuffer<alpaka::DevCpu>(nMemHost, nLowerModules, devHost, queue);
         quintupletsInCPU->setData(*quintupletsInCPU);
 
@@ -1801,6 +2395,7 @@ SDL::pixelTripletsBuffer<alpaka::DevCpu>* SDL::Event::getPixelTriplets()
         alpaka::wait(queue);
 
         int nPixelTriplets = *alpaka::getPtrNative(nPixelTriplets_buf);
+        allocationCounter counter(hostBytes[pixelTripletsMemory]);
         pixelTripletsInCPU = new SDL::pixelTripletsBuffer<alpaka::DevCpu>(nPixelTriplets, devHost, queue);
         pixelTripletsInCPU->setData(*pixelTripletsInCPU);
 
@@ -1832,6 +2427,7 @@ SDL::pixelQuintupletsBuffer<alpaka::DevCpu>* SDL::Event::getPixelQuintuplets()
         alpaka::wait(queue);
 
         int nPixelQuintuplets = *alpaka::getPtrNative(nPixelQuintuplets_buf);
+        allocationCounter counter(hostBytes[pixelQuintupletsMemory]);
         pixelQuintupletsInCPU = new SDL::pixelQuintupletsBuffer<alpaka::DevCpu>(nPixelQuintuplets, devHost, queue);
         pixelQuintupletsInCPU->setData(*pixelQuintupletsInCPU);
 
@@ -1859,6 +2455,7 @@ SDL::trackCandidatesBuffer<alpaka::DevCpu>* SDL::Event::getTrackCandidates()
         alpaka::wait(queue);
 
         int nTrackCanHost = *alpaka::getPtrNative(nTrackCanHost_buf);
+        allocationCounter counter(hostBytes[trackCandidatesMemory]);
         trackCandidatesInCPU = new SDL::trackCandidatesBuffer<alpaka::DevCpu>(N_MAX_NONPIXEL_TRACK_CANDIDATES + N_MAX_PIXEL_TRACK_CANDIDATES, devHost, queue);
         trackCandidatesInCPU->setData(*trackCandidatesInCPU);
 
@@ -1884,6 +2481,7 @@ SDL::trackCandidatesBuffer<alpaka::DevCpu>* SDL::Event::getTrackCandidatesInCMSS
         alpaka::wait(queue);
 
         int nTrackCanHost = *alpaka::getPtrNative(nTrackCanHost_buf);
+        allocationCounter counter(hostBytes[trackCandidatesMemory]);
         trackCandidatesInCPU = new SDL::trackCandidatesBuffer<alpaka::DevCpu>(N_MAX_NONPIXEL_TRACK_CANDIDATES + N_MAX_PIXEL_TRACK_CANDIDATES, devHost, queue);
         trackCandidatesInCPU->setData(*trackCandidatesInCPU);
 
@@ -1902,10 +2500,12 @@ SDL::modulesBuffer<alpaka::DevCpu>* SDL::Event::getFullModules()
     {
         // The last input here is just a small placeholder for the allocation.
         modulesInCPUFull = new SDL::modulesBuffer<alpaka::DevCpu>(devHost, nModules, 1);
+        modulesInCPUFull->allocModuleMap(devHost, modulesBuffers->nModuleConnections);
         modulesInCPUFull->setData(*modulesInCPUFull);
 
         alpaka::memcpy(queue, modulesInCPUFull->detIds_buf, modulesBuffers->detIds_buf, nModules);
-        alpaka::memcpy(queue, modulesInCPUFull->moduleMap_buf, modulesBuffers->moduleMap_buf, 40 * nModules);
+        alpaka::memcpy(queue, modulesInCPUFull->moduleMap_buf, modulesBuffers->moduleMap_buf, modulesBuffers->nModuleConnections);
+        alpaka::memcpy(queue, modulesInCPUFull->moduleMapOffsets_buf, modulesBuffers->moduleMapOffsets_buf, nModules);
         alpaka::memcpy(queue, modulesInCPUFull->nConnectedModules_buf, modulesBuffers->nConnectedModules_buf, nModules);
         alpaka::memcpy(queue, modulesInCPUFull->drdzs_buf, modulesBuffers->drdzs_buf, nModules);
         alpaka::memcpy(queue, modulesInCPUFull->slopes_buf, modulesBuffers->slopes_buf, nModules);
@@ -1963,3 +2563,103 @@ unsigned int SDL::getBackend() {
     return 3;
 #endif
 }
+
+size_t SDL::getPeakResidentMemory()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    // ru_maxrss is reported in kilobytes on Linux.
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+// Copies a device count (or per-module count array) to the host and returns its sum.
+template<typename TBuff>
+static unsigned int sumDeviceCounts(QueueAcc& queue, TBuff& counts_buf, unsigned int n)
+{
+    using T = alpaka::Elem<TBuff>;
+    auto counts_host_buf = allocBufWrapper<T>(devHost, n, queue);
+    alpaka::memcpy(queue, counts_host_buf, counts_buf, n);
+    alpaka::wait(queue);
+
+    T* counts = alpaka::getPtrNative(counts_host_buf);
+    unsigned int sum = 0;
+    for (unsigned int i = 0; i < n; i++)
+        sum += counts[i];
+    return sum;
+}
+
+std::vector<SDL::memoryUsage> SDL::Event::getMemoryUsage()
+{
+    std::vector<memoryUsage> usage;
+    auto addUsage = [&](const char* name, memoryBuffer buffer, unsigned int capacity, unsigned int used)
+    {
+        usage.push_back({name, deviceBytes[buffer], hostBytes[buffer], capacity, used});
+    };
+
+    if (hitsInGPU != nullptr)
+    {
+        addUsage("hits", hitsMemory, hitsCapacity, sumDeviceCounts(queue, hitsBuffers->nHits_buf, 1));
+    }
+    if (rangesInGPU != nullptr)
+    {
+        // Per-module tables, always fully used.
+        addUsage("objectRanges", rangesMemory, nModules, nModules);
+    }
+    if (mdsInGPU != nullptr)
+    {
+        addUsage("miniDoublets", miniDoubletsMemory, sumDeviceCounts(queue, miniDoubletsBuffers->nMemoryLocations_buf, 1), sumDeviceCounts(queue, miniDoubletsBuffers->nMDs_buf, nLowerModules + 1));
+    }
+    if (segmentsInGPU != nullptr)
+    {
+        addUsage("segments", segmentsMemory, sumDeviceCounts(queue, segmentsBuffers->nMemoryLocations_buf, 1), sumDeviceCounts(queue, segmentsBuffers->nSegments_buf, nLowerModules + 1));
+    }
+    if (tripletsInGPU != nullptr)
+    {
+        addUsage("triplets", tripletsMemory, sumDeviceCounts(queue, tripletsBuffers->nMemoryLocations_buf, 1), sumDeviceCounts(queue, tripletsBuffers->nTriplets_buf, nLowerModules));
+    }
+    if (quintupletsInGPU != nullptr)
+    {
+        addUsage("quintuplets", quintupletsMemory, sumDeviceCounts(queue, quintupletsBuffers->nMemoryLocations_buf, 1), sumDeviceCounts(queue, quintupletsBuffers->nQuintuplets_buf, nLowerModules));
+    }
+    if (pixelTripletsInGPU != nullptr)
+    {
+        addUsage("pixelTriplets", pixelTripletsMemory, N_MAX_PIXEL_TRIPLETS, sumDeviceCounts(queue, pixelTripletsBuffers->nPixelTriplets_buf, 1));
+    }
+    if (pixelQuintupletsInGPU != nullptr)
+    {
+        addUsage("pixelQuintuplets", pixelQuintupletsMemory, N_MAX_PIXEL_QUINTUPLETS, sumDeviceCounts(queue, pixelQuintupletsBuffers->nPixelQuintuplets_buf, 1));
+    }
+    if (trackCandidatesInGPU != nullptr)
+    {
+        addUsage("trackCandidates", trackCandidatesMemory, N_MAX_NONPIXEL_TRACK_CANDIDATES + N_MAX_PIXEL_TRACK_CANDIDATES, sumDeviceCounts(queue, trackCandidatesBuffers->nTrackCandidates_buf, 1));
+    }
+    return usage;
+}
+
+void SDL::Event::printMemoryUsage()
+{
+    const double MB = 1024. * 1024.;
+    std::vector<memoryUsage> usage = getMemoryUsage();
+
+    size_t totalDevice = 0, totalHost = 0, totalUsed = 0;
+    printf("%-18s %12s %12s %12s %12s %12s\n", "buffer", "device [MB]", "host [MB]", "used [MB]", "objects", "capacity");
+    for (auto const& u : usage)
+    {
+        printf("%-18s %12.2f %12.2f %12.2f %12u %12u\n", u.name.c_str(), u.deviceBytes / MB, u.hostBytes / MB, u.usedBytes() / MB, u.used, u.capacity);
+        totalDevice += u.deviceBytes;
+        totalHost += u.hostBytes;
+        totalUsed += u.usedBytes();
+    }
+    printf("%-18s %12.2f %12.2f %12.2f\n", "total", totalDevice / MB, totalHost / MB, totalUsed / MB);
+    printf("peak device memory per event: %.2f MB\n", std::max(peakEventDeviceBytes, totalDevice) / MB);
+#ifdef ARENA_ALLOC
+    printf("arena capacity: %.2f MB\n", arena.getCapacity() / MB);
+#endif
+#ifdef SDL_CACHE_ALLOC
+    // Shared by all events, it also covers the scratch buffers of the build steps.
+    auto const& allocator = cachingAllocator<std::decay_t<decltype(devAcc)>, QueueAcc>::getInstance();
+    printf("caching allocator: %.2f MB in use at peak, %.2f MB cached\n", allocator.getPeakLiveBytes() / MB, allocator.getCachedBytes() / MB);
+#endif
+    printf("process peak resident memory: %.2f MB\n", getPeakResidentMemory() / MB);
+}
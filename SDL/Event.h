@@ -10,10 +10,42 @@
 #include "MiniDoublet.h"
 #include "PixelTriplet.h"
 #include "TrackCandidate.h"
+#include "PixelSeed.h"
+#include "PackedInput.h"
+#include "T5DNNWeights.h"
 #include "Constants.h"
 
 namespace SDL
 {
+    // Per-event buffer structs whose memory footprint is tracked by the event.
+    enum memoryBuffer
+    {
+        hitsMemory = 0,
+        rangesMemory,
+        miniDoubletsMemory,
+        segmentsMemory,
+        tripletsMemory,
+        quintupletsMemory,
+        pixelTripletsMemory,
+        pixelQuintupletsMemory,
+        trackCandidatesMemory,
+        nMemoryBuffers
+    };
+
+    struct memoryUsage
+    {
+        std::string name;
+        size_t deviceBytes; // allocated for the device buffer struct
+        size_t hostBytes;   // allocated for its host mirror, zero until the objects are copied back
+        unsigned int capacity;
+        unsigned int used;
+        // Device bytes scaled by the occupancy of the object storage.
+        size_t usedBytes() const { return capacity == 0 ? 0 : (size_t) ((double) deviceBytes * used / capacity); }
+    };
+
+    // Peak resident set size of the process in bytes.
+    size_t getPeakResidentMemory();
+
     class Event
     {
     private:
@@ -67,7 +99,39 @@ namespace SDL
         pixelTripletsBuffer<alpaka::DevCpu>* pixelTripletsInCPU;
         pixelQuintupletsBuffer<alpaka::DevCpu>* pixelQuintupletsInCPU;
 
+        // Per-event input staging, kept across events and grown when needed.
+        Buf<alpaka::DevCpu, char>* packedInputHost;
+        Buf<Acc, char>* packedInputDevice;
+        size_t packedInputCapacity;
+
+        // Bytes allocated per buffer struct in the current event, filled through allocationCounter.
+        std::array<size_t, nMemoryBuffers> deviceBytes;
+        std::array<size_t, nMemoryBuffers> hostBytes;
+        // Largest device total of deviceBytes over the events reset so far.
+        size_t peakEventDeviceBytes;
+        unsigned int hitsCapacity;
+        // Ranges of the ntuple indices of the outer tracker and the pixel hits, the index space of the hit ownership selection.
+        unsigned int outerHitIdxRange;
+        unsigned int pixelHitIdxRange;
+
+        // Backing memory for the per-event buffers when compiled with ARENA_ALLOC, released in resetEvent.
+        bufferArena arena;
+
         void init(bool verbose);
+        char* uploadPackedInput(const packedInputLayout& layout);
+        template<typename T, typename TBuff>
+        void copyFromPackedInput(TBuff& dst, char* packedInput, size_t offset, size_t nElements)
+        {
+            auto src_view = alpaka::createView(devAcc, packedColumn<T>(packedInput, offset), (Idx) nElements);
+            alpaka::memcpy(queue, dst, src_view, (Idx) nElements);
+        }
+        void bucketHitsByModule(float* xs, float* ys, float* zs, unsigned int* detIds, unsigned int* idxs, unsigned int nInputHits);
+        void computeHitQuantities(unsigned int nHits);
+        template<typename TCount>
+        void createActiveModuleList(ActiveModuleStage stage, const TCount* nInner, const TCount* nOuter = nullptr);
+        void setObjectCounts(const int* totOccupancy, const int* occupancy, int* nObjects);
+        void createPixelSegmentMemory();
+        void addPixelSegmentsFromDevice(unsigned int* hitIndices0, unsigned int* hitIndices1, unsigned int* hitIndices2, unsigned int* hitIndices3, float* dPhiChange, int size);
 
         int* superbinCPU;
         int8_t* pixelTypeCPU;
@@ -80,9 +144,20 @@ namespace SDL
         {
             init(verbose);
         }
+        ~Event();
         void resetEvent();
 
+        // Hits may come in any order, they are bucketed by module on the device. Pixel hits, if any, must come last.
         void addHitToEvent(std::vector<float> x, std::vector<float> y, std::vector<float> z, std::vector<unsigned int> detId, std::vector<unsigned int> idxInNtuple); //call the appropriate hit function, then increment the counter here
+        // Builds the pixel pseudo-hits and pLS from the raw seed tracks on the device, then adds them together with the outer tracker hits.
+        // cmsswDeltaPhiChange selects the pixel type dPhi definition of the CMSSW interface, see preparePixelSeedsKernel.
+        void addHitAndPixelSeedToEvent(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z, const std::vector<unsigned int>& detId,
+                                       const std::vector<float>& see_px, const std::vector<float>& see_py, const std::vector<float>& see_pz,
+                                       const std::vector<float>& see_dxy, const std::vector<float>& see_dz, const std::vector<float>& see_ptErr, const std::vector<float>& see_etaErr,
+                                       const std::vector<float>& see_stateTrajGlbX, const std::vector<float>& see_stateTrajGlbY, const std::vector<float>& see_stateTrajGlbZ,
+                                       const std::vector<float>& see_stateTrajGlbPx, const std::vector<float>& see_stateTrajGlbPy, const std::vector<float>& see_stateTrajGlbPz,
+                                       const std::vector<int>& see_q, const std::vector<std::vector<int>>& see_hitIdx, const std::vector<unsigned int>& seedIdx,
+                                       bool cmsswDeltaPhiChange);
         void addPixelSegmentToEvent(std::vector<unsigned int> hitIndices0,std::vector<unsigned int> hitIndices1,std::vector<unsigned int> hitIndices2,std::vector<unsigned int> hitIndices3, std::vector<float> dPhiChange, std::vector<float> ptIn, std::vector<float> ptErr, std::vector<float> px, std::vector<float> py, std::vector<float> pz, std::vector<float> eta, std::vector<float> etaErr, std::vector<float> phi, std::vector<int> charge, std::vector<unsigned int> seedIdx, std::vector<int> superbin, std::vector<int8_t> pixelType, std::vector<char> isQuad);
 
         /*functions that map the objects to the appropriate modules*/
@@ -155,6 +230,9 @@ namespace SDL
         pixelQuintupletsBuffer<alpaka::DevCpu>* getPixelQuintuplets();
         modulesBuffer<alpaka::DevCpu>* getModules();
         modulesBuffer<alpaka::DevCpu>* getFullModules();
+
+        std::vector<memoryUsage> getMemoryUsage();
+        void printMemoryUsage();
     };
 
     //global stuff
@@ -0,0 +1,94 @@
+#ifndef HalfPrecision_cuh
+#define HalfPrecision_cuh
+
+#include <cstdint>
+#include <cstring>
+
+// Included from Constants.h when compiled with FP16_Base, after alpaka (and cuda_fp16.h on CUDA).
+
+namespace SDL
+{
+    // IEEE half precision conversions with round to nearest even.
+    // CUDA devices use the hardware conversions, other backends the bit level versions below.
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE uint16_t floatToHalfBits(float value)
+    {
+#if defined(__CUDA_ARCH__)
+        return __half_as_ushort(__float2half_rn(value));
+#else
+        uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        uint32_t sign = (f >> 16) & 0x8000;
+        uint32_t absF = f & 0x7fffffff;
+
+        // Inf and NaN, keeping NaN quiet.
+        if (absF >= 0x7f800000)
+            return sign | 0x7c00 | (absF > 0x7f800000 ? 0x200 : 0);
+        // At least 65520, rounds to inf.
+        if (absF >= 0x477ff000)
+            return sign | 0x7c00;
+        // Below the smallest normal half, 2^-14.
+        if (absF < 0x38800000)
+        {
+            if (absF < 0x33000000)
+                return sign;
+            uint32_t shift = 126 - (absF >> 23);
+            uint32_t mant = (absF & 0x7fffff) | 0x800000;
+            uint32_t h = mant >> shift;
+            uint32_t rem = mant & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (rem > halfway or (rem == halfway and (h & 1)))
+                h++;
+            return sign | h;
+        }
+        uint32_t h = (absF - 0x38000000) >> 13;
+        uint32_t rem = absF & 0x1fff;
+        if (rem > 0x1000 or (rem == 0x1000 and (h & 1)))
+            h++;
+        return sign | h;
+#endif
+    }
+
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE float halfBitsToFloat(uint16_t bits)
+    {
+#if defined(__CUDA_ARCH__)
+        return __half2float(__ushort_as_half(bits));
+#else
+        uint32_t sign = uint32_t(bits & 0x8000) << 16;
+        uint32_t exp = (bits >> 10) & 0x1f;
+        uint32_t mant = bits & 0x3ff;
+        uint32_t f;
+        if (exp == 0x1f)
+            f = sign | 0x7f800000 | (mant << 13);
+        else if (exp != 0)
+            f = sign | ((exp + 112) << 23) | (mant << 13);
+        else if (mant == 0)
+            f = sign;
+        else
+        {
+            // Subnormal half, normalised as a float.
+            exp = 113;
+            while ((mant & 0x400) == 0)
+            {
+                mant <<= 1;
+                exp--;
+            }
+            f = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+        }
+        float value;
+        std::memcpy(&value, &f, sizeof(value));
+        return value;
+#endif
+    }
+
+    // 16-bit storage for float columns, converted in the accessors.
+    // Assigning a float stores it rounded to half precision, reading converts back to float.
+    struct half
+    {
+        uint16_t bits;
+
+        half() = default;
+        ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE half(float value) : bits(floatToHalfBits(value)) {}
+        ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE operator float() const { return halfBitsToFloat(bits); }
+    };
+}
+#endif
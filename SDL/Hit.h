@@ -237,6 +237,260 @@ namespace SDL
         }
     };
 
+    // Finds the module of every input hit and counts the hits per module.
+    struct countHitsPerModuleKernel
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+            TAcc const & acc,
+            struct SDL::modules modulesInGPU,
+            unsigned int nModules,
+            unsigned int* inputDetIds,
+            unsigned int nInputHits,
+            uint16_t* inputModuleIndices, // Output: module of each input hit
+            unsigned int* moduleCounts) const // Output: number of input hits per module, zeroed by the caller
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+            for(unsigned int ihit = globalThreadIdx[2]; ihit < nInputHits; ihit += gridThreadExtent[2])
+            {
+                int found_index = binary_search(modulesInGPU.mapdetId, inputDetIds[ihit], nModules);
+                uint16_t moduleIndex = modulesInGPU.mapIdx[found_index];
+                inputModuleIndices[ihit] = moduleIndex;
+                alpaka::atomicOp<alpaka::AtomicAdd>(acc, &moduleCounts[moduleIndex], 1u);
+            }
+        }
+    };
+
+    // Exclusive scan of the per-module hit counts, run as a single block. Sets hitRanges and the scatter cursors.
+    // The pixel module is placed after all other modules so that the pixel pseudo-hits, which are referenced by
+    // position, stay at the end of the hit arrays.
+    struct moduleHitOffsetsKernel
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+            TAcc const & acc,
+            struct SDL::hits hitsInGPU,
+            unsigned int* moduleCounts,
+            unsigned int* moduleCursors, // Output: first hit position of each module
+            unsigned int nModules,
+            uint16_t pixelModuleIndex) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const blockThreadIdx = alpaka::getIdx<alpaka::Block, alpaka::Threads>(acc);
+            Vec const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
+            unsigned int blockThread = blockThreadIdx[2];
+            unsigned int nThreads = blockThreadExtent[2];
+
+            auto& chunkSums = alpaka::declareSharedVar<unsigned int[1024], __COUNTER__>(acc);
+
+            // Sort key k visits the modules in index order, with the pixel module moved to the end.
+            auto keyToModule = [&](unsigned int k) -> unsigned int
+            {
+                if (k < pixelModuleIndex) return k;
+                if (k == nModules - 1) return pixelModuleIndex;
+                return k + 1;
+            };
+
+            unsigned int chunk = (nModules + nThreads - 1) / nThreads;
+            unsigned int kStart = alpaka::math::min(acc, blockThread * chunk, nModules);
+            unsigned int kEnd = alpaka::math::min(acc, kStart + chunk, nModules);
+
+            unsigned int sum = 0;
+            for(unsigned int k = kStart; k < kEnd; k++)
+                sum += moduleCounts[keyToModule(k)];
+            chunkSums[blockThread] = sum;
+            alpaka::syncBlockThreads(acc);
+
+            if(blockThread == 0)
+            {
+                unsigned int running = 0;
+                for(unsigned int t = 0; t < nThreads; t++)
+                {
+                    unsigned int chunkSum = chunkSums[t];
+                    chunkSums[t] = running;
+                    running += chunkSum;
+                }
+            }
+            alpaka::syncBlockThreads(acc);
+
+            unsigned int nHits = *hitsInGPU.nHits;
+            unsigned int offset = chunkSums[blockThread];
+            for(unsigned int k = kStart; k < kEnd; k++)
+            {
+                unsigned int moduleIndex = keyToModule(k);
+                unsigned int count = moduleCounts[moduleIndex];
+                moduleCursors[moduleIndex] = offset;
+                // Pixel pseudo-hits built on the device are not bucketed, they fill the hits after the last bucket.
+                if(moduleIndex == pixelModuleIndex)
+                    count = nHits - offset;
+                hitsInGPU.hitRanges[moduleIndex * 2] = count > 0 ? (int) offset : -1;
+                hitsInGPU.hitRanges[moduleIndex * 2 + 1] = count > 0 ? (int) (offset + count - 1) : -1;
+                offset += count;
+            }
+        }
+    };
+
+    // Assigns the input hits to a slot of their module bucket and records the input index of each slot, and its phi
+    // when bucketedPhis is set. Hits of the same outer tracker module end up contiguous in an order that depends on
+    // the atomics, orderBucketedHitsKernel then writes them in a fixed order. Pixel pseudo-hits in the input must
+    // follow all outer tracker hits and keep their position.
+    struct scatterHitsKernel
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+            TAcc const & acc,
+            struct SDL::hits hitsInGPU,
+            float* inputXs,
+            float* inputYs,
+            uint16_t* inputModuleIndices,
+            unsigned int* moduleCounts,
+            unsigned int* moduleCursors,
+            unsigned int nInputHits,
+            uint16_t pixelModuleIndex,
+            unsigned int* bucketedInputs, // Output: input index of each bucketed hit
+            float* bucketedPhis) const // Output: phi of each bucketed hit, or null
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+            unsigned int nOuterInputHits = nInputHits - moduleCounts[pixelModuleIndex];
+            for(unsigned int ihit = globalThreadIdx[2]; ihit < nInputHits; ihit += gridThreadExtent[2])
+            {
+                uint16_t moduleIndex = inputModuleIndices[ihit];
+                unsigned int dst;
+                if(moduleIndex == pixelModuleIndex)
+                    dst = hitsInGPU.hitRanges[pixelModuleIndex * 2] + (ihit - nOuterInputHits);
+                else
+                    dst = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &moduleCursors[moduleIndex], 1u);
+
+                bucketedInputs[dst] = ihit;
+                if(bucketedPhis != nullptr)
+                    bucketedPhis[dst] = SDL::phi(acc, inputXs[ihit], inputYs[ihit]);
+            }
+        }
+    };
+
+    // Writes the bucketed hits of each outer tracker module in increasing phi, ties broken by input position, or in
+    // input order when bucketedPhis is null, so that the hit order does not depend on the scatter. One block per
+    // module sorts its hits in shared memory, modules with more hits than blockSortCapacity rank each hit by
+    // scanning the module. Pixel pseudo-hits keep their position.
+    struct orderBucketedHitsKernel
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+            TAcc const & acc,
+            struct SDL::hits hitsInGPU,
+            float* inputXs,
+            float* inputYs,
+            float* inputZs,
+            unsigned int* inputDetIds,
+            unsigned int* inputIdxs, // Index in the input ntuple, the input position is used if null
+            uint16_t* inputModuleIndices,
+            unsigned int* bucketedInputs,
+            float* bucketedPhis, // Phi of each bucketed hit, or null to order by input position only
+            unsigned int nInputHits,
+            unsigned int nModules,
+            uint16_t pixelModuleIndex) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const blockThreadIdx = alpaka::getIdx<alpaka::Block, alpaka::Threads>(acc);
+            Vec const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
+            Vec const gridBlockIdx = alpaka::getIdx<alpaka::Grid, alpaka::Blocks>(acc);
+            Vec const gridBlockExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Blocks>(acc);
+
+            auto& keys = alpaka::declareSharedVar<unsigned long long[blockSortCapacity], __COUNTER__>(acc);
+
+            auto writeHit = [&](unsigned int dst, unsigned int ihit)
+            {
+                hitsInGPU.xs[dst] = inputXs[ihit];
+                hitsInGPU.ys[dst] = inputYs[ihit];
+                hitsInGPU.zs[dst] = inputZs[ihit];
+                hitsInGPU.detid[dst] = inputDetIds[ihit];
+                hitsInGPU.idxs[dst] = inputIdxs != nullptr ? inputIdxs[ihit] : ihit;
+                hitsInGPU.moduleIndices[dst] = inputModuleIndices[ihit];
+            };
+
+            auto sortKey = [&](unsigned int pos) -> unsigned long long
+            {
+                return bucketedPhis != nullptr ? phiSortKey(bucketedPhis[pos], bucketedInputs[pos]) : bucketedInputs[pos];
+            };
+
+            for(unsigned int moduleIndex = gridBlockIdx[1]; moduleIndex < nModules; moduleIndex += gridBlockExtent[1])
+            {
+                int first = hitsInGPU.hitRanges[moduleIndex * 2];
+                if(first == -1)
+                    continue;
+                unsigned int nModuleHits = hitsInGPU.hitRanges[moduleIndex * 2 + 1] - first + 1;
+
+                if(moduleIndex == pixelModuleIndex)
+                {
+                    for(unsigned int pos = first + blockThreadIdx[2]; pos < nInputHits; pos += blockThreadExtent[2])
+                        writeHit(pos, bucketedInputs[pos]);
+                }
+                else if(nModuleHits <= blockSortCapacity)
+                {
+                    for(unsigned int i = blockThreadIdx[2]; i < nModuleHits; i += blockThreadExtent[2])
+                        keys[i] = sortKey(first + i);
+                    blockBitonicSort(acc, keys, nModuleHits);
+                    for(unsigned int i = blockThreadIdx[2]; i < nModuleHits; i += blockThreadExtent[2])
+                        writeHit(first + i, static_cast<unsigned int>(keys[i]));
+                    // Before the keys are refilled for the next module
+                    alpaka::syncBlockThreads(acc);
+                }
+                else
+                {
+#ifdef Warnings
+                    if(blockThreadIdx[2] == 0)
+                        printf("Hit ordering: %u hits in module %u exceed the shared memory sort, ranking by scan\n", nModuleHits, moduleIndex);
+#endif
+                    for(unsigned int pos = first + blockThreadIdx[2]; pos < first + nModuleHits; pos += blockThreadExtent[2])
+                    {
+                        unsigned long long key = sortKey(pos);
+                        unsigned int dst = first;
+                        for(unsigned int other = first; other < first + nModuleHits; other++)
+                        {
+                            if(sortKey(other) < key)
+                                dst++;
+                        }
+                        writeHit(dst, bucketedInputs[pos]);
+                    }
+                }
+            }
+        }
+    };
+
+    // First position in [first, first + n) whose phi is not below the given value, for hits ordered by phi.
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned int phiLowerBound(const float* phis, unsigned int first, unsigned int n, float value)
+    {
+        while(n > 0)
+        {
+            unsigned int half = n / 2;
+            if(phis[first + half] < value)
+            {
+                first += half + 1;
+                n -= half + 1;
+            }
+            else
+                n = half;
+        }
+        return first;
+    }
+
+    // Derived hit quantities, run after the hits are bucketed by module.
     struct hitLoopKernel
     {
         template<typename TAcc>
@@ -244,10 +498,6 @@ namespace SDL
             TAcc const & acc,
             uint16_t Endcap, // Integer corresponding to endcap in module subdets
             uint16_t TwoS, // Integer corresponding to TwoS in moduleType
-            unsigned int nModules, // Number of modules
-            unsigned int nEndCapMap, // Number of elements in endcap map
-            unsigned int* geoMapDetId, // DetId's from endcap map
-            float* geoMapPhi, // Phi values from endcap map
             struct SDL::modules modulesInGPU,
             struct SDL::hits hitsInGPU,
             unsigned int const & nHits) const // Total number of hits in event
@@ -263,23 +513,15 @@ namespace SDL
                 float ihit_x = hitsInGPU.xs[ihit];
                 float ihit_y = hitsInGPU.ys[ihit];
                 float ihit_z = hitsInGPU.zs[ihit];
-                int iDetId = hitsInGPU.detid[ihit];
 
                 hitsInGPU.rts[ihit] = alpaka::math::sqrt(acc, ihit_x*ihit_x + ihit_y*ihit_y);
                 hitsInGPU.phis[ihit] = SDL::phi(acc, ihit_x,ihit_y);
                 hitsInGPU.etas[ihit] = ((ihit_z>0)-(ihit_z<0)) * alpaka::math::acosh(acc, alpaka::math::sqrt(acc, ihit_x*ihit_x+ihit_y*ihit_y+ihit_z*ihit_z)/hitsInGPU.rts[ihit]);
-                int found_index = binary_search(modulesInGPU.mapdetId, iDetId, nModules);
-                uint16_t lastModuleIndex = modulesInGPU.mapIdx[found_index];
-
-                hitsInGPU.moduleIndices[ihit] = lastModuleIndex;
+                uint16_t lastModuleIndex = hitsInGPU.moduleIndices[ihit];
 
                 if(modulesInGPU.subdets[lastModuleIndex] == Endcap && modulesInGPU.moduleType[lastModuleIndex] == TwoS)
                 {
-                    found_index = binary_search(geoMapDetId, iDetId, nEndCapMap);
-                    float phi = 0;
-                    // Unclear why these are not in map, but CPU map returns phi = 0 for all exceptions.
-                    if (found_index != -1)
-                        phi = geoMapPhi[found_index];
+                    float phi = modulesInGPU.endcapPhis[lastModuleIndex];
                     float cos_phi = alpaka::math::cos(acc, phi);
                     hitsInGPU.highEdgeXs[ihit] = ihit_x + 2.5f * cos_phi;
                     hitsInGPU.lowEdgeXs[ihit] = ihit_x - 2.5f * cos_phi;
@@ -287,13 +529,6 @@ namespace SDL
                     hitsInGPU.highEdgeYs[ihit] = ihit_y + 2.5f * sin_phi;
                     hitsInGPU.lowEdgeYs[ihit] = ihit_y - 2.5f * sin_phi;
                 }
-                // Need to set initial value if index hasn't been seen before.
-                int old = alpaka::atomicOp<alpaka::AtomicCas>(acc, &(hitsInGPU.hitRanges[lastModuleIndex * 2]), -1, ihit);
-                // For subsequent visits, stores the min value.
-                if (old != -1)
-                    alpaka::atomicOp<alpaka::AtomicMin>(acc, &hitsInGPU.hitRanges[lastModuleIndex * 2], ihit);
-
-                alpaka::atomicOp<alpaka::AtomicMax>(acc, &hitsInGPU.hitRanges[lastModuleIndex * 2 + 1], ihit);
             }
         }
     };
@@ -0,0 +1,63 @@
+#ifndef HitSignature_cuh
+#define HitSignature_cuh
+
+#include "Constants.h"
+
+namespace SDL
+{
+    // Hit signatures used by the overlap checks of the duplicate removal: the hit indices of an object
+    // sorted at creation time, and a 64 bit mask with one bit per hit, picked by a multiplicative hash.
+    // Two objects without a common mask bit share no hit, which most compared pairs can be rejected on.
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned long long hitMaskBit(unsigned int hitIndex)
+    {
+        return 1ull << ((hitIndex * 2654435769u) >> 26);
+    };
+
+    // Writes the n hits sorted to sortedHits and returns their mask.
+    template<unsigned int n>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned long long fillHitSignature(const unsigned int* hits, unsigned int* sortedHits)
+    {
+        unsigned long long mask = 0;
+        for (unsigned int i = 0; i < n; i++)
+        {
+            unsigned int hit = hits[i];
+            mask |= hitMaskBit(hit);
+            unsigned int j = i;
+            while (j > 0 and sortedHits[j - 1] > hit)
+            {
+                sortedHits[j] = sortedHits[j - 1];
+                j--;
+            }
+            sortedHits[j] = hit;
+        }
+        return mask;
+    };
+
+    // Number of hits of the sorted hits1 that are also in the sorted hits2, counting repeated hits of hits1
+    // each time, as the pairwise comparisons did.
+    template<unsigned int n1, unsigned int n2>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE int countSortedHitMatches(const unsigned int* hits1, const unsigned int* hits2)
+    {
+        int nMatched = 0;
+        unsigned int i = 0;
+        unsigned int j = 0;
+        while (i < n1 and j < n2)
+        {
+            if (hits1[i] < hits2[j])
+            {
+                i++;
+            }
+            else if (hits2[j] < hits1[i])
+            {
+                j++;
+            }
+            else
+            {
+                nMatched++;
+                i++;
+            }
+        }
+        return nMatched;
+    };
+}
+#endif
@@ -32,172 +32,65 @@ namespace SDL
         segmentsInGPU.isDup[pixelSegmentArrayIndex] |= 1 + secondpass;
     };
 
+    // The overlap checks compare the hit signatures from HitSignature.h, filled when the objects are stored.
     ALPAKA_FN_ACC ALPAKA_FN_INLINE int checkHitsT5(unsigned int ix, unsigned int jx, struct SDL::quintuplets& quintupletsInGPU)
     {
-        unsigned int hits1[10];
-        unsigned int hits2[10];
-
-        hits1[0] = quintupletsInGPU.hitIndices[10*ix];
-        hits1[1] = quintupletsInGPU.hitIndices[10*ix+1];
-        hits1[2] = quintupletsInGPU.hitIndices[10*ix+2];
-        hits1[3] = quintupletsInGPU.hitIndices[10*ix+3];
-        hits1[4] = quintupletsInGPU.hitIndices[10*ix+4];
-        hits1[5] = quintupletsInGPU.hitIndices[10*ix+5];
-        hits1[6] = quintupletsInGPU.hitIndices[10*ix+6];
-        hits1[7] = quintupletsInGPU.hitIndices[10*ix+7];
-        hits1[8] = quintupletsInGPU.hitIndices[10*ix+8];
-        hits1[9] = quintupletsInGPU.hitIndices[10*ix+9];
-
-        hits2[0] = quintupletsInGPU.hitIndices[10*jx];
-        hits2[1] = quintupletsInGPU.hitIndices[10*jx+1];
-        hits2[2] = quintupletsInGPU.hitIndices[10*jx+2];
-        hits2[3] = quintupletsInGPU.hitIndices[10*jx+3];
-        hits2[4] = quintupletsInGPU.hitIndices[10*jx+4];
-        hits2[5] = quintupletsInGPU.hitIndices[10*jx+5];
-        hits2[6] = quintupletsInGPU.hitIndices[10*jx+6];
-        hits2[7] = quintupletsInGPU.hitIndices[10*jx+7];
-        hits2[8] = quintupletsInGPU.hitIndices[10*jx+8];
-        hits2[9] = quintupletsInGPU.hitIndices[10*jx+9];
-
-        int nMatched = 0;
-        for (int i = 0; i < 10; i++)
-        {
-            bool matched = false;
-            for (int j = 0; j < 10; j++)
-            {
-                if(hits1[i] == hits2[j])
-                {
-                    matched = true; break;
-                }
-            }
-            if(matched)
-            {
-                nMatched++;
-            }
-        }
-        return nMatched;
+        if((quintupletsInGPU.hitMask[ix] & quintupletsInGPU.hitMask[jx]) == 0)
+            return 0;
+
+        return countSortedHitMatches<10, 10>(&quintupletsInGPU.sortedHitIndices[10*ix], &quintupletsInGPU.sortedHitIndices[10*jx]);
     };
 
     ALPAKA_FN_ACC ALPAKA_FN_INLINE int checkHitspT5(unsigned int ix, unsigned int jx,struct SDL::pixelQuintuplets& pixelQuintupletsInGPU)
     {
-        unsigned int hits1[14];
-        unsigned int hits2[14];
-
-        hits1[0] = pixelQuintupletsInGPU.hitIndices[14*ix];
-        hits1[1] = pixelQuintupletsInGPU.hitIndices[14*ix+1];
-        hits1[2] = pixelQuintupletsInGPU.hitIndices[14*ix+2];
-        hits1[3] = pixelQuintupletsInGPU.hitIndices[14*ix+3];
-        hits1[4] = pixelQuintupletsInGPU.hitIndices[14*ix+4];
-        hits1[5] = pixelQuintupletsInGPU.hitIndices[14*ix+5];
-        hits1[6] = pixelQuintupletsInGPU.hitIndices[14*ix+6];
-        hits1[7] = pixelQuintupletsInGPU.hitIndices[14*ix+7];
-        hits1[8] = pixelQuintupletsInGPU.hitIndices[14*ix+8];
-        hits1[9] = pixelQuintupletsInGPU.hitIndices[14*ix+9];
-        hits1[10] = pixelQuintupletsInGPU.hitIndices[14*ix+10];
-        hits1[11] = pixelQuintupletsInGPU.hitIndices[14*ix+11];
-        hits1[12] = pixelQuintupletsInGPU.hitIndices[14*ix+12];
-        hits1[13] = pixelQuintupletsInGPU.hitIndices[14*ix+13];
-
-        hits2[0] = pixelQuintupletsInGPU.hitIndices[14*jx];
-        hits2[1] = pixelQuintupletsInGPU.hitIndices[14*jx+1];
-        hits2[2] = pixelQuintupletsInGPU.hitIndices[14*jx+2];
-        hits2[3] = pixelQuintupletsInGPU.hitIndices[14*jx+3];
-        hits2[4] = pixelQuintupletsInGPU.hitIndices[14*jx+4];
-        hits2[5] = pixelQuintupletsInGPU.hitIndices[14*jx+5];
-        hits2[6] = pixelQuintupletsInGPU.hitIndices[14*jx+6];
-        hits2[7] = pixelQuintupletsInGPU.hitIndices[14*jx+7];
-        hits2[8] = pixelQuintupletsInGPU.hitIndices[14*jx+8];
-        hits2[9] = pixelQuintupletsInGPU.hitIndices[14*jx+9];
-        hits2[10] = pixelQuintupletsInGPU.hitIndices[14*jx+10];
-        hits2[11] = pixelQuintupletsInGPU.hitIndices[14*jx+11];
-        hits2[12] = pixelQuintupletsInGPU.hitIndices[14*jx+12];
-        hits2[13] = pixelQuintupletsInGPU.hitIndices[14*jx+13];
-
-        int nMatched = 0;
-        for (int i = 0; i < 14; i++)
-        {
-            bool matched = false;
-            for (int j = 0; j < 14; j++)
-            {
-                if(hits1[i] == hits2[j])
-                {
-                    matched = true; break;
-                }
-            }
-            if(matched)
-            {
-                nMatched++;
-            }
-        }
-        return nMatched;
+        if((pixelQuintupletsInGPU.hitMask[ix] & pixelQuintupletsInGPU.hitMask[jx]) == 0)
+            return 0;
+
+        return countSortedHitMatches<14, 14>(&pixelQuintupletsInGPU.sortedHitIndices[14*ix], &pixelQuintupletsInGPU.sortedHitIndices[14*jx]);
     };
 
     ALPAKA_FN_ACC ALPAKA_FN_INLINE void checkHitspT3(unsigned int ix, unsigned int jx,struct SDL::pixelTriplets& pixelTripletsInGPU, int* matched)
     {
-        int phits1[4] = {-1,-1,-1,-1};
-        int phits2[4] = {-1,-1,-1,-1};
-        phits1[0] = pixelTripletsInGPU.hitIndices[10*ix];
-        phits1[1] = pixelTripletsInGPU.hitIndices[10*ix+1];
-        phits1[2] = pixelTripletsInGPU.hitIndices[10*ix+2];
-        phits1[3] = pixelTripletsInGPU.hitIndices[10*ix+3];
-
-        phits2[0] = pixelTripletsInGPU.hitIndices[10*jx];
-        phits2[1] = pixelTripletsInGPU.hitIndices[10*jx+1];
-        phits2[2] = pixelTripletsInGPU.hitIndices[10*jx+2];
-        phits2[3] = pixelTripletsInGPU.hitIndices[10*jx+3];
-
-        int npMatched = 0;
-        for (int i = 0; i < 4; i++)
+        if((pixelTripletsInGPU.hitMask[ix] & pixelTripletsInGPU.hitMask[jx]) == 0)
         {
-            bool pmatched = false;
-            for (int j = 0; j < 4; j++)
-            {
-                if(phits1[i] == phits2[j])
-                {
-                    pmatched = true; break;
-                }
-            }
-            if(pmatched)
-            {
-                npMatched++;
-            }
+            matched[0] = 0;
+            matched[1] = 0;
+            return;
         }
 
-        int hits1[6] = {-1,-1,-1,-1,-1,-1};
-        int hits2[6] = {-1,-1,-1,-1,-1,-1};
-        hits1[0] = pixelTripletsInGPU.hitIndices[10*ix+4];
-        hits1[1] = pixelTripletsInGPU.hitIndices[10*ix+5];
-        hits1[2] = pixelTripletsInGPU.hitIndices[10*ix+6];
-        hits1[3] = pixelTripletsInGPU.hitIndices[10*ix+7];
-        hits1[4] = pixelTripletsInGPU.hitIndices[10*ix+8];
-        hits1[5] = pixelTripletsInGPU.hitIndices[10*ix+9];
-
-        hits2[0] = pixelTripletsInGPU.hitIndices[10*jx+4];
-        hits2[1] = pixelTripletsInGPU.hitIndices[10*jx+5];
-        hits2[2] = pixelTripletsInGPU.hitIndices[10*jx+6];
-        hits2[3] = pixelTripletsInGPU.hitIndices[10*jx+7];
-        hits2[4] = pixelTripletsInGPU.hitIndices[10*jx+8];
-        hits2[5] = pixelTripletsInGPU.hitIndices[10*jx+9];
-
-        int nMatched = 0;
-        for (int i = 0; i < 6; i++)
-        {
-            bool tmatched = false;
-            for (int j = 0; j < 6; j++)
-            {
-                if(hits1[i] == hits2[j])
-                {
-                    tmatched = true; break;
-                }
-            }
-            if(tmatched)
-            {
-                nMatched++;
-            }
-        }
+        // The first four sorted hits are the pixel hits, the other six the triplet hits
+        matched[0] = countSortedHitMatches<4, 4>(&pixelTripletsInGPU.sortedHitIndices[10*ix], &pixelTripletsInGPU.sortedHitIndices[10*jx]);
+        matched[1] = countSortedHitMatches<6, 6>(&pixelTripletsInGPU.sortedHitIndices[10*ix+4], &pixelTripletsInGPU.sortedHitIndices[10*jx+4]);
+    };
 
-        matched[0] = npMatched;
-        matched[1] = nMatched;
+    // The duplicate removal runs in two kernels. The removeDup* kernels record for every object the
+    // best overlapping object that beats it, as the atomic minimum of a packed (rank, index) key in
+    // dupCompetitor, and the flagDup* kernels then flag the objects that have such a competitor.
+    // No isDup flag is read while it is written, so the result does not depend on the thread timing.
+    // Smaller keys are better, and the index makes the keys unique.
+    // Lower score first, then higher index
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned long long quintupletDupKey(struct SDL::quintuplets& quintupletsInGPU, unsigned int quintupletIndex)
+    {
+        return (static_cast<unsigned long long>(orderedScoreBits(__H2F(quintupletsInGPU.score_rphisum[quintupletIndex]))) << 32) | static_cast<unsigned long long>(~quintupletIndex);
+    };
+
+    // Lower third logical layer first, then lower score, then higher index
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned long long pixelTripletDupKey(struct SDL::pixelTriplets& pixelTripletsInGPU, unsigned int pixelTripletIndex)
+    {
+        static_assert(N_MAX_PIXEL_TRIPLETS <= (1u << 24), "pT3 indices must fit in 24 bits of the duplicate removal key");
+        return (static_cast<unsigned long long>(pixelTripletsInGPU.logicalLayers[5*pixelTripletIndex+2]) << 56) | (static_cast<unsigned long long>(orderedScoreBits(__H2F(pixelTripletsInGPU.score[pixelTripletIndex]))) << 24) | static_cast<unsigned long long>(~pixelTripletIndex & 0xFFFFFFu);
+    };
+
+    // Lower score first, then lower index
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned long long pixelQuintupletDupKey(struct SDL::pixelQuintuplets& pixelQuintupletsInGPU, unsigned int pixelQuintupletIndex)
+    {
+        return (static_cast<unsigned long long>(orderedScoreBits(__H2F(pixelQuintupletsInGPU.score[pixelQuintupletIndex]))) << 32) | static_cast<unsigned long long>(pixelQuintupletIndex);
+    };
+
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void recordDupCompetitor(TAcc const & acc, unsigned long long* dupCompetitor, unsigned int index, unsigned long long competitorKey)
+    {
+        alpaka::atomicOp<alpaka::AtomicMin>(acc, &dupCompetitor[index], competitorKey);
     };
 
     struct removeDupQuintupletsInGPUAfterBuild
@@ -226,7 +119,7 @@ namespace SDL
                     unsigned int ix = quintupletModuleIndices_lowmod + ix1;
                     float eta1 = __H2F(quintupletsInGPU.eta[ix]);
                     float phi1 = __H2F(quintupletsInGPU.phi[ix]);
-                    float score_rphisum1 = __H2F(quintupletsInGPU.score_rphisum[ix]);
+                    unsigned long long key1 = quintupletDupKey(quintupletsInGPU, ix);
 
                     for(unsigned int jx1 = globalThreadIdx[2]; jx1 < nQuintuplets_lowmod; jx1 += gridThreadExtent[2])
                     {
@@ -234,11 +127,15 @@ namespace SDL
                         if(ix == jx)
                             continue;
 
+                        // Each pair is checked once, for the worse of the two
+                        unsigned long long key2 = quintupletDupKey(quintupletsInGPU, jx);
+                        if(key2 > key1)
+                            continue;
+
                         float eta2 = __H2F(quintupletsInGPU.eta[jx]);
                         float phi2 = __H2F(quintupletsInGPU.phi[jx]);
                         float dEta = alpaka::math::abs(acc, eta1 - eta2);
                         float dPhi = SDL::calculate_dPhi(phi1, phi2);
-                        float score_rphisum2 = __H2F(quintupletsInGPU.score_rphisum[jx]);
 
                         if (dEta > 0.1f)
                             continue;
@@ -249,18 +146,7 @@ namespace SDL
                         int nMatched = checkHitsT5(ix, jx, quintupletsInGPU);
                         if(nMatched >= 7)
                         {
-                            if(score_rphisum1 > score_rphisum2)
-                            {
-                                rmQuintupletFromMemory(quintupletsInGPU, ix); continue;
-                            }
-                            else if((score_rphisum1 == score_rphisum2) && (ix < jx))
-                            {
-                                rmQuintupletFromMemory(quintupletsInGPU, ix); continue;
-                            }
-                            else
-                            {
-                                rmQuintupletFromMemory(quintupletsInGPU, jx); continue;
-                            }
+                            recordDupCompetitor(acc, quintupletsInGPU.dupCompetitor, ix, key2);
                         }
                     }
                 }
@@ -307,6 +193,8 @@ namespace SDL
                         if(quintupletsInGPU.partOfPT5[ix] || quintupletsInGPU.isDup[ix])
                             continue;
 
+                        unsigned long long key1 = quintupletDupKey(quintupletsInGPU, ix);
+
                         for(unsigned int jx1 = 0; jx1 < nQuintuplets_lowmod2; jx1++)
                         {
                             unsigned int jx = quintupletModuleIndices_lowmod2 + jx1;
@@ -316,13 +204,15 @@ namespace SDL
                             if(quintupletsInGPU.partOfPT5[jx] || quintupletsInGPU.isDup[jx])
                                 continue;
 
+                            unsigned long long key2 = quintupletDupKey(quintupletsInGPU, jx);
+                            if(key2 > key1)
+                                continue;
+
                             float eta1 = __H2F(quintupletsInGPU.eta[ix]);
                             float phi1 = __H2F(quintupletsInGPU.phi[ix]);
-                            float score_rphisum1 = __H2F(quintupletsInGPU.score_rphisum[ix]);
 
                             float eta2 = __H2F(quintupletsInGPU.eta[jx]);
                             float phi2 = __H2F(quintupletsInGPU.phi[jx]);
-                            float score_rphisum2 = __H2F(quintupletsInGPU.score_rphisum[jx]);
 
                             float dEta = alpaka::math::abs(acc, eta1-eta2);
                             float dPhi = SDL::calculate_dPhi(phi1, phi2);
@@ -337,14 +227,7 @@ namespace SDL
                             int nMatched = checkHitsT5(ix, jx, quintupletsInGPU);
                             if(dR2 < 0.001f || nMatched >= 5)
                             {
-                                if(score_rphisum1 > score_rphisum2)
-                                {
-                                    rmQuintupletFromMemory(quintupletsInGPU, ix); continue;
-                                }
-                                if((score_rphisum1 == score_rphisum2) && (ix < jx))
-                                {
-                                    rmQuintupletFromMemory(quintupletsInGPU, ix); continue;
-                                }
+                                recordDupCompetitor(acc, quintupletsInGPU.dupCompetitor, ix, key2);
                             }
                         }
                     }
@@ -353,6 +236,39 @@ namespace SDL
         }
     };
 
+    struct flagDupQuintupletsInGPU
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::modules modulesInGPU,
+                struct SDL::quintuplets quintupletsInGPU,
+                struct SDL::objectRanges rangesInGPU) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+
+            for(unsigned int lowmod = globalThreadIdx[1]; lowmod < *modulesInGPU.nLowerModules; lowmod += gridThreadExtent[1])
+            {
+                int nQuintuplets_lowmod = quintupletsInGPU.nQuintuplets[lowmod];
+                int quintupletModuleIndices_lowmod = rangesInGPU.quintupletModuleIndices[lowmod];
+
+                for(unsigned int ix1 = globalThreadIdx[2]; ix1 < nQuintuplets_lowmod; ix1 += gridThreadExtent[2])
+                {
+                    unsigned int ix = quintupletModuleIndices_lowmod + ix1;
+                    if(quintupletsInGPU.dupCompetitor[ix] != noDupCompetitor)
+                    {
+                        rmQuintupletFromMemory(quintupletsInGPU, ix);
+                    }
+                }
+            }
+        }
+    };
+
     struct removeDupPixelTripletsInGPUFromMap
     {
         template<typename TAcc>
@@ -370,34 +286,51 @@ namespace SDL
 
             for (unsigned int ix = globalThreadIdx[1]; ix < *pixelTripletsInGPU.nPixelTriplets; ix += gridThreadExtent[1])
             {
+                unsigned long long key1 = pixelTripletDupKey(pixelTripletsInGPU, ix);
                 for(unsigned int jx = globalThreadIdx[2]; jx < *pixelTripletsInGPU.nPixelTriplets; jx += gridThreadExtent[2])
                 {
                     if(ix == jx)
                         continue;
 
+                    unsigned long long key2 = pixelTripletDupKey(pixelTripletsInGPU, jx);
+                    if(key2 > key1)
+                        continue;
+
                     int nMatched[2];
                     checkHitspT3(ix, jx, pixelTripletsInGPU, nMatched);
                     if((nMatched[0] + nMatched[1]) >= 5)
                     {
-                        // Check the layers
-                        if(pixelTripletsInGPU.logicalLayers[5*jx+2] < pixelTripletsInGPU.logicalLayers[5*ix+2])
-                        {
-                            rmPixelTripletFromMemory(pixelTripletsInGPU, ix); break;
-                        }
-                        else if(pixelTripletsInGPU.logicalLayers[5*ix+2] == pixelTripletsInGPU.logicalLayers[5*jx+2] && __H2F(pixelTripletsInGPU.score[ix]) > __H2F(pixelTripletsInGPU.score[jx]))
-                        {
-                            rmPixelTripletFromMemory(pixelTripletsInGPU, ix); break;
-                        }
-                        else if(pixelTripletsInGPU.logicalLayers[5*ix+2] == pixelTripletsInGPU.logicalLayers[5*jx+2] && (__H2F(pixelTripletsInGPU.score[ix]) == __H2F(pixelTripletsInGPU.score[jx])) && (ix < jx))
-                        {
-                            rmPixelTripletFromMemory(pixelTripletsInGPU, ix); break;
-                        }
+                        recordDupCompetitor(acc, pixelTripletsInGPU.dupCompetitor, ix, key2);
                     }
                 }
             }
         }
     };
 
+    struct flagDupPixelTripletsInGPU
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::pixelTriplets pixelTripletsInGPU) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+
+            for(unsigned int ix = globalThreadIdx[2]; ix < *pixelTripletsInGPU.nPixelTriplets; ix += gridThreadExtent[2])
+            {
+                if(pixelTripletsInGPU.dupCompetitor[ix] != noDupCompetitor)
+                {
+                    rmPixelTripletFromMemory(pixelTripletsInGPU, ix);
+                }
+            }
+        }
+    };
+
     struct removeDupPixelQuintupletsInGPUFromMap
     {
         template<typename TAcc>
@@ -419,7 +352,7 @@ namespace SDL
                 if(secondPass && pixelQuintupletsInGPU.isDup[ix])
                     continue;
 
-                float score1 = __H2F(pixelQuintupletsInGPU.score[ix]);
+                unsigned long long key1 = pixelQuintupletDupKey(pixelQuintupletsInGPU, ix);
                 for(unsigned int jx = globalThreadIdx[2]; jx < nPixelQuintuplets; jx += gridThreadExtent[2])
                 {
                     if(ix == jx)
@@ -428,20 +361,44 @@ namespace SDL
                     if(secondPass && pixelQuintupletsInGPU.isDup[jx])
                         continue;
 
+                    unsigned long long key2 = pixelQuintupletDupKey(pixelQuintupletsInGPU, jx);
+                    if(key2 > key1)
+                        continue;
+
                     int nMatched = checkHitspT5(ix, jx, pixelQuintupletsInGPU);
-                    float score2 = __H2F(pixelQuintupletsInGPU.score[jx]);
                     if(nMatched >= 7)
                     {
-                        if(score1 > score2 or ((score1 == score2) and (ix > jx)))
-                        {
-                            rmPixelQuintupletFromMemory(pixelQuintupletsInGPU, ix); break;
-                        }
+                        recordDupCompetitor(acc, pixelQuintupletsInGPU.dupCompetitor, ix, key2);
                     }
                 }
             }
         }
     };
 
+    struct flagDupPixelQuintupletsInGPU
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::pixelQuintuplets pixelQuintupletsInGPU) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+
+            for(unsigned int ix = globalThreadIdx[2]; ix < *pixelQuintupletsInGPU.nPixelQuintuplets; ix += gridThreadExtent[2])
+            {
+                if(pixelQuintupletsInGPU.dupCompetitor[ix] != noDupCompetitor)
+                {
+                    rmPixelQuintupletFromMemory(pixelQuintupletsInGPU, ix);
+                }
+            }
+        }
+    };
+
     struct checkHitspLS
     {
         template<typename TAcc>
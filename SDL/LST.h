@@ -6,11 +6,7 @@
 #include <numeric>
 #include <mutex>
 
-#include "code/cppitertools/enumerate.hpp"
-
 #include "TString.h"
-#include "Math/Vector3D.h"
-#include <Math/Vector4D.h>
 
 #include "Event.h"
 
@@ -44,45 +40,30 @@ namespace SDL {
                  const std::vector<float> ph2_y,
                  const std::vector<float> ph2_z) {
     auto event = SDL::Event(verbose, queue);
-    prepareInput(see_px,
-                 see_py,
-                 see_pz,
-                 see_dxy,
-                 see_dz,
-                 see_ptErr,
-                 see_etaErr,
-                 see_stateTrajGlbX,
-                 see_stateTrajGlbY,
-                 see_stateTrajGlbZ,
-                 see_stateTrajGlbPx,
-                 see_stateTrajGlbPy,
-                 see_stateTrajGlbPz,
-                 see_q,
-                 see_hitIdx,
-                 ph2_detId,
-                 ph2_x,
-                 ph2_y,
-                 ph2_z);
-
-    event.addHitToEvent(in_trkX_,
-                        in_trkY_,
-                        in_trkZ_,
-                        in_hitId_,
-                        in_hitIdxs_);
-    event.addPixelSegmentToEvent(in_hitIndices_vec0_,
-                                 in_hitIndices_vec1_,
-                                 in_hitIndices_vec2_,
-                                 in_hitIndices_vec3_,
-                                 in_deltaPhi_vec_,
-                                 in_ptIn_vec_, in_ptErr_vec_,
-                                 in_px_vec_, in_py_vec_, in_pz_vec_,
-                                 in_eta_vec_, in_etaErr_vec_,
-                                 in_phi_vec_,
-                                 in_charge_vec_,
-                                 in_seedIdx_vec_,
-                                 in_superbin_vec_,
-                                 in_pixelType_vec_,
-                                 in_isQuad_vec_);
+    std::vector<unsigned int> seedIdx(see_px.size());
+    std::iota(seedIdx.begin(), seedIdx.end(), 0);
+
+    event.addHitAndPixelSeedToEvent(ph2_x,
+                                    ph2_y,
+                                    ph2_z,
+                                    ph2_detId,
+                                    see_px,
+                                    see_py,
+                                    see_pz,
+                                    see_dxy,
+                                    see_dz,
+                                    see_ptErr,
+                                    see_etaErr,
+                                    see_stateTrajGlbX,
+                                    see_stateTrajGlbY,
+                                    see_stateTrajGlbZ,
+                                    see_stateTrajGlbPx,
+                                    see_stateTrajGlbPy,
+                                    see_stateTrajGlbPz,
+                                    see_q,
+                                    see_hitIdx,
+                                    seedIdx,
+                                    true);
     event.createMiniDoublets();
     if (verbose) {
         printf("# of Mini-doublets produced: %d\n",event.getNumberOfMiniDoublets());
@@ -178,30 +159,6 @@ namespace SDL {
     private:
         void loadMaps();
         TString get_absolute_path_after_check_file_exists(const std::string name);
-        void prepareInput(const std::vector<float> see_px,
-                          const std::vector<float> see_py,
-                          const std::vector<float> see_pz,
-                          const std::vector<float> see_dxy,
-                          const std::vector<float> see_dz,
-                          const std::vector<float> see_ptErr,
-                          const std::vector<float> see_etaErr,
-                          const std::vector<float> see_stateTrajGlbX,
-                          const std::vector<float> see_stateTrajGlbY,
-                          const std::vector<float> see_stateTrajGlbZ,
-                          const std::vector<float> see_stateTrajGlbPx,
-                          const std::vector<float> see_stateTrajGlbPy,
-                          const std::vector<float> see_stateTrajGlbPz,
-                          const std::vector<int> see_q,
-                          const std::vector<std::vector<int>> see_hitIdx,
-                          const std::vector<unsigned int> ph2_detId,
-                          const std::vector<float> ph2_x,
-                          const std::vector<float> ph2_y,
-                          const std::vector<float> ph2_z);
-
-        ROOT::Math::XYZVector calculateR3FromPCA(const ROOT::Math::PxPyPzMVector& p3,
-                                                 const float dxy,
-                                                 const float dz);
-
         void getOutput(SDL::Event& event);
         std::vector<unsigned int> getHitIdxs(const short trackCandidateType,
                                              const unsigned int TCIdx,
@@ -210,29 +167,6 @@ namespace SDL {
 
         // Input and output vectors
         TString TrackLooperDir_;
-        std::vector<float> in_trkX_;
-        std::vector<float> in_trkY_;
-        std::vector<float> in_trkZ_;
-        std::vector<unsigned int> in_hitId_;
-        std::vector<unsigned int> in_hitIdxs_;
-        std::vector<unsigned int> in_hitIndices_vec0_;
-        std::vector<unsigned int> in_hitIndices_vec1_;
-        std::vector<unsigned int> in_hitIndices_vec2_;
-        std::vector<unsigned int> in_hitIndices_vec3_;
-        std::vector<float> in_deltaPhi_vec_;
-        std::vector<float> in_ptIn_vec_;
-        std::vector<float> in_ptErr_vec_;
-        std::vector<float> in_px_vec_;
-        std::vector<float> in_py_vec_;
-        std::vector<float> in_pz_vec_;
-        std::vector<float> in_eta_vec_;
-        std::vector<float> in_etaErr_vec_;
-        std::vector<float> in_phi_vec_;
-        std::vector<int> in_charge_vec_;
-        std::vector<unsigned int> in_seedIdx_vec_;
-        std::vector<int> in_superbin_vec_;
-        std::vector<int8_t> in_pixelType_vec_;
-        std::vector<char> in_isQuad_vec_;
         std::vector<std::vector<unsigned int>> out_tc_hitIdxs_;
         std::vector<unsigned int> out_tc_len_;
         std::vector<int> out_tc_seedIdx_;
@@ -8,6 +8,57 @@
 
 namespace SDL
 {
+#ifdef PHI_SORTED_MDS
+    constexpr bool phiSortedMDs = true;
+#else
+    constexpr bool phiSortedMDs = false;
+#endif
+
+#ifdef LEAN_MDS
+    constexpr bool leanMDs = true;
+#else
+    constexpr bool leanMDs = false;
+#endif
+
+#ifdef PACKED_MDS
+    constexpr bool packedMDs = true;
+#else
+    constexpr bool packedMDs = false;
+#endif
+
+    // Anchor hit position of an MD packed into one aligned element, filled with PACKED_MDS.
+    struct alignas(16) mdAnchorPosition
+    {
+        float x;
+        float y;
+        float z;
+        float rt;
+    };
+
+    // Hit level quantity of the anchor or outer hit of each MD.
+    // Stored per MD by default, with LEAN_MDS it is read from hits through the MD's hit index instead.
+    // With PACKED_MDS the anchor position columns read from the packed anchorPositions (stride 4).
+    struct mdHitColumn
+    {
+        float* data;
+        const float* hitData;
+        const unsigned int* hitIndices;
+        unsigned int stride;
+
+        ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE float operator[](unsigned int i) const
+        {
+            if constexpr (packedMDs)
+            {
+                if (stride > 1)
+                    return data[i * stride];
+            }
+            if constexpr (leanMDs)
+                return hitData[hitIndices[i]];
+            else
+                return data[i];
+        }
+    };
+
     struct miniDoublets
     {
         unsigned int* nMemoryLocations;
@@ -17,41 +68,53 @@ namespace SDL
         uint16_t* moduleIndices;
         int* nMDs; //counter per module
         int* totOccupancyMDs; //counter per module
-        float* dphichanges;
+        FPX* dphichanges;
 
         float* dzs; //will store drt if the module is endcap
-        float* dphis;
+        FPX* dphis;
 
         float* shiftedXs;
         float* shiftedYs;
         float* shiftedZs;
         float* noShiftedDzs; //if shifted module
-        float* noShiftedDphis; //if shifted module
-        float* noShiftedDphiChanges; //if shifted module
-
-        float* anchorX;
-        float* anchorY;
-        float* anchorZ;
-        float* anchorRt;
-        float* anchorPhi;
-        float* anchorEta;
-        float* anchorHighEdgeX;
-        float* anchorHighEdgeY;
-        float* anchorLowEdgeX;
-        float* anchorLowEdgeY;
+        FPX* noShiftedDphis; //if shifted module
+        FPX* noShiftedDphiChanges; //if shifted module
+
+        mdHitColumn anchorX;
+        mdHitColumn anchorY;
+        mdHitColumn anchorZ;
+        mdHitColumn anchorRt;
+        mdHitColumn anchorPhi;
+        mdHitColumn anchorEta;
+        mdHitColumn anchorHighEdgeX;
+        mdHitColumn anchorHighEdgeY;
+        mdHitColumn anchorLowEdgeX;
+        mdHitColumn anchorLowEdgeY;
         float* anchorLowEdgePhi;
         float* anchorHighEdgePhi;
 
-        float* outerX;
-        float* outerY;
-        float* outerZ;
-        float* outerRt;
-        float* outerPhi;
-        float* outerEta;
-        float* outerHighEdgeX;
-        float* outerHighEdgeY;
-        float* outerLowEdgeX;
-        float* outerLowEdgeY;
+        mdHitColumn outerX;
+        mdHitColumn outerY;
+        mdHitColumn outerZ;
+        mdHitColumn outerRt;
+        mdHitColumn outerPhi;
+        mdHitColumn outerEta;
+        mdHitColumn outerHighEdgeX;
+        mdHitColumn outerHighEdgeY;
+        mdHitColumn outerLowEdgeX;
+        mdHitColumn outerLowEdgeY;
+
+        mdAnchorPosition* anchorPositions;
+
+        // Segments starting at each MD, see buildOutgoingSegmentIndex.
+        unsigned int* nOutgoingSegments;
+        unsigned int* outgoingSegmentOffsets;
+
+        // Phi ordered view of the MDs of each module, filled with PHI_SORTED_MDS.
+        unsigned int* phiSortedIndices;
+        float* phiSortedAnchorPhis;
+        float* anchorRtMins; //per module
+        float* anchorRtMaxs; //per module
 
         template<typename TBuf>
         void setData(TBuf& mdsbuf)
@@ -71,28 +134,67 @@ namespace SDL
             noShiftedDzs = alpaka::getPtrNative(mdsbuf.noShiftedDzs_buf);
             noShiftedDphis = alpaka::getPtrNative(mdsbuf.noShiftedDphis_buf);
             noShiftedDphiChanges = alpaka::getPtrNative(mdsbuf.noShiftedDphiChanges_buf);
-            anchorX = alpaka::getPtrNative(mdsbuf.anchorX_buf);
-            anchorY = alpaka::getPtrNative(mdsbuf.anchorY_buf);
-            anchorZ = alpaka::getPtrNative(mdsbuf.anchorZ_buf);
-            anchorRt = alpaka::getPtrNative(mdsbuf.anchorRt_buf);
-            anchorPhi = alpaka::getPtrNative(mdsbuf.anchorPhi_buf);
-            anchorEta = alpaka::getPtrNative(mdsbuf.anchorEta_buf);
-            anchorHighEdgeX = alpaka::getPtrNative(mdsbuf.anchorHighEdgeX_buf);
-            anchorHighEdgeY = alpaka::getPtrNative(mdsbuf.anchorHighEdgeY_buf);
-            anchorLowEdgeX = alpaka::getPtrNative(mdsbuf.anchorLowEdgeX_buf);
-            anchorLowEdgeY = alpaka::getPtrNative(mdsbuf.anchorLowEdgeY_buf);
-            outerX = alpaka::getPtrNative(mdsbuf.outerX_buf);
-            outerY = alpaka::getPtrNative(mdsbuf.outerY_buf);
-            outerZ = alpaka::getPtrNative(mdsbuf.outerZ_buf);
-            outerRt = alpaka::getPtrNative(mdsbuf.outerRt_buf);
-            outerPhi = alpaka::getPtrNative(mdsbuf.outerPhi_buf);
-            outerEta = alpaka::getPtrNative(mdsbuf.outerEta_buf);
-            outerHighEdgeX = alpaka::getPtrNative(mdsbuf.outerHighEdgeX_buf);
-            outerHighEdgeY = alpaka::getPtrNative(mdsbuf.outerHighEdgeY_buf);
-            outerLowEdgeX = alpaka::getPtrNative(mdsbuf.outerLowEdgeX_buf);
-            outerLowEdgeY = alpaka::getPtrNative(mdsbuf.outerLowEdgeY_buf);
+            anchorX = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorX_buf), nullptr, anchorHitIndices, 1};
+            anchorY = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorY_buf), nullptr, anchorHitIndices, 1};
+            anchorZ = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorZ_buf), nullptr, anchorHitIndices, 1};
+            anchorRt = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorRt_buf), nullptr, anchorHitIndices, 1};
+            anchorPhi = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorPhi_buf), nullptr, anchorHitIndices, 1};
+            anchorEta = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorEta_buf), nullptr, anchorHitIndices, 1};
+            anchorHighEdgeX = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorHighEdgeX_buf), nullptr, anchorHitIndices, 1};
+            anchorHighEdgeY = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorHighEdgeY_buf), nullptr, anchorHitIndices, 1};
+            anchorLowEdgeX = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorLowEdgeX_buf), nullptr, anchorHitIndices, 1};
+            anchorLowEdgeY = mdHitColumn{alpaka::getPtrNative(mdsbuf.anchorLowEdgeY_buf), nullptr, anchorHitIndices, 1};
+            outerX = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerX_buf), nullptr, outerHitIndices, 1};
+            outerY = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerY_buf), nullptr, outerHitIndices, 1};
+            outerZ = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerZ_buf), nullptr, outerHitIndices, 1};
+            outerRt = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerRt_buf), nullptr, outerHitIndices, 1};
+            outerPhi = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerPhi_buf), nullptr, outerHitIndices, 1};
+            outerEta = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerEta_buf), nullptr, outerHitIndices, 1};
+            outerHighEdgeX = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerHighEdgeX_buf), nullptr, outerHitIndices, 1};
+            outerHighEdgeY = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerHighEdgeY_buf), nullptr, outerHitIndices, 1};
+            outerLowEdgeX = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerLowEdgeX_buf), nullptr, outerHitIndices, 1};
+            outerLowEdgeY = mdHitColumn{alpaka::getPtrNative(mdsbuf.outerLowEdgeY_buf), nullptr, outerHitIndices, 1};
+            anchorPositions = alpaka::getPtrNative(mdsbuf.anchorPositions_buf);
+            if constexpr (packedMDs)
+            {
+                float* packed = reinterpret_cast<float*>(anchorPositions);
+                anchorX = mdHitColumn{packed, nullptr, anchorHitIndices, 4};
+                anchorY = mdHitColumn{packed + 1, nullptr, anchorHitIndices, 4};
+                anchorZ = mdHitColumn{packed + 2, nullptr, anchorHitIndices, 4};
+                anchorRt = mdHitColumn{packed + 3, nullptr, anchorHitIndices, 4};
+            }
             anchorLowEdgePhi = alpaka::getPtrNative(mdsbuf.anchorLowEdgePhi_buf);
             anchorHighEdgePhi = alpaka::getPtrNative(mdsbuf.anchorHighEdgePhi_buf);
+            nOutgoingSegments = alpaka::getPtrNative(mdsbuf.nOutgoingSegments_buf);
+            outgoingSegmentOffsets = alpaka::getPtrNative(mdsbuf.outgoingSegmentOffsets_buf);
+            phiSortedIndices = alpaka::getPtrNative(mdsbuf.phiSortedIndices_buf);
+            phiSortedAnchorPhis = alpaka::getPtrNative(mdsbuf.phiSortedAnchorPhis_buf);
+            anchorRtMins = alpaka::getPtrNative(mdsbuf.anchorRtMins_buf);
+            anchorRtMaxs = alpaka::getPtrNative(mdsbuf.anchorRtMaxs_buf);
+        }
+
+        void setHitData(struct hits& hitsIn)
+        {
+            anchorX.hitData = hitsIn.xs;
+            anchorY.hitData = hitsIn.ys;
+            anchorZ.hitData = hitsIn.zs;
+            anchorRt.hitData = hitsIn.rts;
+            anchorPhi.hitData = hitsIn.phis;
+            anchorEta.hitData = hitsIn.etas;
+            anchorHighEdgeX.hitData = hitsIn.highEdgeXs;
+            anchorHighEdgeY.hitData = hitsIn.highEdgeYs;
+            anchorLowEdgeX.hitData = hitsIn.lowEdgeXs;
+            anchorLowEdgeY.hitData = hitsIn.lowEdgeYs;
+            outerX.hitData = hitsIn.xs;
+            outerY.hitData = hitsIn.ys;
+            outerZ.hitData = hitsIn.zs;
+            outerRt.hitData = hitsIn.rts;
+            outerPhi.hitData = hitsIn.phis;
+            outerEta.hitData = hitsIn.etas;
+            outerHighEdgeX.hitData = hitsIn.highEdgeXs;
+            outerHighEdgeY.hitData = hitsIn.highEdgeYs;
+            outerLowEdgeX.hitData = hitsIn.lowEdgeXs;
+            outerLowEdgeY.hitData = hitsIn.lowEdgeYs;
         }
     };
 
@@ -106,17 +208,17 @@ namespace SDL
         Buf<TAcc, uint16_t> moduleIndices_buf;
         Buf<TAcc, int> nMDs_buf;
         Buf<TAcc, int> totOccupancyMDs_buf;
-        Buf<TAcc, float> dphichanges_buf;
+        Buf<TAcc, FPX> dphichanges_buf;
 
         Buf<TAcc, float> dzs_buf;
-        Buf<TAcc, float> dphis_buf;
+        Buf<TAcc, FPX> dphis_buf;
 
         Buf<TAcc, float> shiftedXs_buf;
         Buf<TAcc, float> shiftedYs_buf;
         Buf<TAcc, float> shiftedZs_buf;
         Buf<TAcc, float> noShiftedDzs_buf;
-        Buf<TAcc, float> noShiftedDphis_buf;
-        Buf<TAcc, float> noShiftedDphiChanges_buf;
+        Buf<TAcc, FPX> noShiftedDphis_buf;
+        Buf<TAcc, FPX> noShiftedDphiChanges_buf;
 
         Buf<TAcc, float> anchorX_buf;
         Buf<TAcc, float> anchorY_buf;
@@ -142,6 +244,16 @@ namespace SDL
         Buf<TAcc, float> outerLowEdgeX_buf;
         Buf<TAcc, float> outerLowEdgeY_buf;
 
+        Buf<TAcc, mdAnchorPosition> anchorPositions_buf;
+
+        Buf<TAcc, unsigned int> nOutgoingSegments_buf;
+        Buf<TAcc, unsigned int> outgoingSegmentOffsets_buf;
+
+        Buf<TAcc, unsigned int> phiSortedIndices_buf;
+        Buf<TAcc, float> phiSortedAnchorPhis_buf;
+        Buf<TAcc, float> anchorRtMins_buf;
+        Buf<TAcc, float> anchorRtMaxs_buf;
+
         template<typename TQueue, typename TDevAcc>
         miniDoubletsBuffer(unsigned int nMemoryLoc,
                            uint16_t nLowerModules,
@@ -153,37 +265,44 @@ namespace SDL
             moduleIndices_buf(allocBufWrapper<uint16_t>(devAccIn, nMemoryLoc, queue)),
             nMDs_buf(allocBufWrapper<int>(devAccIn, nLowerModules+1, queue)),
             totOccupancyMDs_buf(allocBufWrapper<int>(devAccIn, nLowerModules+1, queue)),
-            dphichanges_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
+            dphichanges_buf(allocBufWrapper<FPX>(devAccIn, nMemoryLoc, queue)),
             dzs_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            dphis_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
+            dphis_buf(allocBufWrapper<FPX>(devAccIn, nMemoryLoc, queue)),
             shiftedXs_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
             shiftedYs_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
             shiftedZs_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
             noShiftedDzs_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            noShiftedDphis_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            noShiftedDphiChanges_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorX_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorY_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorZ_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorRt_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorPhi_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorEta_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorHighEdgeX_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorHighEdgeY_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorLowEdgeX_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorLowEdgeY_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerX_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerY_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerZ_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerRt_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerPhi_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerEta_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerHighEdgeX_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerHighEdgeY_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerLowEdgeX_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            outerLowEdgeY_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
+            noShiftedDphis_buf(allocBufWrapper<FPX>(devAccIn, nMemoryLoc, queue)),
+            noShiftedDphiChanges_buf(allocBufWrapper<FPX>(devAccIn, nMemoryLoc, queue)),
+            anchorX_buf(allocBufWrapper<float>(devAccIn, (leanMDs or packedMDs) ? 1 : nMemoryLoc, queue)),
+            anchorY_buf(allocBufWrapper<float>(devAccIn, (leanMDs or packedMDs) ? 1 : nMemoryLoc, queue)),
+            anchorZ_buf(allocBufWrapper<float>(devAccIn, (leanMDs or packedMDs) ? 1 : nMemoryLoc, queue)),
+            anchorRt_buf(allocBufWrapper<float>(devAccIn, (leanMDs or packedMDs) ? 1 : nMemoryLoc, queue)),
+            anchorPhi_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            anchorEta_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            anchorHighEdgeX_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            anchorHighEdgeY_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            anchorLowEdgeX_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            anchorLowEdgeY_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerX_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerY_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerZ_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerRt_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerPhi_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerEta_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerHighEdgeX_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerHighEdgeY_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerLowEdgeX_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            outerLowEdgeY_buf(allocBufWrapper<float>(devAccIn, leanMDs ? 1 : nMemoryLoc, queue)),
+            anchorPositions_buf(allocBufWrapper<mdAnchorPosition>(devAccIn, packedMDs ? nMemoryLoc : 1, queue)),
             anchorLowEdgePhi_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
-            anchorHighEdgePhi_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue))
+            anchorHighEdgePhi_buf(allocBufWrapper<float>(devAccIn, nMemoryLoc, queue)),
+            nOutgoingSegments_buf(allocBufWrapper<unsigned int>(devAccIn, nMemoryLoc, queue)),
+            outgoingSegmentOffsets_buf(allocBufWrapper<unsigned int>(devAccIn, nMemoryLoc, queue)),
+            phiSortedIndices_buf(allocBufWrapper<unsigned int>(devAccIn, phiSortedMDs ? nMemoryLoc : 1, queue)),
+            phiSortedAnchorPhis_buf(allocBufWrapper<float>(devAccIn, phiSortedMDs ? nMemoryLoc : 1, queue)),
+            anchorRtMins_buf(allocBufWrapper<float>(devAccIn, phiSortedMDs ? nLowerModules+1 : 1, queue)),
+            anchorRtMaxs_buf(allocBufWrapper<float>(devAccIn, phiSortedMDs ? nLowerModules+1 : 1, queue))
         {
             alpaka::memset(queue, nMDs_buf, 0, nLowerModules+1);
             alpaka::memset(queue, totOccupancyMDs_buf, 0, nLowerModules+1);
@@ -216,41 +335,51 @@ namespace SDL
             outerHitIndex = upperHitIdx;
         }
 
-        mdsInGPU.dphichanges[idx] = dPhiChange;
+        mdsInGPU.dphichanges[idx] = __F2H(dPhiChange);
 
-        mdsInGPU.dphis[idx] = dPhi;
+        mdsInGPU.dphis[idx] = __F2H(dPhi);
         mdsInGPU.dzs[idx] = dz;
         mdsInGPU.shiftedXs[idx] = shiftedX;
         mdsInGPU.shiftedYs[idx] = shiftedY;
         mdsInGPU.shiftedZs[idx] = shiftedZ;
 
         mdsInGPU.noShiftedDzs[idx] = noShiftedDz;
-        mdsInGPU.noShiftedDphis[idx] = noShiftedDphi;
-        mdsInGPU.noShiftedDphiChanges[idx] = noShiftedDPhiChange;
-
-        mdsInGPU.anchorX[idx] = hitsInGPU.xs[anchorHitIndex];
-        mdsInGPU.anchorY[idx] = hitsInGPU.ys[anchorHitIndex];
-        mdsInGPU.anchorZ[idx] = hitsInGPU.zs[anchorHitIndex];
-        mdsInGPU.anchorRt[idx] = hitsInGPU.rts[anchorHitIndex];
-        mdsInGPU.anchorPhi[idx] = hitsInGPU.phis[anchorHitIndex];
-        mdsInGPU.anchorEta[idx] = hitsInGPU.etas[anchorHitIndex];
-        mdsInGPU.anchorHighEdgeX[idx] = hitsInGPU.highEdgeXs[anchorHitIndex];
-        mdsInGPU.anchorHighEdgeY[idx] = hitsInGPU.highEdgeYs[anchorHitIndex];
-        mdsInGPU.anchorLowEdgeX[idx] = hitsInGPU.lowEdgeXs[anchorHitIndex];
-        mdsInGPU.anchorLowEdgeY[idx] = hitsInGPU.lowEdgeYs[anchorHitIndex];
-        mdsInGPU.anchorHighEdgePhi[idx] = alpaka::math::atan2(acc, mdsInGPU.anchorHighEdgeY[idx], mdsInGPU.anchorHighEdgeX[idx]);
-        mdsInGPU.anchorLowEdgePhi[idx] = alpaka::math::atan2(acc, mdsInGPU.anchorLowEdgeY[idx], mdsInGPU.anchorLowEdgeX[idx]);
-
-        mdsInGPU.outerX[idx] = hitsInGPU.xs[outerHitIndex];
-        mdsInGPU.outerY[idx] = hitsInGPU.ys[outerHitIndex];
-        mdsInGPU.outerZ[idx] = hitsInGPU.zs[outerHitIndex];
-        mdsInGPU.outerRt[idx] = hitsInGPU.rts[outerHitIndex];
-        mdsInGPU.outerPhi[idx] = hitsInGPU.phis[outerHitIndex];
-        mdsInGPU.outerEta[idx] = hitsInGPU.etas[outerHitIndex];
-        mdsInGPU.outerHighEdgeX[idx] = hitsInGPU.highEdgeXs[outerHitIndex];
-        mdsInGPU.outerHighEdgeY[idx] = hitsInGPU.highEdgeYs[outerHitIndex];
-        mdsInGPU.outerLowEdgeX[idx] = hitsInGPU.lowEdgeXs[outerHitIndex];
-        mdsInGPU.outerLowEdgeY[idx] = hitsInGPU.lowEdgeYs[outerHitIndex];
+        mdsInGPU.noShiftedDphis[idx] = __F2H(noShiftedDphi);
+        mdsInGPU.noShiftedDphiChanges[idx] = __F2H(noShiftedDPhiChange);
+
+        mdsInGPU.anchorHighEdgePhi[idx] = alpaka::math::atan2(acc, hitsInGPU.highEdgeYs[anchorHitIndex], hitsInGPU.highEdgeXs[anchorHitIndex]);
+        mdsInGPU.anchorLowEdgePhi[idx] = alpaka::math::atan2(acc, hitsInGPU.lowEdgeYs[anchorHitIndex], hitsInGPU.lowEdgeXs[anchorHitIndex]);
+
+        if constexpr (packedMDs)
+            mdsInGPU.anchorPositions[idx] = mdAnchorPosition{hitsInGPU.xs[anchorHitIndex], hitsInGPU.ys[anchorHitIndex], hitsInGPU.zs[anchorHitIndex], hitsInGPU.rts[anchorHitIndex]};
+
+        if constexpr (not leanMDs)
+        {
+            if constexpr (not packedMDs)
+            {
+                mdsInGPU.anchorX.data[idx] = hitsInGPU.xs[anchorHitIndex];
+                mdsInGPU.anchorY.data[idx] = hitsInGPU.ys[anchorHitIndex];
+                mdsInGPU.anchorZ.data[idx] = hitsInGPU.zs[anchorHitIndex];
+                mdsInGPU.anchorRt.data[idx] = hitsInGPU.rts[anchorHitIndex];
+            }
+            mdsInGPU.anchorPhi.data[idx] = hitsInGPU.phis[anchorHitIndex];
+            mdsInGPU.anchorEta.data[idx] = hitsInGPU.etas[anchorHitIndex];
+            mdsInGPU.anchorHighEdgeX.data[idx] = hitsInGPU.highEdgeXs[anchorHitIndex];
+            mdsInGPU.anchorHighEdgeY.data[idx] = hitsInGPU.highEdgeYs[anchorHitIndex];
+            mdsInGPU.anchorLowEdgeX.data[idx] = hitsInGPU.lowEdgeXs[anchorHitIndex];
+            mdsInGPU.anchorLowEdgeY.data[idx] = hitsInGPU.lowEdgeYs[anchorHitIndex];
+
+            mdsInGPU.outerX.data[idx] = hitsInGPU.xs[outerHitIndex];
+            mdsInGPU.outerY.data[idx] = hitsInGPU.ys[outerHitIndex];
+            mdsInGPU.outerZ.data[idx] = hitsInGPU.zs[outerHitIndex];
+            mdsInGPU.outerRt.data[idx] = hitsInGPU.rts[outerHitIndex];
+            mdsInGPU.outerPhi.data[idx] = hitsInGPU.phis[outerHitIndex];
+            mdsInGPU.outerEta.data[idx] = hitsInGPU.etas[outerHitIndex];
+            mdsInGPU.outerHighEdgeX.data[idx] = hitsInGPU.highEdgeXs[outerHitIndex];
+            mdsInGPU.outerHighEdgeY.data[idx] = hitsInGPU.highEdgeYs[outerHitIndex];
+            mdsInGPU.outerLowEdgeX.data[idx] = hitsInGPU.lowEdgeXs[outerHitIndex];
+            mdsInGPU.outerLowEdgeY.data[idx] = hitsInGPU.lowEdgeYs[outerHitIndex];
+        }
     };
 
     ALPAKA_FN_ACC ALPAKA_FN_INLINE float isTighterTiltedModules(struct SDL::modules& modulesInGPU, uint16_t& moduleIndex)
@@ -767,6 +896,93 @@ namespace SDL
         return pass;
     };
 
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void createMiniDoubletFromHits(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::hits& hitsInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::objectRanges& rangesInGPU, uint16_t& lowerModuleIndex, uint16_t& upperModuleIndex, unsigned int lowerHitArrayIndex, unsigned int upperHitArrayIndex)
+    {
+        float xLower = hitsInGPU.xs[lowerHitArrayIndex];
+        float yLower = hitsInGPU.ys[lowerHitArrayIndex];
+        float zLower = hitsInGPU.zs[lowerHitArrayIndex];
+        float rtLower = hitsInGPU.rts[lowerHitArrayIndex];
+        float xUpper = hitsInGPU.xs[upperHitArrayIndex];
+        float yUpper = hitsInGPU.ys[upperHitArrayIndex];
+        float zUpper = hitsInGPU.zs[upperHitArrayIndex];
+        float rtUpper = hitsInGPU.rts[upperHitArrayIndex];
+
+        float dz, dphi, dphichange, shiftedX, shiftedY, shiftedZ, noShiftedDz, noShiftedDphi, noShiftedDphiChange;
+        bool success = runMiniDoubletDefaultAlgo(acc, modulesInGPU, lowerModuleIndex, upperModuleIndex, lowerHitArrayIndex, upperHitArrayIndex, dz, dphi, dphichange, shiftedX, shiftedY, shiftedZ, noShiftedDz, noShiftedDphi, noShiftedDphiChange, xLower,yLower,zLower,rtLower,xUpper,yUpper,zUpper,rtUpper);
+        int totOccupancyMDs = atomicIncrementAggregated(acc, mdsInGPU.totOccupancyMDs, lowerModuleIndex, success);
+        if(success)
+        {
+            if(totOccupancyMDs >= (rangesInGPU.miniDoubletModuleOccupancy[lowerModuleIndex]))
+            {
+#ifdef Warnings
+                printf("Mini-doublet excess alert! Module index =  %d\n",lowerModuleIndex);
+#endif
+            }
+            else
+            {
+                unsigned int mdIndex = rangesInGPU.miniDoubletModuleIndices[lowerModuleIndex] + totOccupancyMDs;
+
+                addMDToMemory(acc, mdsInGPU,hitsInGPU, modulesInGPU, lowerHitArrayIndex, upperHitArrayIndex, lowerModuleIndex, dz, dphi, dphichange, shiftedX, shiftedY, shiftedZ, noShiftedDz, noShiftedDphi, noShiftedDphiChange, mdIndex);
+            }
+        }
+    };
+
+    // Cut #1 of runMiniDoubletDefaultAlgoBarrel and the dz and drt cuts of runMiniDoubletDefaultAlgoEndcap,
+    // with the same arithmetic but without branches so that it vectorises over a batch of hits.
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE bool passMiniDoubletLeadingCut(TAcc const & acc, bool isBarrel, float dzCut, float drtCut, float zLower, float rtLower, float zUpper, float rtUpper)
+    {
+        float dz = zLower - zUpper;
+        const float sign = ((dz > 0) - (dz < 0)) * ((zLower > 0) - (zLower < 0));
+        const float invertedcrossercut = (alpaka::math::abs(acc, dz) > 2) * sign;
+        bool passBarrel = (alpaka::math::abs(acc, dz) < dzCut) & (invertedcrossercut <= 0);
+        bool passEndcap = (alpaka::math::abs(acc, dz) < dzCut) & (alpaka::math::abs(acc, rtLower - rtUpper) < drtCut);
+        return isBarrel ? passBarrel : passEndcap;
+    };
+
+    // Tries a lower hit with nUpperHits consecutive upper hits, at most candidateBatchSize. The leading cut is
+    // evaluated over the whole batch first and only the pairs passing it run the full algorithm, which repeats it.
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void createMiniDoubletsFromHitBatch(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::hits& hitsInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::objectRanges& rangesInGPU, uint16_t& lowerModuleIndex, uint16_t& upperModuleIndex, unsigned int lowerHitArrayIndex, unsigned int firstUpperHitArrayIndex, unsigned int nUpperHits)
+    {
+        const bool isBarrel = modulesInGPU.subdets[lowerModuleIndex] == SDL::Barrel;
+        const bool isPS = modulesInGPU.moduleType[lowerModuleIndex] == SDL::PS;
+        const float dzCut = isBarrel ? (isPS ? 2.f : 10.f) : 1.f;
+        const float drtCut = isPS ? 2.f : 10.f;
+
+        float zLower = hitsInGPU.zs[lowerHitArrayIndex];
+        float rtLower = hitsInGPU.rts[lowerHitArrayIndex];
+        const float* zUpper = hitsInGPU.zs + firstUpperHitArrayIndex;
+        const float* rtUpper = hitsInGPU.rts + firstUpperHitArrayIndex;
+
+        bool pass[candidateBatchSize];
+        for(unsigned int i = 0; i < nUpperHits; i++)
+        {
+            pass[i] = passMiniDoubletLeadingCut(acc, isBarrel, dzCut, drtCut, zLower, rtLower, zUpper[i], rtUpper[i]);
+        }
+        for(unsigned int i = 0; i < nUpperHits; i++)
+        {
+            if(pass[i])
+            {
+                createMiniDoubletFromHits(acc, modulesInGPU, hitsInGPU, mdsInGPU, rangesInGPU, lowerModuleIndex, upperModuleIndex, lowerHitArrayIndex, firstUpperHitArrayIndex + i);
+            }
+        }
+    };
+
+#ifdef PHI_SORTED_HITS
+    // Largest |dPhi| between the lower hit and any upper hit that can pass the flat barrel cuts.
+    // The flat barrel cut is on the unshifted dPhi with a threshold growing with rt. When the threshold is taken
+    // at the upper hit, its rt is bounded by the module gap plus the sagitta of the module across its width.
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE float flatBarrelPhiWindow(TAcc const & acc, struct SDL::modules& modulesInGPU, uint16_t& lowerModuleIndex, float rtLower)
+    {
+        float rtMax = modulesInGPU.moduleLayerType[lowerModuleIndex] == SDL::Pixel ? rtLower : rtLower + moduleGapSize(modulesInGPU, lowerModuleIndex) + 1.f;
+        // Small margin for the rounding of the phi difference against deltaPhi.
+        return dPhiThreshold(acc, rtMax, modulesInGPU, lowerModuleIndex) + 1e-4f;
+    };
+#endif
+
     struct createMiniDoubletsInGPUv2
     {
         template<typename TAcc>
@@ -783,54 +999,83 @@ namespace SDL
 
             Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
             Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+            unsigned int const nElements = candidateBatch(acc);
 
-            for(uint16_t lowerModuleIndex = globalThreadIdx[1]; lowerModuleIndex < (*modulesInGPU.nLowerModules); lowerModuleIndex += gridThreadExtent[1])
+            // Each chunk holds the pairs of up to activeChunkSize(MDStage) lower hits of a module
+            for(unsigned int chunk = globalThreadIdx[1]; chunk < rangesInGPU.nActiveChunks[SDL::MDStage]; chunk += gridThreadExtent[1])
             {
+                unsigned int firstLowerHit;
+                uint16_t lowerModuleIndex = activeChunkModule(rangesInGPU, SDL::MDStage, *modulesInGPU.nLowerModules, chunk, firstLowerHit);
                 uint16_t upperModuleIndex = modulesInGPU.partnerModuleIndices[lowerModuleIndex];
                 int nLowerHits = hitsInGPU.hitRangesnLower[lowerModuleIndex];
                 int nUpperHits = hitsInGPU.hitRangesnUpper[lowerModuleIndex];
                 if(hitsInGPU.hitRangesLower[lowerModuleIndex] == -1) continue;
-                const int maxHits = alpaka::math::max(acc, nUpperHits, nLowerHits);
+                int lastLowerHit = alpaka::math::min(acc, (int) (firstLowerHit + SDL::activeChunkSize(SDL::MDStage)), nLowerHits);
                 unsigned int upHitArrayIndex = hitsInGPU.hitRangesUpper[lowerModuleIndex];
                 unsigned int loHitArrayIndex = hitsInGPU.hitRangesLower[lowerModuleIndex];
-                int limit = nUpperHits*nLowerHits;
 
-                for(int hitIndex = globalThreadIdx[2]; hitIndex< limit; hitIndex += gridThreadExtent[2])
+#ifdef PHI_SORTED_HITS
+                // Hits are ordered in phi within each module, so in the flat barrel only the upper hits inside the
+                // dPhi window of the lower hit are tried. The other modules shift the strip hits before the dPhi
+                // cut and keep the full pair loop.
+                if(modulesInGPU.subdets[lowerModuleIndex] == SDL::Barrel and modulesInGPU.sides[lowerModuleIndex] == SDL::Center and nUpperHits > 0)
                 {
-                    int lowerHitIndex =  hitIndex / nUpperHits;
-                    int upperHitIndex =  hitIndex % nUpperHits;
-                    if(upperHitIndex >= nUpperHits) continue;
-                    if(lowerHitIndex >= nLowerHits) continue;
-                    unsigned int lowerHitArrayIndex = loHitArrayIndex + lowerHitIndex;
-                    float xLower = hitsInGPU.xs[lowerHitArrayIndex];
-                    float yLower = hitsInGPU.ys[lowerHitArrayIndex];
-                    float zLower = hitsInGPU.zs[lowerHitArrayIndex];
-                    float rtLower = hitsInGPU.rts[lowerHitArrayIndex];
-                    unsigned int upperHitArrayIndex = upHitArrayIndex+upperHitIndex;
-                    float xUpper = hitsInGPU.xs[upperHitArrayIndex];
-                    float yUpper = hitsInGPU.ys[upperHitArrayIndex];
-                    float zUpper = hitsInGPU.zs[upperHitArrayIndex];
-                    float rtUpper = hitsInGPU.rts[upperHitArrayIndex];
-
-                    float dz, dphi, dphichange, shiftedX, shiftedY, shiftedZ, noShiftedDz, noShiftedDphi, noShiftedDphiChange;
-                    bool success = runMiniDoubletDefaultAlgo(acc, modulesInGPU, lowerModuleIndex, upperModuleIndex, lowerHitArrayIndex, upperHitArrayIndex, dz, dphi, dphichange, shiftedX, shiftedY, shiftedZ, noShiftedDz, noShiftedDphi, noShiftedDphiChange, xLower,yLower,zLower,rtLower,xUpper,yUpper,zUpper,rtUpper);
-                    if(success)
+                    for(int lowerHitIndex = firstLowerHit + globalThreadIdx[2]; lowerHitIndex < lastLowerHit; lowerHitIndex += gridThreadExtent[2])
                     {
-                        int totOccupancyMDs = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &mdsInGPU.totOccupancyMDs[lowerModuleIndex], 1);
-                        if(totOccupancyMDs >= (rangesInGPU.miniDoubletModuleOccupancy[lowerModuleIndex]))
+                        unsigned int lowerHitArrayIndex = loHitArrayIndex + lowerHitIndex;
+                        float phiLower = hitsInGPU.phis[lowerHitArrayIndex];
+                        float window = flatBarrelPhiWindow(acc, modulesInGPU, lowerModuleIndex, hitsInGPU.rts[lowerHitArrayIndex]);
+
+                        // Up to two ranges of upper hits when the window wraps around +-pi.
+                        unsigned int upperEnd = upHitArrayIndex + nUpperHits;
+                        unsigned int first[2] = {upHitArrayIndex, upperEnd};
+                        unsigned int last[2] = {upperEnd, upperEnd};
+                        if(window < float(M_PI))
                         {
-#ifdef Warnings
-                            printf("Mini-doublet excess alert! Module index =  %d\n",lowerModuleIndex);
-#endif
+                            float phiLow = phiLower - window;
+                            float phiHigh = phiLower + window;
+                            if(phiLow < -float(M_PI))
+                            {
+                                first[0] = upHitArrayIndex;
+                                last[0] = phiLowerBound(hitsInGPU.phis, upHitArrayIndex, nUpperHits, phiHigh);
+                                first[1] = phiLowerBound(hitsInGPU.phis, upHitArrayIndex, nUpperHits, phiLow + 2.f * float(M_PI));
+                            }
+                            else if(phiHigh > float(M_PI))
+                            {
+                                first[0] = upHitArrayIndex;
+                                last[0] = phiLowerBound(hitsInGPU.phis, upHitArrayIndex, nUpperHits, phiHigh - 2.f * float(M_PI));
+                                first[1] = phiLowerBound(hitsInGPU.phis, upHitArrayIndex, nUpperHits, phiLow);
+                            }
+                            else
+                            {
+                                first[0] = phiLowerBound(hitsInGPU.phis, upHitArrayIndex, nUpperHits, phiLow);
+                                last[0] = phiLowerBound(hitsInGPU.phis, upHitArrayIndex, nUpperHits, phiHigh);
+                            }
                         }
-                        else
-                        {
-                            int mdModuleIndex = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &mdsInGPU.nMDs[lowerModuleIndex], 1);
-                            unsigned int mdIndex = rangesInGPU.miniDoubletModuleIndices[lowerModuleIndex] + mdModuleIndex;
 
-                            addMDToMemory(acc, mdsInGPU,hitsInGPU, modulesInGPU, lowerHitArrayIndex, upperHitArrayIndex, lowerModuleIndex, dz, dphi, dphichange, shiftedX, shiftedY, shiftedZ, noShiftedDz, noShiftedDphi, noShiftedDphiChange, mdIndex);
+                        for(int range = 0; range < 2; range++)
+                        {
+                            for(unsigned int upperHitArrayIndex = first[range]; upperHitArrayIndex < last[range]; upperHitArrayIndex++)
+                            {
+                                createMiniDoubletFromHits(acc, modulesInGPU, hitsInGPU, mdsInGPU, rangesInGPU, lowerModuleIndex, upperModuleIndex, lowerHitArrayIndex, upperHitArrayIndex);
+                            }
                         }
                     }
+                    continue;
+                }
+#endif
+                // Each lower hit is paired with batches of up to nElements consecutive upper hits
+                int nUpperBatches = (nUpperHits + nElements - 1) / nElements;
+                int limit = nUpperBatches*lastLowerHit;
+
+                for(int batchIndex = nUpperBatches*firstLowerHit + globalThreadIdx[2]; batchIndex < limit; batchIndex += gridThreadExtent[2])
+                {
+                    int lowerHitIndex = batchIndex / nUpperBatches;
+                    int firstUpperHitIndex = (batchIndex % nUpperBatches) * nElements;
+                    if(lowerHitIndex >= nLowerHits) continue;
+                    unsigned int lowerHitArrayIndex = loHitArrayIndex + lowerHitIndex;
+                    unsigned int nBatchHits = alpaka::math::min(acc, (int) nElements, nUpperHits - firstUpperHitIndex);
+                    createMiniDoubletsFromHitBatch(acc, modulesInGPU, hitsInGPU, mdsInGPU, rangesInGPU, lowerModuleIndex, upperModuleIndex, lowerHitArrayIndex, upHitArrayIndex + firstUpperHitIndex, nBatchHits);
                 }
             }
         }
@@ -914,6 +1159,87 @@ namespace SDL
         }
     };
 
+    // Fills the phi ordered view of the MDs of each lower module, ties broken by MD index, along with the anchor rt
+    // extent of the module. One block per module sorts its MDs in shared memory, modules with more MDs than
+    // blockSortCapacity rank each MD by scanning the module.
+    struct sortMDsByPhiKernel
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::modules modulesInGPU,
+                struct SDL::miniDoublets mdsInGPU,
+                struct SDL::objectRanges rangesInGPU) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const blockThreadIdx = alpaka::getIdx<alpaka::Block, alpaka::Threads>(acc);
+            Vec const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
+            Vec const gridBlockIdx = alpaka::getIdx<alpaka::Grid, alpaka::Blocks>(acc);
+            Vec const gridBlockExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Blocks>(acc);
+
+            auto& keys = alpaka::declareSharedVar<unsigned long long[blockSortCapacity], __COUNTER__>(acc);
+
+            // The modules with MDs are in the worklist of the MD stage
+            const uint16_t* activeModules = &rangesInGPU.activeModules[SDL::MDStage * (*modulesInGPU.nLowerModules)];
+            for(unsigned int activeModuleIndex = gridBlockIdx[1]; activeModuleIndex < rangesInGPU.nActiveModules[SDL::MDStage]; activeModuleIndex += gridBlockExtent[1])
+            {
+                uint16_t lowerModuleIndex = activeModules[activeModuleIndex];
+                unsigned int first = rangesInGPU.miniDoubletModuleIndices[lowerModuleIndex];
+                unsigned int nMDs = mdsInGPU.nMDs[lowerModuleIndex];
+
+                if(blockThreadIdx[2] == 0 and nMDs > 0)
+                {
+                    float rtMin = mdsInGPU.anchorRt[first];
+                    float rtMax = rtMin;
+                    for(unsigned int mdIndex = first + 1; mdIndex < first + nMDs; mdIndex++)
+                    {
+                        rtMin = alpaka::math::min(acc, rtMin, mdsInGPU.anchorRt[mdIndex]);
+                        rtMax = alpaka::math::max(acc, rtMax, mdsInGPU.anchorRt[mdIndex]);
+                    }
+                    mdsInGPU.anchorRtMins[lowerModuleIndex] = rtMin;
+                    mdsInGPU.anchorRtMaxs[lowerModuleIndex] = rtMax;
+                }
+
+                if(nMDs <= blockSortCapacity)
+                {
+                    for(unsigned int i = blockThreadIdx[2]; i < nMDs; i += blockThreadExtent[2])
+                        keys[i] = phiSortKey(mdsInGPU.anchorPhi[first + i], first + i);
+                    blockBitonicSort(acc, keys, nMDs);
+                    for(unsigned int i = blockThreadIdx[2]; i < nMDs; i += blockThreadExtent[2])
+                    {
+                        unsigned int mdIndex = static_cast<unsigned int>(keys[i]);
+                        mdsInGPU.phiSortedIndices[first + i] = mdIndex;
+                        mdsInGPU.phiSortedAnchorPhis[first + i] = mdsInGPU.anchorPhi[mdIndex];
+                    }
+                    // Before the keys are refilled for the next module
+                    alpaka::syncBlockThreads(acc);
+                }
+                else
+                {
+#ifdef Warnings
+                    if(blockThreadIdx[2] == 0)
+                        printf("MD phi ordering: %u MDs in module %d exceed the shared memory sort, ranking by scan\n", nMDs, lowerModuleIndex);
+#endif
+                    for(unsigned int mdIndex = first + blockThreadIdx[2]; mdIndex < first + nMDs; mdIndex += blockThreadExtent[2])
+                    {
+                        unsigned long long key = phiSortKey(mdsInGPU.anchorPhi[mdIndex], mdIndex);
+                        unsigned int rank = 0;
+                        for(unsigned int other = first; other < first + nMDs; other++)
+                        {
+                            if(phiSortKey(mdsInGPU.anchorPhi[other], other) < key)
+                                rank++;
+                        }
+                        mdsInGPU.phiSortedIndices[first + rank] = mdIndex;
+                        mdsInGPU.phiSortedAnchorPhis[first + rank] = mdsInGPU.anchorPhi[mdIndex];
+                    }
+                }
+            }
+        }
+    };
+
     struct addMiniDoubletRangesToEventExplicit
     {
         template<typename TAcc>
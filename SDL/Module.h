@@ -47,6 +47,24 @@ namespace SDL
     inline std::map <unsigned int, unsigned int> *module_type; // 23 : Ph2PSP, 24 : Ph2PSS, 25 : Ph2SS
     // https://github.com/cms-sw/cmssw/blob/5e809e8e0a625578aa265dc4b128a93830cb5429/Geometry/TrackerGeometryBuilder/interface/TrackerGeometry.h#L29
 
+    // Stages that loop over a device side list of the lower modules with work, filled by createActiveModuleListInGPU
+    enum ActiveModuleStage
+    {
+        MDStage = 0,
+        SegmentStage,
+        TripletStage,
+        QuintupletStage,
+        nActiveModuleStages
+    };
+
+    // Inner objects per chunk of work in the stage kernels: lower hits for MDs, inner MDs for segments,
+    // inner segments for triplets and inner triplets for T5s. The kernels take chunks instead of whole
+    // modules, so that the dense modules are spread over many threads.
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE constexpr unsigned int activeChunkSize(ActiveModuleStage stage)
+    {
+        return (stage == MDStage or stage == QuintupletStage) ? 8 : 16;
+    };
+
     struct objectRanges
     {
         int* hitRanges;
@@ -76,6 +94,13 @@ namespace SDL
         int *tripletModuleIndices;
         int *tripletModuleOccupancy;
 
+        // nLowerModules entries per stage, ordered by decreasing expected work
+        uint16_t* activeModules;
+        uint16_t* nActiveModules; // one per stage
+        // First chunk of each listed module, nLowerModules entries per stage
+        unsigned int* activeChunkOffsets;
+        unsigned int* nActiveChunks; // one per stage
+
         unsigned int *device_nTotalMDs;
         unsigned int *device_nTotalSegs;
         unsigned int *device_nTotalTrips;
@@ -108,6 +133,11 @@ namespace SDL
             tripletModuleIndices = alpaka::getPtrNative(objectRangesbuf.tripletModuleIndices_buf);
             tripletModuleOccupancy = alpaka::getPtrNative(objectRangesbuf.tripletModuleOccupancy_buf);
 
+            activeModules = alpaka::getPtrNative(objectRangesbuf.activeModules_buf);
+            nActiveModules = alpaka::getPtrNative(objectRangesbuf.nActiveModules_buf);
+            activeChunkOffsets = alpaka::getPtrNative(objectRangesbuf.activeChunkOffsets_buf);
+            nActiveChunks = alpaka::getPtrNative(objectRangesbuf.nActiveChunks_buf);
+
             device_nTotalMDs = alpaka::getPtrNative(objectRangesbuf.device_nTotalMDs_buf);
             device_nTotalSegs = alpaka::getPtrNative(objectRangesbuf.device_nTotalSegs_buf);
             device_nTotalTrips = alpaka::getPtrNative(objectRangesbuf.device_nTotalTrips_buf);
@@ -142,6 +172,11 @@ namespace SDL
         Buf<TAcc, int> tripletModuleIndices_buf;
         Buf<TAcc, int> tripletModuleOccupancy_buf;
 
+        Buf<TAcc, uint16_t> activeModules_buf;
+        Buf<TAcc, uint16_t> nActiveModules_buf;
+        Buf<TAcc, unsigned int> activeChunkOffsets_buf;
+        Buf<TAcc, unsigned int> nActiveChunks_buf;
+
         Buf<TAcc, unsigned int> device_nTotalMDs_buf;
         Buf<TAcc, unsigned int> device_nTotalSegs_buf;
         Buf<TAcc, unsigned int> device_nTotalTrips_buf;
@@ -173,6 +208,10 @@ namespace SDL
             segmentModuleOccupancy_buf(allocBufWrapper<int>(devAccIn, nLowerMod+1, queue)),
             tripletModuleIndices_buf(allocBufWrapper<int>(devAccIn, nLowerMod, queue)),
             tripletModuleOccupancy_buf(allocBufWrapper<int>(devAccIn, nLowerMod, queue)),
+            activeModules_buf(allocBufWrapper<uint16_t>(devAccIn, nLowerMod*nActiveModuleStages, queue)),
+            nActiveModules_buf(allocBufWrapper<uint16_t>(devAccIn, nActiveModuleStages, queue)),
+            activeChunkOffsets_buf(allocBufWrapper<unsigned int>(devAccIn, nLowerMod*nActiveModuleStages, queue)),
+            nActiveChunks_buf(allocBufWrapper<unsigned int>(devAccIn, nActiveModuleStages, queue)),
             device_nTotalMDs_buf(allocBufWrapper<unsigned int>(devAccIn, 1, queue)),
             device_nTotalSegs_buf(allocBufWrapper<unsigned int>(devAccIn, 1, queue)),
             device_nTotalTrips_buf(allocBufWrapper<unsigned int>(devAccIn, 1, queue)),
@@ -190,6 +229,9 @@ namespace SDL
             alpaka::memset(queue, trackCandidateRanges_buf, -1, nMod*2);
             alpaka::memset(queue, quintupletRanges_buf, -1, nMod*2);
             alpaka::memset(queue, quintupletModuleIndices_buf, -1, nLowerMod);
+            alpaka::memset(queue, quintupletModuleOccupancy_buf, 0, nLowerMod);
+            alpaka::memset(queue, nActiveModules_buf, 0, nActiveModuleStages);
+            alpaka::memset(queue, nActiveChunks_buf, 0, nActiveModuleStages);
             alpaka::wait(queue);
         }
     };
@@ -197,12 +239,14 @@ namespace SDL
     struct modules
     {
         unsigned int* detIds;
-        uint16_t* moduleMap;
+        uint16_t* moduleMap; //connected modules of module i at moduleMap[moduleMapOffsets[i]], nConnectedModules[i] of them
+        unsigned int* moduleMapOffsets;
         unsigned int* mapdetId;
         uint16_t* mapIdx;
         uint16_t* nConnectedModules;
         float* drdzs;
         float* slopes;
+        float* endcapPhis; //orientation phi of endcap 2S modules from the endcap geometry, 0 elsewhere
         uint16_t *nModules;
         uint16_t *nLowerModules;
         uint16_t* partnerModuleIndices;
@@ -222,7 +266,7 @@ namespace SDL
         ModuleLayerType* moduleLayerType;
         int* sdlLayers;
 
-        unsigned int* connectedPixels;
+        uint16_t* connectedPixels;
 
         bool parseIsInverted(short subdet, short side, short module, short layer)
         {
@@ -299,11 +343,13 @@ namespace SDL
         {
             detIds = alpaka::getPtrNative(modulesbuf.detIds_buf);
             moduleMap = alpaka::getPtrNative(modulesbuf.moduleMap_buf);
+            moduleMapOffsets = alpaka::getPtrNative(modulesbuf.moduleMapOffsets_buf);
             mapdetId = alpaka::getPtrNative(modulesbuf.mapdetId_buf);
             mapIdx = alpaka::getPtrNative(modulesbuf.mapIdx_buf);
             nConnectedModules = alpaka::getPtrNative(modulesbuf.nConnectedModules_buf);
             drdzs = alpaka::getPtrNative(modulesbuf.drdzs_buf);
             slopes = alpaka::getPtrNative(modulesbuf.slopes_buf);
+            endcapPhis = alpaka::getPtrNative(modulesbuf.endcapPhis_buf);
             nModules = alpaka::getPtrNative(modulesbuf.nModules_buf);
             nLowerModules = alpaka::getPtrNative(modulesbuf.nLowerModules_buf);
             partnerModuleIndices = alpaka::getPtrNative(modulesbuf.partnerModuleIndices_buf);
@@ -332,11 +378,13 @@ namespace SDL
     {
         Buf<TAcc, unsigned int> detIds_buf;
         Buf<TAcc, uint16_t> moduleMap_buf;
+        Buf<TAcc, unsigned int> moduleMapOffsets_buf;
         Buf<TAcc, unsigned int> mapdetId_buf;
         Buf<TAcc, uint16_t> mapIdx_buf;
         Buf<TAcc, uint16_t> nConnectedModules_buf;
         Buf<TAcc, float> drdzs_buf;
         Buf<TAcc, float> slopes_buf;
+        Buf<TAcc, float> endcapPhis_buf;
         Buf<TAcc, uint16_t> nModules_buf;
         Buf<TAcc, uint16_t> nLowerModules_buf;
         Buf<TAcc, uint16_t> partnerModuleIndices_buf;
@@ -355,20 +403,24 @@ namespace SDL
         Buf<TAcc, ModuleType> moduleType_buf;
         Buf<TAcc, ModuleLayerType> moduleLayerType_buf;
 
-        Buf<TAcc, unsigned int> connectedPixels_buf;
+        Buf<TAcc, uint16_t> connectedPixels_buf;
         Buf<TAcc, int> sdlLayers_buf;
 
+        unsigned int nModuleConnections; //size of moduleMap
+
         template<typename TDevAcc>
         modulesBuffer(TDevAcc const & devAccIn,
                       unsigned int nMod = modules_size,
                       unsigned int nPixs = pix_tot) :
             detIds_buf(allocBufWrapper<unsigned int>(devAccIn, nMod)),
-            moduleMap_buf(allocBufWrapper<uint16_t>(devAccIn, nMod * 40)),
+            moduleMap_buf(allocBufWrapper<uint16_t>(devAccIn, 1)),
+            moduleMapOffsets_buf(allocBufWrapper<unsigned int>(devAccIn, nMod)),
             mapdetId_buf(allocBufWrapper<unsigned int>(devAccIn, nMod)),
             mapIdx_buf(allocBufWrapper<uint16_t>(devAccIn, nMod)),
             nConnectedModules_buf(allocBufWrapper<uint16_t>(devAccIn, nMod)),
             drdzs_buf(allocBufWrapper<float>(devAccIn, nMod)),
             slopes_buf(allocBufWrapper<float>(devAccIn, nMod)),
+            endcapPhis_buf(allocBufWrapper<float>(devAccIn, nMod)),
             nModules_buf(allocBufWrapper<uint16_t>(devAccIn, 1)),
             nLowerModules_buf(allocBufWrapper<uint16_t>(devAccIn, 1)),
             partnerModuleIndices_buf(allocBufWrapper<uint16_t>(devAccIn, nMod)),
@@ -388,8 +440,17 @@ namespace SDL
             moduleLayerType_buf(allocBufWrapper<ModuleLayerType>(devAccIn, nMod)),
             sdlLayers_buf(allocBufWrapper<int>(devAccIn, nMod)),
 
-            connectedPixels_buf(allocBufWrapper<unsigned int>(devAccIn, nPixs))
+            connectedPixels_buf(allocBufWrapper<uint16_t>(devAccIn, nPixs)),
+            nModuleConnections(1)
         {}
+
+        // moduleMap is only sized once the connection map is known, setData has to be called again after this.
+        template<typename TDev>
+        void allocModuleMap(TDev const & devIn, unsigned int nConnections)
+        {
+            moduleMap_buf = allocBufWrapper<uint16_t>(devIn, nConnections);
+            nModuleConnections = nConnections;
+        }
     };
 
     // PixelMap is never allocated on the device.
@@ -482,8 +543,8 @@ namespace SDL
             throw std::runtime_error("Mismatched sizes");
         }
 
-        auto connectedPixels_buf = allocBufWrapper<unsigned int>(devHost, connectedPix_size);
-        unsigned int* connectedPixels = alpaka::getPtrNative(connectedPixels_buf);
+        auto connectedPixels_buf = allocBufWrapper<uint16_t>(devHost, connectedPix_size);
+        uint16_t* connectedPixels = alpaka::getPtrNative(connectedPixels_buf);
 
         for(int icondet = 0; icondet < totalSizes; icondet++)
         {
@@ -505,25 +566,40 @@ namespace SDL
     template<typename TQueue, typename TAcc>
     inline void fillConnectedModuleArrayExplicit(struct modulesBuffer<TAcc>* modulesBuf, unsigned int nMod, TQueue queue)
     {
-        auto moduleMap_buf = allocBufWrapper<uint16_t>(devHost, nMod * 40);
-        uint16_t* moduleMap = alpaka::getPtrNative(moduleMap_buf);
-
         auto nConnectedModules_buf = allocBufWrapper<uint16_t>(devHost, nMod);
         uint16_t* nConnectedModules = alpaka::getPtrNative(nConnectedModules_buf);
 
+        auto moduleMapOffsets_buf = allocBufWrapper<unsigned int>(devHost, nMod);
+        unsigned int* moduleMapOffsets = alpaka::getPtrNative(moduleMapOffsets_buf);
+
         for(auto it = (*detIdToIndex).begin(); it != (*detIdToIndex).end(); ++it)
         {
-            unsigned int detId = it->first;
-            uint16_t index = it->second;
-            auto& connectedModules = moduleConnectionMap.getConnectedModuleDetIds(detId);
-            nConnectedModules[index] = connectedModules.size();
-            for(uint16_t i = 0; i< nConnectedModules[index];i++)
+            nConnectedModules[it->second] = moduleConnectionMap.getConnectedModuleDetIds(it->first).size();
+        }
+
+        unsigned int nConnections = 0;
+        for(unsigned int index = 0; index < nMod; index++)
+        {
+            moduleMapOffsets[index] = nConnections;
+            nConnections += nConnectedModules[index];
+        }
+
+        auto moduleMap_buf = allocBufWrapper<uint16_t>(devHost, nConnections);
+        uint16_t* moduleMap = alpaka::getPtrNative(moduleMap_buf);
+
+        for(auto it = (*detIdToIndex).begin(); it != (*detIdToIndex).end(); ++it)
+        {
+            auto& connectedModules = moduleConnectionMap.getConnectedModuleDetIds(it->first);
+            unsigned int offset = moduleMapOffsets[it->second];
+            for(uint16_t i = 0; i < nConnectedModules[it->second]; i++)
             {
-                moduleMap[index * 40 + i] = (*detIdToIndex)[connectedModules[i]];
+                moduleMap[offset + i] = (*detIdToIndex)[connectedModules[i]];
             }
         }
 
-        alpaka::memcpy(queue, modulesBuf->moduleMap_buf, moduleMap_buf, nMod * 40);
+        modulesBuf->allocModuleMap(alpaka::getDev(modulesBuf->moduleMap_buf), nConnections);
+        alpaka::memcpy(queue, modulesBuf->moduleMap_buf, moduleMap_buf, nConnections);
+        alpaka::memcpy(queue, modulesBuf->moduleMapOffsets_buf, moduleMapOffsets_buf, nMod);
         alpaka::memcpy(queue, modulesBuf->nConnectedModules_buf, nConnectedModules_buf, nMod);
         alpaka::wait(queue);
     };
@@ -650,6 +726,7 @@ namespace SDL
         auto moduleLayerType_buf = allocBufWrapper<ModuleLayerType>(devHost, nModules);
         auto slopes_buf = allocBufWrapper<float>(devHost, nModules);
         auto drdzs_buf = allocBufWrapper<float>(devHost, nModules);
+        auto endcapPhis_buf = allocBufWrapper<float>(devHost, nModules);
         auto partnerModuleIndices_buf = allocBufWrapper<uint16_t>(devHost, nModules);
         auto sdlLayers_buf = allocBufWrapper<int>(devHost, nModules);
 
@@ -670,6 +747,7 @@ namespace SDL
         ModuleLayerType* host_moduleLayerType = alpaka::getPtrNative(moduleLayerType_buf);
         float* host_slopes = alpaka::getPtrNative(slopes_buf);
         float* host_drdzs = alpaka::getPtrNative(drdzs_buf);
+        float* host_endcapPhis = alpaka::getPtrNative(endcapPhis_buf);
         uint16_t* host_partnerModuleIndices = alpaka::getPtrNative(partnerModuleIndices_buf);
         int* host_sdlLayers = alpaka::getPtrNative(sdlLayers_buf);
 
@@ -743,6 +821,7 @@ namespace SDL
                 host_moduleLayerType[index] = SDL::InnerPixelLayer;
                 host_slopes[index] = 0;
                 host_drdzs[index] = 0;
+                host_endcapPhis[index] = 0;
                 host_isAnchor[index] = false;
             }
             else
@@ -765,6 +844,8 @@ namespace SDL
 
                 host_slopes[index] = (subdet == Endcap) ? endcapGeometry->getSlopeLower(detId) : tiltedGeometry.getSlope(detId);
                 host_drdzs[index] = (subdet == Barrel) ? tiltedGeometry.getDrDz(detId) : 0;
+                // Modules missing from the endcap map keep phi = 0, as the CPU map does.
+                host_endcapPhis[index] = (subdet == Endcap and host_moduleType[index] == SDL::TwoS) ? endcapGeometry->getCentroidPhi(detId) : 0;
             }
 
             host_sdlLayers[index] = layer + 6 * (subdet == SDL::Endcap) + 5 * (subdet == SDL::Endcap and host_moduleType[index] == SDL::TwoS);
@@ -813,6 +894,7 @@ namespace SDL
         alpaka::memcpy(queue, modulesBuf->isAnchor_buf, isAnchor_buf);
         alpaka::memcpy(queue, modulesBuf->slopes_buf, slopes_buf);
         alpaka::memcpy(queue, modulesBuf->drdzs_buf, drdzs_buf);
+        alpaka::memcpy(queue, modulesBuf->endcapPhis_buf, endcapPhis_buf);
         alpaka::memcpy(queue, modulesBuf->partnerModuleIndices_buf, partnerModuleIndices_buf);
         alpaka::memcpy(queue, modulesBuf->sdlLayers_buf, sdlLayers_buf);
         alpaka::wait(queue);
@@ -821,5 +903,195 @@ namespace SDL
         fillMapArraysExplicit(modulesBuf, nModules, queue);
         fillPixelMap(modulesBuf, pixelMapping, queue);
     };
+
+    // Expected work of a lower module in a stage, zero if the stage has nothing to do there.
+    // MDs: lower times upper hits. Segments and triplets: inner objects times the objects of the
+    // connected modules, which the outer object has to start in. T5s: the triplets of the modules
+    // eligible for T5s, as the outer triplet does not start in a connected module.
+    template<typename TCount>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned int activeModuleWork(struct SDL::modules& modulesInGPU, struct SDL::objectRanges& rangesInGPU, SDL::ActiveModuleStage stage, const TCount* nInner, const TCount* nOuter, uint16_t lowerModuleIndex)
+    {
+        int nInnerObjects = nInner[lowerModuleIndex];
+        if (nInnerObjects <= 0)
+            return 0;
+
+        if (stage == SDL::MDStage)
+        {
+            int nOuterObjects = nOuter[lowerModuleIndex];
+            return nOuterObjects > 0 ? nInnerObjects * nOuterObjects : 0;
+        }
+        if (stage == SDL::QuintupletStage)
+        {
+            return rangesInGPU.quintupletModuleIndices[lowerModuleIndex] == -1 ? 0 : nInnerObjects;
+        }
+
+        unsigned int nConnectedObjects = 0;
+        unsigned int moduleMapOffset = modulesInGPU.moduleMapOffsets[lowerModuleIndex];
+        for (unsigned int i = 0; i < modulesInGPU.nConnectedModules[lowerModuleIndex]; i++)
+        {
+            int nObjects = nInner[modulesInGPU.moduleMap[moduleMapOffset + i]];
+            if (nObjects > 0)
+                nConnectedObjects += nObjects;
+        }
+        return nInnerObjects * nConnectedObjects;
+    };
+
+    // Bin of a module in createActiveModuleListInGPU, the position of the highest set bit of its work
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned int activeModuleWorkBin(unsigned int work)
+    {
+        unsigned int bin = 0;
+        while (work >>= 1)
+            bin++;
+        return bin;
+    };
+
+    // Listed module of a chunk of a stage, found by bisecting the chunk offsets, and the first inner object of the chunk.
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE uint16_t activeChunkModule(struct SDL::objectRanges& rangesInGPU, SDL::ActiveModuleStage stage, uint16_t nLowerModules, unsigned int chunk, unsigned int& firstInnerObject)
+    {
+        const unsigned int* chunkOffsets = &rangesInGPU.activeChunkOffsets[stage * nLowerModules];
+        unsigned int low = 0;
+        unsigned int high = rangesInGPU.nActiveModules[stage];
+        while (high - low > 1)
+        {
+            unsigned int mid = (low + high) / 2;
+            if (chunkOffsets[mid] <= chunk)
+                low = mid;
+            else
+                high = mid;
+        }
+        firstInnerObject = (chunk - chunkOffsets[low]) * activeChunkSize(stage);
+        return rangesInGPU.activeModules[stage * nLowerModules + low];
+    };
+
+    // Compacts the lower modules with work in a stage into rangesInGPU.activeModules, so that the stage
+    // kernels do not step through the empty modules. The modules are ordered by decreasing power of two
+    // of their expected work, so that the largest ones are started first. The inner objects of each
+    // listed module are then split into chunks of activeChunkSize, numbered in list order through
+    // rangesInGPU.activeChunkOffsets. Runs in one block of at most 1024 threads.
+    // nOuter is only used for the MD stage.
+    struct createActiveModuleListInGPU
+    {
+        template<typename TAcc, typename TCount>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::modules modulesInGPU,
+                struct SDL::objectRanges rangesInGPU,
+                SDL::ActiveModuleStage stage,
+                const TCount* nInner,
+                const TCount* nOuter) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+
+            constexpr unsigned int nWorkBins = 32;
+            auto& binCounts = alpaka::declareSharedVar<unsigned int[nWorkBins], __COUNTER__>(acc);
+            auto& binOffsets = alpaka::declareSharedVar<unsigned int[nWorkBins], __COUNTER__>(acc);
+            for (unsigned int bin = globalThreadIdx[2]; bin < nWorkBins; bin += gridThreadExtent[2])
+            {
+                binCounts[bin] = 0;
+            }
+            alpaka::syncBlockThreads(acc);
+
+            uint16_t nLowerModules = *modulesInGPU.nLowerModules;
+            for (uint16_t lowerModuleIndex = globalThreadIdx[2]; lowerModuleIndex < nLowerModules; lowerModuleIndex += gridThreadExtent[2])
+            {
+                unsigned int work = activeModuleWork(modulesInGPU, rangesInGPU, stage, nInner, nOuter, lowerModuleIndex);
+                if (work > 0)
+                    alpaka::atomicOp<alpaka::AtomicAdd>(acc, &binCounts[activeModuleWorkBin(work)], 1u);
+            }
+            alpaka::syncBlockThreads(acc);
+
+            if (globalThreadIdx[2] == 0)
+            {
+                unsigned int nActiveModules = 0;
+                for (int bin = nWorkBins - 1; bin >= 0; bin--)
+                {
+                    binOffsets[bin] = nActiveModules;
+                    nActiveModules += binCounts[bin];
+                }
+                rangesInGPU.nActiveModules[stage] = static_cast<uint16_t>(nActiveModules);
+            }
+            alpaka::syncBlockThreads(acc);
+
+            uint16_t* activeModules = &rangesInGPU.activeModules[stage * nLowerModules];
+            for (uint16_t lowerModuleIndex = globalThreadIdx[2]; lowerModuleIndex < nLowerModules; lowerModuleIndex += gridThreadExtent[2])
+            {
+                unsigned int work = activeModuleWork(modulesInGPU, rangesInGPU, stage, nInner, nOuter, lowerModuleIndex);
+                if (work > 0)
+                {
+                    unsigned int position = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &binOffsets[activeModuleWorkBin(work)], 1u);
+                    activeModules[position] = lowerModuleIndex;
+                }
+            }
+            alpaka::syncBlockThreads(acc);
+
+            // Exclusive scan of the chunks of the listed modules, each thread summing a contiguous range of them
+            auto& threadSums = alpaka::declareSharedVar<unsigned int[1024], __COUNTER__>(acc);
+            unsigned int nActiveModules = rangesInGPU.nActiveModules[stage];
+            unsigned int chunkSize = activeChunkSize(stage);
+            unsigned int range = (nActiveModules + gridThreadExtent[2] - 1) / gridThreadExtent[2];
+            unsigned int first = alpaka::math::min(acc, static_cast<unsigned int>(globalThreadIdx[2]) * range, nActiveModules);
+            unsigned int last = alpaka::math::min(acc, first + range, nActiveModules);
+
+            unsigned int nChunks = 0;
+            for (unsigned int i = first; i < last; i++)
+            {
+                nChunks += (nInner[activeModules[i]] + chunkSize - 1) / chunkSize;
+            }
+            threadSums[globalThreadIdx[2]] = nChunks;
+            alpaka::syncBlockThreads(acc);
+
+            if (globalThreadIdx[2] == 0)
+            {
+                unsigned int running = 0;
+                for (unsigned int t = 0; t < gridThreadExtent[2]; t++)
+                {
+                    unsigned int threadSum = threadSums[t];
+                    threadSums[t] = running;
+                    running += threadSum;
+                }
+                rangesInGPU.nActiveChunks[stage] = running;
+            }
+            alpaka::syncBlockThreads(acc);
+
+            unsigned int* chunkOffsets = &rangesInGPU.activeChunkOffsets[stage * nLowerModules];
+            unsigned int offset = threadSums[globalThreadIdx[2]];
+            for (unsigned int i = first; i < last; i++)
+            {
+                chunkOffsets[i] = offset;
+                offset += (nInner[activeModules[i]] + chunkSize - 1) / chunkSize;
+            }
+        }
+    };
+
+    // The build kernels only increment the occupancy counter of a module, which keeps counting the objects that did
+    // not fit. The object count of the module is that counter clamped to the occupancy of the module.
+    struct setModuleObjectCounts
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::modules modulesInGPU,
+                const int* totOccupancy,
+                const int* occupancy,
+                int* nObjects) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+
+            for (uint16_t i = globalThreadIdx[2]; i < *modulesInGPU.nLowerModules; i += gridThreadExtent[2])
+            {
+                nObjects[i] = alpaka::math::min(acc, totOccupancy[i], occupancy[i]);
+            }
+        }
+    };
 }
 #endif
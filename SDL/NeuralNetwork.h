@@ -11,14 +11,62 @@
 
 namespace T5DNN
 {
+    constexpr unsigned int nInputFeatures = 38;
+    constexpr unsigned int nHiddenFeatures = 32;
 
+    // Float weights of the three dense layers, read by floatLogit.
+    struct denseLayers
+    {
+        float wgtT0[nInputFeatures * nHiddenFeatures];
+        float b0[nHiddenFeatures];
+        float wgtT2[nHiddenFeatures * nHiddenFeatures];
+        float b2[nHiddenFeatures];
+        float wgtT4[nHiddenFeatures];
+        float b4[1];
+    };
+
+    // int8 weights of the three dense layers with one scale per output, read by quantisedLogit.
+    // The biases stay in float and are copied from the float layers, so that the kernels only
+    // need the layers of the active path.
+    struct quantisedLayers
+    {
+        float scale0[nHiddenFeatures];
+        float b0[nHiddenFeatures];
+        int8_t qWgtT0[nInputFeatures * nHiddenFeatures];
+        float scale2[nHiddenFeatures];
+        float b2[nHiddenFeatures];
+        int8_t qWgtT2[nHiddenFeatures * nHiddenFeatures];
+        float scale4[1];
+        float b4[1];
+        int8_t qWgtT4[nHiddenFeatures];
+    };
+
+    // Network parameters as used by the kernels, filled on the host by SDL::T5DNNWeights
+    // from NeuralNetworkWeights.h or from a weight file.
+    struct alignas(64) weights
+    {
+        denseLayers dense;
+        quantisedLayers quantisedDense; // used when quantised is set
+        float lstWP1;
+        float lstWP2;
+        int quantised;
+    };
+}
+
+#if !defined(ALPAKA_ACC_GPU_CUDA_ENABLED) && !defined(ALPAKA_ACC_GPU_HIP_ENABLED)
+#include "NeuralNetworkSIMD.h"
+#endif
+
+namespace T5DNN
+{
+    // Fills the nInputFeatures DNN inputs of a T5 candidate into x.
     template<typename TAcc>
-    ALPAKA_FN_ACC ALPAKA_FN_INLINE float runInference(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, 
-                                                      struct SDL::segments& segmentsInGPU, struct SDL::triplets& tripletsInGPU, 
-                                                      const float* xVec, const float* yVec, const unsigned int* mdIndices, 
-                                                      const uint16_t* lowerModuleIndices, const unsigned int& innerTripletIndex, 
-                                                      const unsigned int& outerTripletIndex, const float& innerRadius, 
-                                                      const float& outerRadius, const float& bridgeRadius)
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void fillInputs(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, 
+                                                   struct SDL::segments& segmentsInGPU, struct SDL::triplets& tripletsInGPU, 
+                                                   const float* xVec, const float* yVec, const unsigned int* mdIndices, 
+                                                   const uint16_t* lowerModuleIndices, const unsigned int& innerTripletIndex, 
+                                                   const unsigned int& outerTripletIndex, const float& innerRadius, 
+                                                   const float& outerRadius, const float& bridgeRadius, float* x)
     {
         // Unpack x-coordinates of hits
         float x1 = xVec[0];
@@ -59,7 +107,7 @@ namespace T5DNN
         bool is_endcap5 = (modulesInGPU.subdets[lowerModuleIndex5] == 4);                // true if anchor hit 5 is in the endcap
 
         // Build DNN input vector (corresponding output N-tuple branch noted in parenthetical in comment)
-        float x[38] = {
+        const float inputs[nInputFeatures] = {
             SDL::temp_log10(acc, 2*SDL::k2Rinv1GeVf*innerRadius),                                       // inner T3 pT (t3_pt)
             mdsInGPU.anchorEta[mdIndex1],                                                // inner T3 anchor hit 1 eta (t3_0_eta)
             mdsInGPU.anchorPhi[mdIndex1],                                                // inner T3 anchor hit 1 phi (t3_0_phi)
@@ -99,7 +147,19 @@ namespace T5DNN
             SDL::temp_log10(acc, bridgeRadius),                                                         // T5 bridge radius (t5_bridgeRadius)
             SDL::temp_log10(acc, outerRadius)                                                           // T5 outer radius (t5_outerRadius)
         };
+        for (unsigned int i = 0; i < nInputFeatures; ++i)
+        {
+            x[i] = inputs[i];
+        }
+    }
 
+    // (0)-(1): first hidden layer
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE void firstLayer(const float* x, const float* wgtT0, const float* b0, float* x_1)
+    {
+#if !defined(ALPAKA_ACC_GPU_CUDA_ENABLED) && !defined(ALPAKA_ACC_GPU_HIP_ENABLED)
+        // vectorised on the CPU backends
+        denseReLUSIMD<nInputFeatures>(x, wgtT0, b0, x_1);
+#else
         // (0): Linear(in_features=38, out_features=32, bias=True) => x = x*W_T + b
         float x_0[32];
         for (unsigned int col = 0; col < 32; ++col)
@@ -107,18 +167,26 @@ namespace T5DNN
             x_0[col] = 0;
             for (unsigned int inner = 0; inner < 38; ++inner)
             {
-                x_0[col] += x[inner]*wgtT_0[inner][col];
+                x_0[col] += x[inner]*wgtT0[inner*nHiddenFeatures + col];
             }
-            x_0[col] += bias_0[col];
+            x_0[col] += b0[col];
         }
         
         // (1): ReLU()
-        float x_1[32];
         for (unsigned int col = 0; col < 32; ++col)
         {
             x_1[col] = (x_0[col] > 0.f) ? x_0[col] : 0.f;
         }
-        
+#endif
+    }
+
+    // (2)-(3): second hidden layer
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE void secondLayer(const float* x_1, const float* wgtT2, const float* b2, float* x_3)
+    {
+#if !defined(ALPAKA_ACC_GPU_CUDA_ENABLED) && !defined(ALPAKA_ACC_GPU_HIP_ENABLED)
+        // vectorised on the CPU backends
+        denseReLUSIMD<nHiddenFeatures>(x_1, wgtT2, b2, x_3);
+#else
         // (2): Linear(in_features=32, out_features=32, bias=True) => x = x*W_T + b
         float x_2[32];
         for (unsigned int col = 0; col < 32; ++col)
@@ -126,18 +194,38 @@ namespace T5DNN
             x_2[col] = 0;
             for (unsigned int inner = 0; inner < 32; ++inner)
             {
-                x_2[col] += x_1[inner]*wgtT_2[inner][col];
+                x_2[col] += x_1[inner]*wgtT2[inner*nHiddenFeatures + col];
             }
-            x_2[col] += bias_2[col];
+            x_2[col] += b2[col];
         }
         
         // (3): ReLU()
-        float x_3[32];
         for (unsigned int col = 0; col < 32; ++col)
         {
             x_3[col] = (x_2[col] > 0.f) ? x_2[col] : 0.f;
         }
-        
+#endif
+    }
+
+    // Hidden layer with the int8 weights followed by a ReLU, x = scale*(x*Q_T) + b
+    template<unsigned int nIn>
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE void denseReLUQuantised(const float* x, const int8_t* qWgtT, const float* scale, const float* b, float* y)
+    {
+        for (unsigned int col = 0; col < nHiddenFeatures; ++col)
+        {
+            float sum = 0;
+            for (unsigned int inner = 0; inner < nIn; ++inner)
+            {
+                sum += x[inner]*qWgtT[inner*nHiddenFeatures + col];
+            }
+            sum = sum*scale[col] + b[col];
+            y[col] = (sum > 0.f) ? sum : 0.f;
+        }
+    }
+
+    // (4): output layer
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE float outputLayer(const float* x_3, const float* wgtT4, const float* b4)
+    {
         // (4): Linear(in_features=32, out_features=1, bias=True) => x = x*W_T + b
         float x_4[1];
         for (unsigned int col = 0; col < 1; ++col)
@@ -145,11 +233,67 @@ namespace T5DNN
             x_4[col] = 0;
             for (unsigned int inner = 0; inner < 32; ++inner)
             {
-                x_4[col] += x_3[inner]*wgtT_4[inner][col];
+                x_4[col] += x_3[inner]*wgtT4[inner + col];
             }
-            x_4[col] += bias_4[col];
+            x_4[col] += b4[col];
         }
-        
+        return x_4[0];
+    }
+
+    // (4): output layer with the int8 weights
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE float outputLayerQuantised(const float* x_3, const int8_t* qWgtT4, const float* scale4, const float* b4)
+    {
+        float x_4 = 0;
+        for (unsigned int inner = 0; inner < 32; ++inner)
+        {
+            x_4 += x_3[inner]*qWgtT4[inner];
+        }
+        return x_4*scale4[0] + b4[0];
+    }
+
+    // Pre-sigmoid output of the MLP on the inputs x with the float weights.
+    // Also called on the host to validate the quantised weights.
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE float floatLogit(const float* x, const denseLayers& w)
+    {
+        alignas(64) float x_1[32];
+        alignas(64) float x_3[32];
+        firstLayer(x, w.wgtT0, w.b0, x_1);
+        secondLayer(x_1, w.wgtT2, w.b2, x_3);
+        return outputLayer(x_3, w.wgtT4, w.b4);
+    }
+
+    // Pre-sigmoid output of the MLP with the int8 weights.
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE float quantisedLogit(const float* x, const quantisedLayers& w)
+    {
+        float x_1[32];
+        float x_3[32];
+        denseReLUQuantised<nInputFeatures>(x, w.qWgtT0, w.scale0, w.b0, x_1);
+        denseReLUQuantised<nHiddenFeatures>(x_1, w.qWgtT2, w.scale2, w.b2, x_3);
+        return outputLayerQuantised(x_3, w.qWgtT4, w.scale4, w.b4);
+    }
+
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE float logit(const float* x, const denseLayers& w)
+    {
+        return floatLogit(x, w);
+    }
+
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE float logit(const float* x, const quantisedLayers& w)
+    {
+        return quantisedLogit(x, w);
+    }
+
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE float logit(const float* x, const weights& w)
+    {
+        return w.quantised ? quantisedLogit(x, w.quantisedDense) : floatLogit(x, w.dense);
+    }
+
+    // Evaluates the MLP on the inputs x. The weights are either the device copy made by
+    // SDL::T5DNNWeights or the layers of the active path copied from it, e.g. in shared memory.
+    template<typename TAcc, typename TWeights>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE float evaluate(TAcc const & acc, const float* x, const TWeights& w)
+    {
+        float x_4[1] = {logit(x, w)};
+
         // (5): Sigmoid()
         float x_5[1];
         for (unsigned int col = 0; col < 1; ++col)
@@ -159,6 +303,19 @@ namespace T5DNN
         
         return x_5[0];
     }
+
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE float runInference(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, 
+                                                      struct SDL::segments& segmentsInGPU, struct SDL::triplets& tripletsInGPU, 
+                                                      const float* xVec, const float* yVec, const unsigned int* mdIndices, 
+                                                      const uint16_t* lowerModuleIndices, const unsigned int& innerTripletIndex, 
+                                                      const unsigned int& outerTripletIndex, const float& innerRadius, 
+                                                      const float& outerRadius, const float& bridgeRadius, const weights& dnnWeights)
+    {
+        float x[nInputFeatures];
+        fillInputs(acc, modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, xVec, yVec, mdIndices, lowerModuleIndices, innerTripletIndex, outerTripletIndex, innerRadius, outerRadius, bridgeRadius, x);
+        return evaluate(acc, x, dnnWeights);
+    }
 }
 
 #endif
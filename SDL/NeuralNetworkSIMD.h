@@ -0,0 +1,71 @@
+#ifndef NeuralNetworkSIMD_cuh
+#define NeuralNetworkSIMD_cuh
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Included from NeuralNetwork.h on the CPU backends.
+
+namespace T5DNN
+{
+    // Linear layer with 32 outputs followed by a ReLU, vectorised over the outputs.
+    // The rows of wgtT are contiguous in the outputs, so each input is broadcast and multiplied with one row.
+    // The sums are done in the order of the scalar loops in firstLayer and secondLayer, with separate multiplies and adds.
+    // The outputs can still differ from the scalar loops in the last bits, the CPU backend is built with -Ofast.
+    template<unsigned int nIn>
+    ALPAKA_FN_HOST_ACC ALPAKA_FN_INLINE void denseReLUSIMD(const float* x, const float* wgtT, const float* b, float* y)
+    {
+        static_assert(nHiddenFeatures == 32, "denseReLUSIMD assumes 32 outputs per layer");
+#if defined(__AVX512F__)
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        for (unsigned int inner = 0; inner < nIn; ++inner)
+        {
+            __m512 xb = _mm512_set1_ps(x[inner]);
+            acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(xb, _mm512_loadu_ps(wgtT + inner*32)));
+            acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(xb, _mm512_loadu_ps(wgtT + inner*32 + 16)));
+        }
+        // max returns the second operand for NaN and for -0, like the scalar ReLU
+        __m512 zero = _mm512_setzero_ps();
+        _mm512_storeu_ps(y, _mm512_max_ps(_mm512_add_ps(acc0, _mm512_loadu_ps(b)), zero));
+        _mm512_storeu_ps(y + 16, _mm512_max_ps(_mm512_add_ps(acc1, _mm512_loadu_ps(b + 16)), zero));
+#elif defined(__AVX2__)
+        __m256 acc[4];
+        for (unsigned int k = 0; k < 4; ++k)
+        {
+            acc[k] = _mm256_setzero_ps();
+        }
+        for (unsigned int inner = 0; inner < nIn; ++inner)
+        {
+            __m256 xb = _mm256_set1_ps(x[inner]);
+            for (unsigned int k = 0; k < 4; ++k)
+            {
+                acc[k] = _mm256_add_ps(acc[k], _mm256_mul_ps(xb, _mm256_loadu_ps(wgtT + inner*32 + 8*k)));
+            }
+        }
+        // max returns the second operand for NaN and for -0, like the scalar ReLU
+        __m256 zero = _mm256_setzero_ps();
+        for (unsigned int k = 0; k < 4; ++k)
+        {
+            _mm256_storeu_ps(y + 8*k, _mm256_max_ps(_mm256_add_ps(acc[k], _mm256_loadu_ps(b + 8*k)), zero));
+        }
+#else
+        // Scalar fallback, with the loop over the outputs innermost so that the compiler can vectorise it
+        float acc[32] = {};
+        for (unsigned int inner = 0; inner < nIn; ++inner)
+        {
+            for (unsigned int col = 0; col < 32; ++col)
+            {
+                acc[col] += x[inner]*wgtT[inner*32 + col];
+            }
+        }
+        for (unsigned int col = 0; col < 32; ++col)
+        {
+            float sum = acc[col] + b[col];
+            y[col] = (sum > 0.f) ? sum : 0.f;
+        }
+#endif
+    }
+}
+#endif
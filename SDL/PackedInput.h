@@ -0,0 +1,55 @@
+#ifndef PackedInput_cuh
+#define PackedInput_cuh
+
+#include <cstring>
+#include <vector>
+
+#include "Constants.h"
+
+namespace SDL
+{
+    // Layout of the per-event host input packed into one contiguous buffer.
+    // Each column starts at an aligned byte offset so it can be used in place on the device.
+    struct packedInputLayout
+    {
+        static constexpr size_t alignment = 128;
+
+        std::vector<const void*> sources;
+        std::vector<size_t> sizes;
+        std::vector<size_t> offsets;
+        size_t nBytes = 0;
+
+        template<typename T>
+        size_t add(const T* data, size_t nElements)
+        {
+            size_t offset = nBytes;
+            sources.push_back(data);
+            sizes.push_back(nElements * sizeof(T));
+            offsets.push_back(offset);
+            nBytes = offset + (nElements * sizeof(T) + alignment - 1) / alignment * alignment;
+            return offset;
+        }
+
+        template<typename T>
+        size_t add(const std::vector<T>& column)
+        {
+            return add(column.data(), column.size());
+        }
+
+        void pack(char* dst) const
+        {
+            for (size_t i = 0; i < sources.size(); i++)
+            {
+                if (sizes[i] > 0)
+                    std::memcpy(dst + offsets[i], sources[i], sizes[i]);
+            }
+        }
+    };
+
+    template<typename T>
+    ALPAKA_FN_HOST ALPAKA_FN_INLINE T* packedColumn(char* base, size_t offset)
+    {
+        return reinterpret_cast<T*>(base + offset);
+    }
+}
+#endif
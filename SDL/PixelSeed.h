@@ -0,0 +1,335 @@
+#ifndef PixelSeed_cuh
+#define PixelSeed_cuh
+
+#include "Constants.h"
+#include "Hit.h"
+#include "Segment.h"
+#include "PackedInput.h"
+
+namespace SDL
+{
+    // Raw pixel seed tracks as read from the input, plus the per-seed bookkeeping
+    // needed to turn them into pixel line segments (pLS) on the device.
+    // The raw seed columns point into the packed per-event input, only the derived columns are owned by pixelSeedsBuffer.
+    struct pixelSeeds
+    {
+        unsigned int* nSeeds;
+        float* px; // Momentum at the point of closest approach
+        float* py;
+        float* pz;
+        float* dxy;
+        float* dz;
+        float* ptErr;
+        float* etaErr;
+        float* stateTrajGlbX; // Position and momentum at the last hit
+        float* stateTrajGlbY;
+        float* stateTrajGlbZ;
+        float* stateTrajGlbPx;
+        float* stateTrajGlbPy;
+        float* stateTrajGlbPz;
+        int* charge;
+        unsigned int* seedIdx;
+        unsigned int* hitIdxs; // 4 per seed, index of the pixel hits in the input ntuple
+        char* isQuad;
+
+        int* pLSIndex; // Index of the pLS built from this seed, -1 if the seed is rejected
+        unsigned int* hitOffset; // Position of the first pseudo-hit of this seed after the outer tracker hits
+        unsigned int* nPixelSegments;
+        unsigned int* nPixelHits;
+
+        // Per-pLS inputs of addPixelSegmentToEventKernel
+        unsigned int* hitIndices0;
+        unsigned int* hitIndices1;
+        unsigned int* hitIndices2;
+        unsigned int* hitIndices3;
+        float* dPhiChange;
+
+        void setInputs(char* packedInput, size_t const* offsets)
+        {
+            nSeeds = packedColumn<unsigned int>(packedInput, offsets[0]);
+            px = packedColumn<float>(packedInput, offsets[1]);
+            py = packedColumn<float>(packedInput, offsets[2]);
+            pz = packedColumn<float>(packedInput, offsets[3]);
+            dxy = packedColumn<float>(packedInput, offsets[4]);
+            dz = packedColumn<float>(packedInput, offsets[5]);
+            ptErr = packedColumn<float>(packedInput, offsets[6]);
+            etaErr = packedColumn<float>(packedInput, offsets[7]);
+            stateTrajGlbX = packedColumn<float>(packedInput, offsets[8]);
+            stateTrajGlbY = packedColumn<float>(packedInput, offsets[9]);
+            stateTrajGlbZ = packedColumn<float>(packedInput, offsets[10]);
+            stateTrajGlbPx = packedColumn<float>(packedInput, offsets[11]);
+            stateTrajGlbPy = packedColumn<float>(packedInput, offsets[12]);
+            stateTrajGlbPz = packedColumn<float>(packedInput, offsets[13]);
+            charge = packedColumn<int>(packedInput, offsets[14]);
+            seedIdx = packedColumn<unsigned int>(packedInput, offsets[15]);
+            hitIdxs = packedColumn<unsigned int>(packedInput, offsets[16]);
+            isQuad = packedColumn<char>(packedInput, offsets[17]);
+        }
+
+        template<typename TBuff>
+        void setData(TBuff& seedsbuf)
+        {
+            pLSIndex = alpaka::getPtrNative(seedsbuf.pLSIndex_buf);
+            hitOffset = alpaka::getPtrNative(seedsbuf.hitOffset_buf);
+            nPixelSegments = alpaka::getPtrNative(seedsbuf.nPixelSegments_buf);
+            nPixelHits = alpaka::getPtrNative(seedsbuf.nPixelHits_buf);
+            hitIndices0 = alpaka::getPtrNative(seedsbuf.hitIndices0_buf);
+            hitIndices1 = alpaka::getPtrNative(seedsbuf.hitIndices1_buf);
+            hitIndices2 = alpaka::getPtrNative(seedsbuf.hitIndices2_buf);
+            hitIndices3 = alpaka::getPtrNative(seedsbuf.hitIndices3_buf);
+            dPhiChange = alpaka::getPtrNative(seedsbuf.dPhiChange_buf);
+        }
+    };
+
+    template<typename TAcc>
+    struct pixelSeedsBuffer : pixelSeeds
+    {
+        Buf<TAcc, int> pLSIndex_buf;
+        Buf<TAcc, unsigned int> hitOffset_buf;
+        Buf<TAcc, unsigned int> nPixelSegments_buf;
+        Buf<TAcc, unsigned int> nPixelHits_buf;
+        Buf<TAcc, unsigned int> hitIndices0_buf;
+        Buf<TAcc, unsigned int> hitIndices1_buf;
+        Buf<TAcc, unsigned int> hitIndices2_buf;
+        Buf<TAcc, unsigned int> hitIndices3_buf;
+        Buf<TAcc, float> dPhiChange_buf;
+
+        template<typename TQueue, typename TDevAcc>
+        pixelSeedsBuffer(unsigned int nMaxSeeds,
+                         TDevAcc const & devAccIn,
+                         TQueue& queue) :
+            pLSIndex_buf(allocBufWrapper<int>(devAccIn, nMaxSeeds, queue)),
+            hitOffset_buf(allocBufWrapper<unsigned int>(devAccIn, nMaxSeeds, queue)),
+            nPixelSegments_buf(allocBufWrapper<unsigned int>(devAccIn, 1u, queue)),
+            nPixelHits_buf(allocBufWrapper<unsigned int>(devAccIn, 1u, queue)),
+            hitIndices0_buf(allocBufWrapper<unsigned int>(devAccIn, nMaxSeeds, queue)),
+            hitIndices1_buf(allocBufWrapper<unsigned int>(devAccIn, nMaxSeeds, queue)),
+            hitIndices2_buf(allocBufWrapper<unsigned int>(devAccIn, nMaxSeeds, queue)),
+            hitIndices3_buf(allocBufWrapper<unsigned int>(devAccIn, nMaxSeeds, queue)),
+            dPhiChange_buf(allocBufWrapper<float>(devAccIn, nMaxSeeds, queue))
+        {
+            alpaka::memset(queue, nPixelSegments_buf, 0u, 1u);
+            alpaka::memset(queue, nPixelHits_buf, 0u, 1u);
+            alpaka::wait(queue);
+        }
+    };
+
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE bool passPixelSeedSelection(TAcc const & acc, struct SDL::pixelSeeds& seedsInGPU, unsigned int iSeed)
+    {
+        float pxLH = seedsInGPU.stateTrajGlbPx[iSeed];
+        float pyLH = seedsInGPU.stateTrajGlbPy[iSeed];
+        float ptIn = alpaka::math::sqrt(acc, pxLH * pxLH + pyLH * pyLH);
+        return ptIn > SDL::ptCut - 2 * seedsInGPU.ptErr[iSeed];
+    };
+
+    // Assigns the pLS index and the pseudo-hit offset of every accepted seed.
+    // Runs as a single block so that the pLS keep the input seed order.
+    struct selectPixelSeedsKernel
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+            TAcc const & acc,
+            struct SDL::hits hitsInGPU,
+            struct SDL::pixelSeeds seedsInGPU,
+            unsigned int nOuterHits) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const blockThreadIdx = alpaka::getIdx<alpaka::Block, alpaka::Threads>(acc);
+            Vec const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
+
+            unsigned int blockThread = blockThreadIdx[2];
+            unsigned int nThreads = blockThreadExtent[2];
+            unsigned int nSeeds = *seedsInGPU.nSeeds;
+
+            auto& nSegmentsBefore = alpaka::declareSharedVar<unsigned int[1024], __COUNTER__>(acc);
+            auto& nHitsBefore = alpaka::declareSharedVar<unsigned int[1024], __COUNTER__>(acc);
+
+            // Each thread handles a contiguous chunk of seeds.
+            unsigned int chunkSize = (nSeeds + nThreads - 1) / nThreads;
+            unsigned int firstSeed = alpaka::math::min(acc, blockThread * chunkSize, nSeeds);
+            unsigned int lastSeed = alpaka::math::min(acc, firstSeed + chunkSize, nSeeds);
+
+            unsigned int nSegmentsChunk = 0;
+            unsigned int nHitsChunk = 0;
+            for(unsigned int iSeed = firstSeed; iSeed < lastSeed; iSeed++)
+            {
+                if(passPixelSeedSelection(acc, seedsInGPU, iSeed))
+                {
+                    nSegmentsChunk++;
+                    nHitsChunk += seedsInGPU.isQuad[iSeed] ? 4 : 3;
+                }
+            }
+            nSegmentsBefore[blockThread] = nSegmentsChunk;
+            nHitsBefore[blockThread] = nHitsChunk;
+            alpaka::syncBlockThreads(acc);
+
+            if(blockThread == 0)
+            {
+                unsigned int nSegmentsSum = 0;
+                unsigned int nHitsSum = 0;
+                for(unsigned int i = 0; i < nThreads; i++)
+                {
+                    unsigned int nSegmentsThread = nSegmentsBefore[i];
+                    unsigned int nHitsThread = nHitsBefore[i];
+                    nSegmentsBefore[i] = nSegmentsSum;
+                    nHitsBefore[i] = nHitsSum;
+                    nSegmentsSum += nSegmentsThread;
+                    nHitsSum += nHitsThread;
+                }
+                *seedsInGPU.nPixelSegments = nSegmentsSum;
+                *seedsInGPU.nPixelHits = nHitsSum;
+                *hitsInGPU.nHits = nOuterHits + nHitsSum;
+            }
+            alpaka::syncBlockThreads(acc);
+
+            unsigned int pLSIndex = nSegmentsBefore[blockThread];
+            unsigned int hitOffset = nHitsBefore[blockThread];
+            for(unsigned int iSeed = firstSeed; iSeed < lastSeed; iSeed++)
+            {
+                if(passPixelSeedSelection(acc, seedsInGPU, iSeed))
+                {
+                    seedsInGPU.pLSIndex[iSeed] = pLSIndex;
+                    seedsInGPU.hitOffset[iSeed] = hitOffset;
+                    pLSIndex++;
+                    hitOffset += seedsInGPU.isQuad[iSeed] ? 4 : 3;
+                }
+                else
+                {
+                    seedsInGPU.pLSIndex[iSeed] = -1;
+                }
+            }
+        }
+    };
+
+    // Builds the pixel pseudo-hits and the pLS quantities of every accepted seed.
+    // The pixel type dPhi change is phi(r) - phi(p) at the last hit, or with cmsswDeltaPhiChange the phi of r - p
+    // in double precision as in the CMSSW interface.
+    struct preparePixelSeedsKernel
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+            TAcc const & acc,
+            struct SDL::hits hitsInGPU,
+            struct SDL::segments segmentsInGPU,
+            struct SDL::pixelSeeds seedsInGPU,
+            unsigned int nOuterHits,
+            uint16_t pixelModuleIndex,
+            bool cmsswDeltaPhiChange) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+
+            unsigned int nSeeds = *seedsInGPU.nSeeds;
+            for(unsigned int iSeed = globalThreadIdx[2]; iSeed < nSeeds; iSeed += gridThreadExtent[2])
+            {
+                int pLSIndex = seedsInGPU.pLSIndex[iSeed];
+                if(pLSIndex < 0)
+                    continue;
+
+                float pxLH = seedsInGPU.stateTrajGlbPx[iSeed];
+                float pyLH = seedsInGPU.stateTrajGlbPy[iSeed];
+                float pzLH = seedsInGPU.stateTrajGlbPz[iSeed];
+                float xLH = seedsInGPU.stateTrajGlbX[iSeed];
+                float yLH = seedsInGPU.stateTrajGlbY[iSeed];
+                float zLH = seedsInGPU.stateTrajGlbZ[iSeed];
+
+                float ptIn = alpaka::math::sqrt(acc, pxLH * pxLH + pyLH * pyLH);
+                float ptErr = seedsInGPU.ptErr[iSeed];
+                float pixelSegmentDeltaPhiChange;
+                if (cmsswDeltaPhiChange)
+                    pixelSegmentDeltaPhiChange = alpaka::math::atan2(acc, double(yLH) - double(pyLH), double(xLH) - double(pxLH));
+                else
+                    pixelSegmentDeltaPhiChange = phi_mpi_pi(acc, SDL::phi(acc, xLH, yLH) - SDL::phi(acc, pxLH, pyLH));
+
+                int8_t pixtype;
+                if (ptIn >= 2.0f) pixtype = 0;
+                else if (pixelSegmentDeltaPhiChange >= 0) pixtype = 1;
+                else pixtype = 2;
+
+                // Position at the point of closest approach
+                float pxPCA = seedsInGPU.px[iSeed];
+                float pyPCA = seedsInGPU.py[iSeed];
+                float pzPCA = seedsInGPU.pz[iSeed];
+                float dxy = seedsInGPU.dxy[iSeed];
+                float dz = seedsInGPU.dz[iSeed];
+                float ptPCA = alpaka::math::sqrt(acc, pxPCA * pxPCA + pyPCA * pyPCA);
+                float pPCA = alpaka::math::sqrt(acc, pxPCA * pxPCA + pyPCA * pyPCA + pzPCA * pzPCA);
+                float etaPCA = SDL::eta(acc, pxPCA, pyPCA, pzPCA);
+                float phiPCA = SDL::phi(acc, pxPCA, pyPCA);
+                float xPCA = -dxy * pyPCA / ptPCA - pxPCA / pPCA * pzPCA / pPCA * dz;
+                float yPCA = dxy * pxPCA / ptPCA - pyPCA / pPCA * pzPCA / pPCA * dz;
+                float zPCA = dz * ptPCA * ptPCA / pPCA / pPCA;
+
+                // Pseudo-hits: PCA position, PCA (pt, eta, phi), last hit position and (x, dxy, dz) for quadruplets.
+                char isQuad = seedsInGPU.isQuad[iSeed];
+                unsigned int hitIdx0 = nOuterHits + seedsInGPU.hitOffset[iSeed];
+                unsigned int hitIdx1 = hitIdx0 + 1;
+                unsigned int hitIdx2 = hitIdx0 + 2;
+                unsigned int hitIdx3 = isQuad ? hitIdx0 + 3 : hitIdx2;
+
+                hitsInGPU.xs[hitIdx0] = xPCA;
+                hitsInGPU.ys[hitIdx0] = yPCA;
+                hitsInGPU.zs[hitIdx0] = zPCA;
+                hitsInGPU.xs[hitIdx1] = ptPCA;
+                hitsInGPU.ys[hitIdx1] = etaPCA;
+                hitsInGPU.zs[hitIdx1] = phiPCA;
+                hitsInGPU.xs[hitIdx2] = xLH;
+                hitsInGPU.ys[hitIdx2] = yLH;
+                hitsInGPU.zs[hitIdx2] = zLH;
+                if(isQuad)
+                {
+                    hitsInGPU.xs[hitIdx3] = xLH;
+                    hitsInGPU.ys[hitIdx3] = dxy;
+                    hitsInGPU.zs[hitIdx3] = dz;
+                }
+                for(unsigned int i = 0; i < (isQuad ? 4u : 3u); i++)
+                {
+                    hitsInGPU.detid[hitIdx0 + i] = 1;
+                    hitsInGPU.moduleIndices[hitIdx0 + i] = pixelModuleIndex;
+                    hitsInGPU.idxs[hitIdx0 + i] = seedsInGPU.hitIdxs[4 * iSeed + i];
+                }
+
+                // pLS beyond the maximum are truncated in addPixelSegmentToEvent.
+                if(pLSIndex >= N_MAX_PIXEL_SEGMENTS_PER_MODULE)
+                    continue;
+
+                float neta = 25.;
+                float nphi = 72.;
+                float nz = 25.;
+                int etabin = (etaPCA + 2.6f) / ((2 * 2.6f) / neta);
+                int phibin = (phiPCA + float(M_PI)) / ((2.f * float(M_PI)) / nphi);
+                int dzbin = (dz + 30) / (2 * 30 / nz);
+                int isuperbin = (nz * nphi) * etabin + (nz) * phibin + dzbin;
+
+                seedsInGPU.hitIndices0[pLSIndex] = hitIdx0;
+                seedsInGPU.hitIndices1[pLSIndex] = hitIdx1;
+                seedsInGPU.hitIndices2[pLSIndex] = hitIdx2;
+                seedsInGPU.hitIndices3[pLSIndex] = hitIdx3;
+                seedsInGPU.dPhiChange[pLSIndex] = pixelSegmentDeltaPhiChange;
+
+                segmentsInGPU.ptIn[pLSIndex] = ptIn;
+                segmentsInGPU.ptErr[pLSIndex] = ptErr;
+                segmentsInGPU.px[pLSIndex] = pxLH;
+                segmentsInGPU.py[pLSIndex] = pyLH;
+                segmentsInGPU.pz[pLSIndex] = pzLH;
+                segmentsInGPU.etaErr[pLSIndex] = seedsInGPU.etaErr[iSeed];
+                segmentsInGPU.isQuad[pLSIndex] = isQuad;
+                segmentsInGPU.eta[pLSIndex] = SDL::eta(acc, pxLH, pyLH, pzLH);
+                segmentsInGPU.phi[pLSIndex] = SDL::phi(acc, pxLH, pyLH);
+                segmentsInGPU.charge[pLSIndex] = seedsInGPU.charge[iSeed];
+                segmentsInGPU.seedIdx[pLSIndex] = seedsInGPU.seedIdx[iSeed];
+                segmentsInGPU.superbin[pLSIndex] = isuperbin;
+                segmentsInGPU.pixelType[pLSIndex] = pixtype;
+            }
+        }
+    };
+}
+#endif
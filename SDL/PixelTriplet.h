@@ -33,10 +33,13 @@ namespace SDL
         FPX* phi_pix;
         FPX* score;
         bool* isDup;
+        unsigned long long* dupCompetitor;
         bool* partOfPT5;
 
         uint8_t* logicalLayers;
         unsigned int* hitIndices;
+        unsigned int* sortedHitIndices;
+        unsigned long long* hitMask;
         uint16_t* lowerModuleIndices;
         FPX* centerX;
         FPX* centerY;
@@ -57,9 +60,12 @@ namespace SDL
             phi_pix = alpaka::getPtrNative(pixelTripletsBuffer.phi_pix_buf);
             score = alpaka::getPtrNative(pixelTripletsBuffer.score_buf);
             isDup = alpaka::getPtrNative(pixelTripletsBuffer.isDup_buf);
+            dupCompetitor = alpaka::getPtrNative(pixelTripletsBuffer.dupCompetitor_buf);
             partOfPT5 = alpaka::getPtrNative(pixelTripletsBuffer.partOfPT5_buf);
             logicalLayers = alpaka::getPtrNative(pixelTripletsBuffer.logicalLayers_buf);
             hitIndices = alpaka::getPtrNative(pixelTripletsBuffer.hitIndices_buf);
+            sortedHitIndices = alpaka::getPtrNative(pixelTripletsBuffer.sortedHitIndices_buf);
+            hitMask = alpaka::getPtrNative(pixelTripletsBuffer.hitMask_buf);
             lowerModuleIndices = alpaka::getPtrNative(pixelTripletsBuffer.lowerModuleIndices_buf);
             centerX = alpaka::getPtrNative(pixelTripletsBuffer.centerX_buf);
             centerY = alpaka::getPtrNative(pixelTripletsBuffer.centerY_buf);
@@ -86,9 +92,12 @@ namespace SDL
         Buf<TAcc, FPX> phi_pix_buf;
         Buf<TAcc, FPX> score_buf;
         Buf<TAcc, bool> isDup_buf;
+        Buf<TAcc, unsigned long long> dupCompetitor_buf;
         Buf<TAcc, bool> partOfPT5_buf;
         Buf<TAcc, uint8_t> logicalLayers_buf;
         Buf<TAcc, unsigned int> hitIndices_buf;
+        Buf<TAcc, unsigned int> sortedHitIndices_buf;
+        Buf<TAcc, unsigned long long> hitMask_buf;
         Buf<TAcc, uint16_t> lowerModuleIndices_buf;
         Buf<TAcc, FPX> centerX_buf;
         Buf<TAcc, FPX> centerY_buf;
@@ -114,9 +123,12 @@ namespace SDL
             phi_pix_buf(allocBufWrapper<FPX>(devAccIn, maxPixelTriplets, queue)),
             score_buf(allocBufWrapper<FPX>(devAccIn, maxPixelTriplets, queue)),
             isDup_buf(allocBufWrapper<bool>(devAccIn, maxPixelTriplets, queue)),
+            dupCompetitor_buf(allocBufWrapper<unsigned long long>(devAccIn, maxPixelTriplets, queue)),
             partOfPT5_buf(allocBufWrapper<bool>(devAccIn, maxPixelTriplets, queue)),
             logicalLayers_buf(allocBufWrapper<uint8_t>(devAccIn, maxPixelTriplets*5, queue)),
             hitIndices_buf(allocBufWrapper<unsigned int>(devAccIn, maxPixelTriplets*10, queue)),
+            sortedHitIndices_buf(allocBufWrapper<unsigned int>(devAccIn, maxPixelTriplets*10, queue)),
+            hitMask_buf(allocBufWrapper<unsigned long long>(devAccIn, maxPixelTriplets, queue)),
             lowerModuleIndices_buf(allocBufWrapper<uint16_t>(devAccIn, maxPixelTriplets*5, queue)),
             centerX_buf(allocBufWrapper<FPX>(devAccIn, maxPixelTriplets, queue)),
             centerY_buf(allocBufWrapper<FPX>(devAccIn, maxPixelTriplets, queue)),
@@ -144,6 +156,7 @@ namespace SDL
         pixelTripletsInGPU.eta_pix[pixelTripletIndex] = __F2H(eta_pix);
         pixelTripletsInGPU.phi_pix[pixelTripletIndex] = __F2H(phi_pix);
         pixelTripletsInGPU.isDup[pixelTripletIndex] = 0;
+        pixelTripletsInGPU.dupCompetitor[pixelTripletIndex] = noDupCompetitor;
         pixelTripletsInGPU.score[pixelTripletIndex] = __F2H(score);
 
         pixelTripletsInGPU.centerX[pixelTripletIndex] = __F2H(centerX);
@@ -174,6 +187,9 @@ namespace SDL
         pixelTripletsInGPU.hitIndices[10 * pixelTripletIndex + 7] = tripletsInGPU.hitIndices[6 * tripletIndex + 3];
         pixelTripletsInGPU.hitIndices[10 * pixelTripletIndex + 8] = tripletsInGPU.hitIndices[6 * tripletIndex + 4];
         pixelTripletsInGPU.hitIndices[10 * pixelTripletIndex + 9] = tripletsInGPU.hitIndices[6 * tripletIndex + 5];
+        // The pixel and the triplet hits are sorted separately, since their matches are counted separately
+        pixelTripletsInGPU.hitMask[pixelTripletIndex] = fillHitSignature<4>(&pixelTripletsInGPU.hitIndices[10 * pixelTripletIndex], &pixelTripletsInGPU.sortedHitIndices[10 * pixelTripletIndex])
+                                                      | fillHitSignature<6>(&pixelTripletsInGPU.hitIndices[10 * pixelTripletIndex + 4], &pixelTripletsInGPU.sortedHitIndices[10 * pixelTripletIndex + 4]);
         pixelTripletsInGPU.rPhiChiSquared[pixelTripletIndex] = rPhiChiSquared;
         pixelTripletsInGPU.rPhiChiSquaredInwards[pixelTripletIndex] = rPhiChiSquaredInwards;
         pixelTripletsInGPU.rzChiSquared[pixelTripletIndex] = rzChiSquared;
@@ -1446,11 +1462,14 @@ namespace SDL
         int* nPixelQuintuplets;
         int* totOccupancyPixelQuintuplets;
         bool* isDup;
+        unsigned long long* dupCompetitor;
         FPX* score;
         FPX* eta;
         FPX* phi;
         uint8_t* logicalLayers;
         unsigned int* hitIndices;
+        unsigned int* sortedHitIndices;
+        unsigned long long* hitMask;
         uint16_t* lowerModuleIndices;
         FPX* pixelRadius;
         FPX* quintupletRadius;
@@ -1468,11 +1487,14 @@ namespace SDL
             nPixelQuintuplets = alpaka::getPtrNative(pixelQuintupletsBuffer.nPixelQuintuplets_buf);
             totOccupancyPixelQuintuplets = alpaka::getPtrNative(pixelQuintupletsBuffer.totOccupancyPixelQuintuplets_buf);
             isDup = alpaka::getPtrNative(pixelQuintupletsBuffer.isDup_buf);
+            dupCompetitor = alpaka::getPtrNative(pixelQuintupletsBuffer.dupCompetitor_buf);
             score = alpaka::getPtrNative(pixelQuintupletsBuffer.score_buf);
             eta = alpaka::getPtrNative(pixelQuintupletsBuffer.eta_buf);
             phi = alpaka::getPtrNative(pixelQuintupletsBuffer.phi_buf);
             logicalLayers = alpaka::getPtrNative(pixelQuintupletsBuffer.logicalLayers_buf);
             hitIndices = alpaka::getPtrNative(pixelQuintupletsBuffer.hitIndices_buf);
+            sortedHitIndices = alpaka::getPtrNative(pixelQuintupletsBuffer.sortedHitIndices_buf);
+            hitMask = alpaka::getPtrNative(pixelQuintupletsBuffer.hitMask_buf);
             lowerModuleIndices = alpaka::getPtrNative(pixelQuintupletsBuffer.lowerModuleIndices_buf);
             pixelRadius = alpaka::getPtrNative(pixelQuintupletsBuffer.pixelRadius_buf);
             quintupletRadius = alpaka::getPtrNative(pixelQuintupletsBuffer.quintupletRadius_buf);
@@ -1492,11 +1514,14 @@ namespace SDL
         Buf<TAcc, int> nPixelQuintuplets_buf;
         Buf<TAcc, int> totOccupancyPixelQuintuplets_buf;
         Buf<TAcc, bool> isDup_buf;
+        Buf<TAcc, unsigned long long> dupCompetitor_buf;
         Buf<TAcc, FPX> score_buf;
         Buf<TAcc, FPX> eta_buf;
         Buf<TAcc, FPX> phi_buf;
         Buf<TAcc, uint8_t> logicalLayers_buf;
         Buf<TAcc, unsigned int> hitIndices_buf;
+        Buf<TAcc, unsigned int> sortedHitIndices_buf;
+        Buf<TAcc, unsigned long long> hitMask_buf;
         Buf<TAcc, uint16_t> lowerModuleIndices_buf;
         Buf<TAcc, FPX> pixelRadius_buf;
         Buf<TAcc, FPX> quintupletRadius_buf;
@@ -1515,11 +1540,14 @@ namespace SDL
             nPixelQuintuplets_buf(allocBufWrapper<int>(devAccIn, 1, queue)),
             totOccupancyPixelQuintuplets_buf(allocBufWrapper<int>(devAccIn, 1, queue)),
             isDup_buf(allocBufWrapper<bool>(devAccIn, maxPixelQuintuplets, queue)),
+            dupCompetitor_buf(allocBufWrapper<unsigned long long>(devAccIn, maxPixelQuintuplets, queue)),
             score_buf(allocBufWrapper<FPX>(devAccIn, maxPixelQuintuplets, queue)),
             eta_buf(allocBufWrapper<FPX>(devAccIn, maxPixelQuintuplets, queue)),
             phi_buf(allocBufWrapper<FPX>(devAccIn, maxPixelQuintuplets, queue)),
             logicalLayers_buf(allocBufWrapper<uint8_t>(devAccIn, maxPixelQuintuplets*7, queue)),
             hitIndices_buf(allocBufWrapper<unsigned int>(devAccIn, maxPixelQuintuplets*14, queue)),
+            sortedHitIndices_buf(allocBufWrapper<unsigned int>(devAccIn, maxPixelQuintuplets*14, queue)),
+            hitMask_buf(allocBufWrapper<unsigned long long>(devAccIn, maxPixelQuintuplets, queue)),
             lowerModuleIndices_buf(allocBufWrapper<uint16_t>(devAccIn, maxPixelQuintuplets*7, queue)),
             pixelRadius_buf(allocBufWrapper<FPX>(devAccIn, maxPixelQuintuplets, queue)),
             quintupletRadius_buf(allocBufWrapper<FPX>(devAccIn, maxPixelQuintuplets, queue)),
@@ -1540,6 +1568,7 @@ namespace SDL
         pixelQuintupletsInGPU.pixelIndices[pixelQuintupletIndex] = pixelIndex;
         pixelQuintupletsInGPU.T5Indices[pixelQuintupletIndex] = T5Index;
         pixelQuintupletsInGPU.isDup[pixelQuintupletIndex] = 0;
+        pixelQuintupletsInGPU.dupCompetitor[pixelQuintupletIndex] = noDupCompetitor;
         pixelQuintupletsInGPU.score[pixelQuintupletIndex] = __F2H(score);
         pixelQuintupletsInGPU.eta[pixelQuintupletIndex]   = __F2H(eta);
         pixelQuintupletsInGPU.phi[pixelQuintupletIndex]   = __F2H(phi);
@@ -1583,6 +1612,7 @@ namespace SDL
         pixelQuintupletsInGPU.hitIndices[14 * pixelQuintupletIndex + 11] = quintupletsInGPU.hitIndices[10 * T5Index + 7];
         pixelQuintupletsInGPU.hitIndices[14 * pixelQuintupletIndex + 12] = quintupletsInGPU.hitIndices[10 * T5Index + 8];
         pixelQuintupletsInGPU.hitIndices[14 * pixelQuintupletIndex + 13] = quintupletsInGPU.hitIndices[10 * T5Index + 9];
+        pixelQuintupletsInGPU.hitMask[pixelQuintupletIndex] = fillHitSignature<14>(&pixelQuintupletsInGPU.hitIndices[14 * pixelQuintupletIndex], &pixelQuintupletsInGPU.sortedHitIndices[14 * pixelQuintupletIndex]);
             
         pixelQuintupletsInGPU.rzChiSquared[pixelQuintupletIndex] = rzChiSquared;
         pixelQuintupletsInGPU.rPhiChiSquared[pixelQuintupletIndex] = rPhiChiSquared;
@@ -9,6 +9,7 @@
 #include "Module.h"
 #include "Hit.h"
 #include "Triplet.h"
+#include "HitSignature.h"
 
 namespace SDL
 {
@@ -29,6 +30,7 @@ namespace SDL
         FPX* score_rphisum;
         uint8_t* layer;
         bool* isDup;
+        unsigned long long* dupCompetitor;
         bool* TightCutFlag;
         bool* partOfPT5;
 
@@ -38,6 +40,8 @@ namespace SDL
 
         uint8_t* logicalLayers;
         unsigned int* hitIndices;
+        unsigned int* sortedHitIndices;
+        unsigned long long* hitMask;
         float* rzChiSquared;
         float* chiSquared;
         float* nonAnchorChiSquared;
@@ -59,6 +63,7 @@ namespace SDL
             score_rphisum = alpaka::getPtrNative(quintupletsbuf.score_rphisum_buf);
             layer = alpaka::getPtrNative(quintupletsbuf.layer_buf);
             isDup = alpaka::getPtrNative(quintupletsbuf.isDup_buf);
+            dupCompetitor = alpaka::getPtrNative(quintupletsbuf.dupCompetitor_buf);
             TightCutFlag = alpaka::getPtrNative(quintupletsbuf.TightCutFlag_buf);
             partOfPT5 = alpaka::getPtrNative(quintupletsbuf.partOfPT5_buf);
             regressionRadius = alpaka::getPtrNative(quintupletsbuf.regressionRadius_buf);
@@ -66,6 +71,8 @@ namespace SDL
             regressionF = alpaka::getPtrNative(quintupletsbuf.regressionF_buf);
             logicalLayers = alpaka::getPtrNative(quintupletsbuf.logicalLayers_buf);
             hitIndices = alpaka::getPtrNative(quintupletsbuf.hitIndices_buf);
+            sortedHitIndices = alpaka::getPtrNative(quintupletsbuf.sortedHitIndices_buf);
+            hitMask = alpaka::getPtrNative(quintupletsbuf.hitMask_buf);
             rzChiSquared = alpaka::getPtrNative(quintupletsbuf.rzChiSquared_buf);
             chiSquared = alpaka::getPtrNative(quintupletsbuf.chiSquared_buf);
             nonAnchorChiSquared = alpaka::getPtrNative(quintupletsbuf.nonAnchorChiSquared_buf);
@@ -90,6 +97,7 @@ namespace SDL
         Buf<TAcc, FPX> score_rphisum_buf;
         Buf<TAcc, uint8_t> layer_buf;
         Buf<TAcc, bool> isDup_buf;
+        Buf<TAcc, unsigned long long> dupCompetitor_buf;
         Buf<TAcc, bool> TightCutFlag_buf;
         Buf<TAcc, bool> partOfPT5_buf;
 
@@ -99,6 +107,8 @@ namespace SDL
 
         Buf<TAcc, uint8_t> logicalLayers_buf;
         Buf<TAcc, unsigned int> hitIndices_buf;
+        Buf<TAcc, unsigned int> sortedHitIndices_buf;
+        Buf<TAcc, unsigned long long> hitMask_buf;
         Buf<TAcc, float> rzChiSquared_buf;
         Buf<TAcc, float> chiSquared_buf;
         Buf<TAcc, float> nonAnchorChiSquared_buf;
@@ -122,6 +132,7 @@ namespace SDL
             score_rphisum_buf(allocBufWrapper<FPX>(devAccIn, nTotalQuintuplets, queue)),
             layer_buf(allocBufWrapper<uint8_t>(devAccIn, nTotalQuintuplets, queue)),
             isDup_buf(allocBufWrapper<bool>(devAccIn, nTotalQuintuplets, queue)),
+            dupCompetitor_buf(allocBufWrapper<unsigned long long>(devAccIn, nTotalQuintuplets, queue)),
             TightCutFlag_buf(allocBufWrapper<bool>(devAccIn, nTotalQuintuplets, queue)),
             partOfPT5_buf(allocBufWrapper<bool>(devAccIn, nTotalQuintuplets, queue)),
             regressionRadius_buf(allocBufWrapper<float>(devAccIn, nTotalQuintuplets, queue)),
@@ -129,6 +140,8 @@ namespace SDL
             regressionF_buf(allocBufWrapper<float>(devAccIn, nTotalQuintuplets, queue)),
             logicalLayers_buf(allocBufWrapper<uint8_t>(devAccIn, 5 * nTotalQuintuplets, queue)),
             hitIndices_buf(allocBufWrapper<unsigned int>(devAccIn, 10 * nTotalQuintuplets, queue)),
+            sortedHitIndices_buf(allocBufWrapper<unsigned int>(devAccIn, 10 * nTotalQuintuplets, queue)),
+            hitMask_buf(allocBufWrapper<unsigned long long>(devAccIn, nTotalQuintuplets, queue)),
             rzChiSquared_buf(allocBufWrapper<float>(devAccIn, nTotalQuintuplets, queue)),
             chiSquared_buf(allocBufWrapper<float>(devAccIn, nTotalQuintuplets, queue)),
             nonAnchorChiSquared_buf(allocBufWrapper<float>(devAccIn, nTotalQuintuplets, queue))
@@ -142,11 +155,117 @@ namespace SDL
         }
     };
 
+#if defined(USE_T5_DNN) && defined(DEFERRED_T5_DNN)
+    constexpr bool deferredT5DNN = true;
+#else
+    constexpr bool deferredT5DNN = false;
+#endif
+
+    // T5 candidates that passed every cut but the DNN, evaluated in batches by runT5DNNInGPU.
+    struct t5DNNCandidates
+    {
+        unsigned int* nCandidates;
+        unsigned int* nMemoryLocations;
+        unsigned int* tripletIndices; //2 per candidate
+        float* innerRadius;
+        float* bridgeRadius;
+        float* outerRadius;
+        float* regressionG;
+        float* regressionF;
+        float* regressionRadius;
+        float* rzChiSquared;
+        float* chiSquared;
+        float* nonAnchorChiSquared;
+        bool* TightCutFlag;
+        float* inputs; //T5DNN::nInputFeatures per candidate
+
+        template<typename TBuff>
+        void setData(TBuff& candidatesbuf)
+        {
+            nCandidates = alpaka::getPtrNative(candidatesbuf.nCandidates_buf);
+            nMemoryLocations = alpaka::getPtrNative(candidatesbuf.nMemoryLocations_buf);
+            tripletIndices = alpaka::getPtrNative(candidatesbuf.tripletIndices_buf);
+            innerRadius = alpaka::getPtrNative(candidatesbuf.innerRadius_buf);
+            bridgeRadius = alpaka::getPtrNative(candidatesbuf.bridgeRadius_buf);
+            outerRadius = alpaka::getPtrNative(candidatesbuf.outerRadius_buf);
+            regressionG = alpaka::getPtrNative(candidatesbuf.regressionG_buf);
+            regressionF = alpaka::getPtrNative(candidatesbuf.regressionF_buf);
+            regressionRadius = alpaka::getPtrNative(candidatesbuf.regressionRadius_buf);
+            rzChiSquared = alpaka::getPtrNative(candidatesbuf.rzChiSquared_buf);
+            chiSquared = alpaka::getPtrNative(candidatesbuf.chiSquared_buf);
+            nonAnchorChiSquared = alpaka::getPtrNative(candidatesbuf.nonAnchorChiSquared_buf);
+            TightCutFlag = alpaka::getPtrNative(candidatesbuf.TightCutFlag_buf);
+            inputs = alpaka::getPtrNative(candidatesbuf.inputs_buf);
+        }
+    };
+
+    template<typename TAcc>
+    struct t5DNNCandidatesBuffer : t5DNNCandidates
+    {
+        Buf<TAcc, unsigned int> nCandidates_buf;
+        Buf<TAcc, unsigned int> nMemoryLocations_buf;
+        Buf<TAcc, unsigned int> tripletIndices_buf;
+        Buf<TAcc, float> innerRadius_buf;
+        Buf<TAcc, float> bridgeRadius_buf;
+        Buf<TAcc, float> outerRadius_buf;
+        Buf<TAcc, float> regressionG_buf;
+        Buf<TAcc, float> regressionF_buf;
+        Buf<TAcc, float> regressionRadius_buf;
+        Buf<TAcc, float> rzChiSquared_buf;
+        Buf<TAcc, float> chiSquared_buf;
+        Buf<TAcc, float> nonAnchorChiSquared_buf;
+        Buf<TAcc, bool> TightCutFlag_buf;
+        Buf<TAcc, float> inputs_buf;
+
+        template<typename TQueue, typename TDevAcc>
+        t5DNNCandidatesBuffer(unsigned int nMaxCandidates,
+                              TDevAcc const & devAccIn,
+                              TQueue& queue) :
+            nCandidates_buf(allocBufWrapper<unsigned int>(devAccIn, 1, queue)),
+            nMemoryLocations_buf(allocBufWrapper<unsigned int>(devAccIn, 1, queue)),
+            tripletIndices_buf(allocBufWrapper<unsigned int>(devAccIn, 2 * nMaxCandidates, queue)),
+            innerRadius_buf(allocBufWrapper<float>(devAccIn, nMaxCandidates, queue)),
+            bridgeRadius_buf(allocBufWrapper<float>(devAccIn, nMaxCandidates, queue)),
+            outerRadius_buf(allocBufWrapper<float>(devAccIn, nMaxCandidates, queue)),
+            regressionG_buf(allocBufWrapper<float>(devAccIn, nMaxCandidates, queue)),
+            regressionF_buf(allocBufWrapper<float>(devAccIn, nMaxCandidates, queue)),
+            regressionRadius_buf(allocBufWrapper<float>(devAccIn, nMaxCandidates, queue)),
+            rzChiSquared_buf(allocBufWrapper<float>(devAccIn, nMaxCandidates, queue)),
+            chiSquared_buf(allocBufWrapper<float>(devAccIn, nMaxCandidates, queue)),
+            nonAnchorChiSquared_buf(allocBufWrapper<float>(devAccIn, nMaxCandidates, queue)),
+            TightCutFlag_buf(allocBufWrapper<bool>(devAccIn, nMaxCandidates, queue)),
+            inputs_buf(allocBufWrapper<float>(devAccIn, T5DNN::nInputFeatures * nMaxCandidates, queue))
+        {
+            alpaka::memset(queue, nCandidates_buf, 0, 1);
+            alpaka::wait(queue);
+        }
+    };
+
     ALPAKA_FN_ACC ALPAKA_FN_INLINE bool checkIntervalOverlap(const float& firstMin, const float& firstMax, const float& secondMin, const float& secondMax)
     {
         return ((firstMin <= secondMin) && (secondMin < firstMax)) || ((secondMin < firstMin) && (firstMin < secondMax));
     };
 
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void addT5DNNCandidateToMemory(struct SDL::t5DNNCandidates& candidatesInGPU, unsigned int innerTripletIndex, unsigned int outerTripletIndex, float innerRadius, float bridgeRadius, float outerRadius, float regressionG, float regressionF, float regressionRadius, float rzChiSquared, float chiSquared, float nonAnchorChiSquared, bool TightCutFlag, const float* inputs, unsigned int candidateIndex)
+    {
+        candidatesInGPU.tripletIndices[2 * candidateIndex] = innerTripletIndex;
+        candidatesInGPU.tripletIndices[2 * candidateIndex + 1] = outerTripletIndex;
+        candidatesInGPU.innerRadius[candidateIndex] = innerRadius;
+        candidatesInGPU.bridgeRadius[candidateIndex] = bridgeRadius;
+        candidatesInGPU.outerRadius[candidateIndex] = outerRadius;
+        candidatesInGPU.regressionG[candidateIndex] = regressionG;
+        candidatesInGPU.regressionF[candidateIndex] = regressionF;
+        candidatesInGPU.regressionRadius[candidateIndex] = regressionRadius;
+        candidatesInGPU.rzChiSquared[candidateIndex] = rzChiSquared;
+        candidatesInGPU.chiSquared[candidateIndex] = chiSquared;
+        candidatesInGPU.nonAnchorChiSquared[candidateIndex] = nonAnchorChiSquared;
+        candidatesInGPU.TightCutFlag[candidateIndex] = TightCutFlag;
+        for(unsigned int i = 0; i < T5DNN::nInputFeatures; i++)
+        {
+            candidatesInGPU.inputs[T5DNN::nInputFeatures * candidateIndex + i] = inputs[i];
+        }
+    };
+
     ALPAKA_FN_ACC ALPAKA_FN_INLINE void addQuintupletToMemory(struct SDL::triplets& tripletsInGPU, struct SDL::quintuplets& quintupletsInGPU, unsigned int innerTripletIndex, unsigned int outerTripletIndex, uint16_t& lowerModule1, uint16_t& lowerModule2, uint16_t& lowerModule3, uint16_t& lowerModule4, uint16_t& lowerModule5, float& innerRadius, float& bridgeRadius, float& outerRadius, float& regressionG, float& regressionF, float& regressionRadius, float& rzChiSquared, float& rPhiChiSquared, float& nonAnchorChiSquared, float pt, float eta, float phi, float scores, uint8_t layer, unsigned int quintupletIndex, bool TightCutFlag)
     {
         quintupletsInGPU.tripletIndices[2 * quintupletIndex] = innerTripletIndex;
@@ -165,6 +284,7 @@ namespace SDL
         quintupletsInGPU.score_rphisum[quintupletIndex] = __F2H(scores);
         quintupletsInGPU.layer[quintupletIndex] = layer;
         quintupletsInGPU.isDup[quintupletIndex] = false;
+        quintupletsInGPU.dupCompetitor[quintupletIndex] = noDupCompetitor;
         quintupletsInGPU.TightCutFlag[quintupletIndex] = TightCutFlag;
         quintupletsInGPU.regressionRadius[quintupletIndex] = regressionRadius;
         quintupletsInGPU.regressionG[quintupletIndex] = regressionG;
@@ -185,6 +305,7 @@ namespace SDL
         quintupletsInGPU.hitIndices[10 * quintupletIndex + 7] = tripletsInGPU.hitIndices[6 * outerTripletIndex + 3];
         quintupletsInGPU.hitIndices[10 * quintupletIndex + 8] = tripletsInGPU.hitIndices[6 * outerTripletIndex + 4];
         quintupletsInGPU.hitIndices[10 * quintupletIndex + 9] = tripletsInGPU.hitIndices[6 * outerTripletIndex + 5];
+        quintupletsInGPU.hitMask[quintupletIndex] = fillHitSignature<10>(&quintupletsInGPU.hitIndices[10 * quintupletIndex], &quintupletsInGPU.sortedHitIndices[10 * quintupletIndex]);
         quintupletsInGPU.bridgeRadius[quintupletIndex] = bridgeRadius;
         quintupletsInGPU.rzChiSquared[quintupletIndex] = rzChiSquared;
         quintupletsInGPU.chiSquared[quintupletIndex] = rPhiChiSquared;
@@ -1965,7 +2086,7 @@ namespace SDL
     };
 
     template<typename TAcc>
-    ALPAKA_FN_ACC ALPAKA_FN_INLINE bool runQuintupletDefaultAlgo(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::segments& segmentsInGPU, struct SDL::triplets& tripletsInGPU, uint16_t& lowerModuleIndex1, uint16_t& lowerModuleIndex2, uint16_t& lowerModuleIndex3, uint16_t& lowerModuleIndex4, uint16_t& lowerModuleIndex5, unsigned int& innerTripletIndex, unsigned int& outerTripletIndex, float& innerRadius, float& outerRadius, float& bridgeRadius, float& regressionG, float& regressionF, float& regressionRadius, float& rzChiSquared, float& chiSquared, float& nonAnchorChiSquared, bool& TightCutFlag)
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE bool runQuintupletDefaultAlgo(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::segments& segmentsInGPU, struct SDL::triplets& tripletsInGPU, uint16_t& lowerModuleIndex1, uint16_t& lowerModuleIndex2, uint16_t& lowerModuleIndex3, uint16_t& lowerModuleIndex4, uint16_t& lowerModuleIndex5, unsigned int& innerTripletIndex, unsigned int& outerTripletIndex, float& innerRadius, float& outerRadius, float& bridgeRadius, float& regressionG, float& regressionF, float& regressionRadius, float& rzChiSquared, float& chiSquared, float& nonAnchorChiSquared, bool& TightCutFlag, float* dnnInputs, const T5DNN::weights* dnnWeights)
     {
         bool pass = true;
         unsigned int firstSegmentIndex = tripletsInGPU.segmentIndices[2 * innerTripletIndex];
@@ -2149,16 +2270,24 @@ namespace SDL
 
 #ifdef USE_T5_DNN
         unsigned int mdIndices[] = {firstMDIndex, secondMDIndex, thirdMDIndex, fourthMDIndex, fifthMDIndex};
-        float inference = T5DNN::runInference(
-            acc, modulesInGPU, mdsInGPU, 
-            segmentsInGPU, tripletsInGPU, 
-            xVec, yVec, mdIndices, lowerModuleIndices, 
-            innerTripletIndex, outerTripletIndex, 
-            innerRadius, outerRadius, bridgeRadius
-        );
-        pass = pass and (inference > T5DNN::LSTWP2);                    // T5-building cut
-        TightCutFlag = TightCutFlag and (inference > T5DNN::LSTWP2);    // T5-in-TC cut
-        if(not pass) return pass;
+        if constexpr (deferredT5DNN)
+        {
+            // Only the inputs are computed here, the DNN cut is applied by runT5DNNInGPU
+            T5DNN::fillInputs(acc, modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, xVec, yVec, mdIndices, lowerModuleIndices, innerTripletIndex, outerTripletIndex, innerRadius, outerRadius, bridgeRadius, dnnInputs);
+        }
+        else
+        {
+            float inference = T5DNN::runInference(
+                acc, modulesInGPU, mdsInGPU, 
+                segmentsInGPU, tripletsInGPU, 
+                xVec, yVec, mdIndices, lowerModuleIndices, 
+                innerTripletIndex, outerTripletIndex, 
+                innerRadius, outerRadius, bridgeRadius, *dnnWeights
+            );
+            pass = pass and (inference > dnnWeights->lstWP2);                    // T5-building cut
+            TightCutFlag = TightCutFlag and (inference > dnnWeights->lstWP2);    // T5-in-TC cut
+            if(not pass) return pass;
+        }
 #endif
 
 #ifdef USE_RPHICHI2
@@ -2181,6 +2310,51 @@ namespace SDL
         return pass;
     };
 
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void storeQuintupletInGPU(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::segments& segmentsInGPU, struct SDL::triplets& tripletsInGPU, struct SDL::quintuplets& quintupletsInGPU, struct SDL::objectRanges& rangesInGPU, unsigned int innerTripletIndex, unsigned int outerTripletIndex, float innerRadius, float bridgeRadius, float outerRadius, float regressionG, float regressionF, float regressionRadius, float rzChiSquared, float chiSquared, float nonAnchorChiSquared, bool TightCutFlag, bool pass)
+    {
+        uint16_t lowerModule1 = tripletsInGPU.lowerModuleIndices[3 * innerTripletIndex];
+        uint16_t lowerModule2 = tripletsInGPU.lowerModuleIndices[3 * innerTripletIndex + 1];
+        uint16_t lowerModule3 = tripletsInGPU.lowerModuleIndices[3 * innerTripletIndex + 2];
+        uint16_t lowerModule4 = tripletsInGPU.lowerModuleIndices[3 * outerTripletIndex + 1];
+        uint16_t lowerModule5 = tripletsInGPU.lowerModuleIndices[3 * outerTripletIndex + 2];
+        int layer = modulesInGPU.layers[lowerModule1];
+        // get upper segment to be in second layer for layer 1, lower segment for layer 2
+        short layer2_adjustment = (layer == 1) ? 1 : 0;
+
+        // Called with pass unset too, so that the slot reservation is done by all threads at the same point
+        int totOccupancyQuintuplets = atomicIncrementAggregated(acc, quintupletsInGPU.totOccupancyQuintuplets, lowerModule1, pass);
+        if(not pass) return;
+        if(totOccupancyQuintuplets >= rangesInGPU.quintupletModuleOccupancy[lowerModule1])
+        {
+#ifdef Warnings
+            printf("Quintuplet excess alert! Module index = %d\n", lowerModule1);
+#endif
+        }
+        else
+        {
+            //this if statement should never get executed!
+            if(rangesInGPU.quintupletModuleIndices[lowerModule1] == -1)
+            {
+#ifdef Warnings
+                printf("Quintuplets : no memory for module at module index = %d\n", lowerModule1);
+#endif
+            }
+            else
+            {
+                unsigned int quintupletIndex = rangesInGPU.quintupletModuleIndices[lowerModule1] + totOccupancyQuintuplets;
+                float phi = mdsInGPU.anchorPhi[segmentsInGPU.mdIndices[2*tripletsInGPU.segmentIndices[2*innerTripletIndex+layer2_adjustment]]];
+                float eta = mdsInGPU.anchorEta[segmentsInGPU.mdIndices[2*tripletsInGPU.segmentIndices[2*innerTripletIndex+layer2_adjustment]]];
+                float pt = (innerRadius+outerRadius)*3.8f*1.602f/(2*100*5.39f);
+                float scores = chiSquared + nonAnchorChiSquared;
+                addQuintupletToMemory(tripletsInGPU, quintupletsInGPU, innerTripletIndex, outerTripletIndex, lowerModule1, lowerModule2, lowerModule3, lowerModule4, lowerModule5, innerRadius, bridgeRadius, outerRadius, regressionG, regressionF, regressionRadius, rzChiSquared, chiSquared, nonAnchorChiSquared, pt,eta,phi,scores,layer,quintupletIndex, TightCutFlag);
+
+                tripletsInGPU.partOfT5[quintupletsInGPU.tripletIndices[2 * quintupletIndex]] = true;
+                tripletsInGPU.partOfT5[quintupletsInGPU.tripletIndices[2 * quintupletIndex + 1]] = true;
+            }
+        }
+    };
+
     struct createQuintupletsInGPUv2
     {
         template<typename TAcc>
@@ -2192,7 +2366,8 @@ namespace SDL
                 struct SDL::triplets tripletsInGPU,
                 struct SDL::quintuplets quintupletsInGPU,
                 struct SDL::objectRanges rangesInGPU,
-                uint16_t nEligibleT5Modules) const
+                struct SDL::t5DNNCandidates t5DNNCandidatesInGPU,
+                const T5DNN::weights* dnnWeights) const
         {
             using Dim = alpaka::Dim<TAcc>;
             using Idx = alpaka::Idx<TAcc>;
@@ -2201,73 +2376,60 @@ namespace SDL
             Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
             Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
 
-            for (int iter = globalThreadIdx[0]; iter < nEligibleT5Modules; iter += gridThreadExtent[0])
+            // Each chunk holds up to activeChunkSize(QuintupletStage) inner triplets of a module
+            for (unsigned int chunk = globalThreadIdx[0]; chunk < rangesInGPU.nActiveChunks[SDL::QuintupletStage]; chunk += gridThreadExtent[0])
             {
-                uint16_t lowerModule1 = rangesInGPU.indicesOfEligibleT5Modules[iter];
-                short layer2_adjustment;
-                int layer = modulesInGPU.layers[lowerModule1];
-                if(layer == 1)
-                {
-                    layer2_adjustment = 1;
-                } // get upper segment to be in second layer
-                else if(layer == 2)
-                {
-                    layer2_adjustment = 0;
-                } // get lower segment to be in second layer
-                else
-                {
-                    continue;
-                }
+                unsigned int firstInnerTriplet;
+                uint16_t lowerModule1 = activeChunkModule(rangesInGPU, SDL::QuintupletStage, *modulesInGPU.nLowerModules, chunk, firstInnerTriplet);
                 unsigned int nInnerTriplets = tripletsInGPU.nTriplets[lowerModule1];
-                for( unsigned int innerTripletArrayIndex = globalThreadIdx[1]; innerTripletArrayIndex < nInnerTriplets; innerTripletArrayIndex += gridThreadExtent[1])
+                unsigned int lastInnerTriplet = alpaka::math::min(acc, firstInnerTriplet + SDL::activeChunkSize(SDL::QuintupletStage), nInnerTriplets);
+                for( unsigned int innerTripletArrayIndex = firstInnerTriplet + globalThreadIdx[1]; innerTripletArrayIndex < lastInnerTriplet; innerTripletArrayIndex += gridThreadExtent[1])
                 {
                     unsigned int innerTripletIndex = rangesInGPU.tripletModuleIndices[lowerModule1] + innerTripletArrayIndex;
                     uint16_t lowerModule2 = tripletsInGPU.lowerModuleIndices[3 * innerTripletIndex + 1];
                     uint16_t lowerModule3 = tripletsInGPU.lowerModuleIndices[3 * innerTripletIndex + 2];
-                    unsigned int nOuterTriplets = tripletsInGPU.nTriplets[lowerModule3];
-                    for (int outerTripletArrayIndex = globalThreadIdx[2]; outerTripletArrayIndex < nOuterTriplets; outerTripletArrayIndex += gridThreadExtent[2])
+                    // The outer triplet has to start at the outer MD of the inner triplet, so only the triplets of the
+                    // segments starting at that MD are tried
+                    unsigned int sharedMDIndex = segmentsInGPU.mdIndices[2 * tripletsInGPU.segmentIndices[2 * innerTripletIndex + 1] + 1];
+                    unsigned int nOuterSegments = mdsInGPU.nOutgoingSegments[sharedMDIndex];
+                    unsigned int outgoingSegmentOffset = mdsInGPU.outgoingSegmentOffsets[sharedMDIndex];
+                    for (int outerSegmentArrayIndex = globalThreadIdx[2]; outerSegmentArrayIndex < nOuterSegments; outerSegmentArrayIndex += gridThreadExtent[2])
                     {
-                        unsigned int outerTripletIndex = rangesInGPU.tripletModuleIndices[lowerModule3] + outerTripletArrayIndex;
-                        uint16_t lowerModule4 = tripletsInGPU.lowerModuleIndices[3 * outerTripletIndex + 1];
-                        uint16_t lowerModule5 = tripletsInGPU.lowerModuleIndices[3 * outerTripletIndex + 2];
+                        unsigned int outerSegmentIndex = segmentsInGPU.outgoingSegmentIndices[outgoingSegmentOffset + outerSegmentArrayIndex];
+                        unsigned int nOuterTriplets = segmentsInGPU.nOutgoingTriplets[outerSegmentIndex];
+                        unsigned int outgoingTripletOffset = segmentsInGPU.outgoingTripletOffsets[outerSegmentIndex];
+                        for (unsigned int outerTripletArrayIndex = 0; outerTripletArrayIndex < nOuterTriplets; outerTripletArrayIndex++)
+                        {
+                            unsigned int outerTripletIndex = tripletsInGPU.outgoingTripletIndices[outgoingTripletOffset + outerTripletArrayIndex];
+                            uint16_t lowerModule4 = tripletsInGPU.lowerModuleIndices[3 * outerTripletIndex + 1];
+                            uint16_t lowerModule5 = tripletsInGPU.lowerModuleIndices[3 * outerTripletIndex + 2];
 
-                        float innerRadius, outerRadius, bridgeRadius, regressionG, regressionF, regressionRadius, rzChiSquared, chiSquared, nonAnchorChiSquared; //required for making distributions
+                            float innerRadius, outerRadius, bridgeRadius, regressionG, regressionF, regressionRadius, rzChiSquared, chiSquared, nonAnchorChiSquared; //required for making distributions
 
-                        bool TightCutFlag;
-                        bool success = runQuintupletDefaultAlgo(acc, modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, lowerModule1, lowerModule2, lowerModule3, lowerModule4, lowerModule5, innerTripletIndex, outerTripletIndex, innerRadius, outerRadius,  bridgeRadius, regressionG, regressionF, regressionRadius, rzChiSquared, chiSquared, nonAnchorChiSquared, TightCutFlag);
+                            bool TightCutFlag;
+                            float dnnInputs[deferredT5DNN ? T5DNN::nInputFeatures : 1];
+                            bool success = runQuintupletDefaultAlgo(acc, modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, lowerModule1, lowerModule2, lowerModule3, lowerModule4, lowerModule5, innerTripletIndex, outerTripletIndex, innerRadius, outerRadius,  bridgeRadius, regressionG, regressionF, regressionRadius, rzChiSquared, chiSquared, nonAnchorChiSquared, TightCutFlag, dnnInputs, dnnWeights);
 
-                        if(success)
-                        {
-                            int totOccupancyQuintuplets = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &quintupletsInGPU.totOccupancyQuintuplets[lowerModule1], 1);
-                            if(totOccupancyQuintuplets >= rangesInGPU.quintupletModuleOccupancy[lowerModule1])
+                            if constexpr (deferredT5DNN)
                             {
-#ifdef Warnings
-                                printf("Quintuplet excess alert! Module index = %d\n", lowerModule1);
-#endif
-                            }
-                            else
-                            {
-                                int quintupletModuleIndex = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &quintupletsInGPU.nQuintuplets[lowerModule1], 1);
-                                //this if statement should never get executed!
-                                if(rangesInGPU.quintupletModuleIndices[lowerModule1] == -1)
+                                if(success)
                                 {
-#ifdef Warnings
-                                    printf("Quintuplets : no memory for module at module index = %d\n", lowerModule1);
-#endif
-                                }
-                                else
-                                {
-                                    unsigned int quintupletIndex = rangesInGPU.quintupletModuleIndices[lowerModule1] +  quintupletModuleIndex;
-                                    float phi = mdsInGPU.anchorPhi[segmentsInGPU.mdIndices[2*tripletsInGPU.segmentIndices[2*innerTripletIndex+layer2_adjustment]]];
-                                    float eta = mdsInGPU.anchorEta[segmentsInGPU.mdIndices[2*tripletsInGPU.segmentIndices[2*innerTripletIndex+layer2_adjustment]]];
-                                    float pt = (innerRadius+outerRadius)*3.8f*1.602f/(2*100*5.39f);
-                                    float scores = chiSquared + nonAnchorChiSquared;
-                                    addQuintupletToMemory(tripletsInGPU, quintupletsInGPU, innerTripletIndex, outerTripletIndex, lowerModule1, lowerModule2, lowerModule3, lowerModule4, lowerModule5, innerRadius, bridgeRadius, outerRadius, regressionG, regressionF, regressionRadius, rzChiSquared, chiSquared, nonAnchorChiSquared, pt,eta,phi,scores,layer,quintupletIndex, TightCutFlag);
-
-                                    tripletsInGPU.partOfT5[quintupletsInGPU.tripletIndices[2 * quintupletIndex]] = true;
-                                    tripletsInGPU.partOfT5[quintupletsInGPU.tripletIndices[2 * quintupletIndex + 1]] = true;
+                                    // Staged for runT5DNNInGPU, or evaluated right away once the staging buffer is full
+                                    unsigned int candidateIndex = alpaka::atomicOp<alpaka::AtomicAdd>(acc, t5DNNCandidatesInGPU.nCandidates, 1u);
+                                    if(candidateIndex < *t5DNNCandidatesInGPU.nMemoryLocations)
+                                    {
+                                        addT5DNNCandidateToMemory(t5DNNCandidatesInGPU, innerTripletIndex, outerTripletIndex, innerRadius, bridgeRadius, outerRadius, regressionG, regressionF, regressionRadius, rzChiSquared, chiSquared, nonAnchorChiSquared, TightCutFlag, dnnInputs, candidateIndex);
+                                        success = false;
+                                    }
+                                    else
+                                    {
+                                        float inference = T5DNN::evaluate(acc, dnnInputs, *dnnWeights);
+                                        success = (inference > dnnWeights->lstWP2);
+                                    }
                                 }
                             }
+
+                            storeQuintupletInGPU(acc, modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, quintupletsInGPU, rangesInGPU, innerTripletIndex, outerTripletIndex, innerRadius, bridgeRadius, outerRadius, regressionG, regressionF, regressionRadius, rzChiSquared, chiSquared, nonAnchorChiSquared, TightCutFlag, success);
                         }
                     }
                 }
@@ -2275,6 +2437,64 @@ namespace SDL
         }
     };
 
+    // TLayers is T5DNN::denseLayers or T5DNN::quantisedLayers, the part of the weights read by the active path.
+    template<typename TLayers>
+    struct runT5DNNInGPU
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::modules modulesInGPU,
+                struct SDL::miniDoublets mdsInGPU,
+                struct SDL::segments segmentsInGPU,
+                struct SDL::triplets tripletsInGPU,
+                struct SDL::quintuplets quintupletsInGPU,
+                struct SDL::objectRanges rangesInGPU,
+                struct SDL::t5DNNCandidates t5DNNCandidatesInGPU,
+                const T5DNN::weights* dnnWeights) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const blockThreadIdx = alpaka::getIdx<alpaka::Block, alpaka::Threads>(acc);
+            Vec const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
+
+            // The layers are loaded once per block and shared by all the candidates of the block.
+            const TLayers* layers;
+            if constexpr (std::is_same_v<TLayers, T5DNN::quantisedLayers>)
+                layers = &dnnWeights->quantisedDense;
+            else
+                layers = &dnnWeights->dense;
+            auto& sharedLayers = alpaka::declareSharedVar<TLayers, __COUNTER__>(acc);
+            static_assert(sizeof(TLayers) % sizeof(uint32_t) == 0, "The T5 DNN layers are copied as 32-bit words");
+            const uint32_t* layerWords = reinterpret_cast<const uint32_t*>(layers);
+            uint32_t* sharedLayerWords = reinterpret_cast<uint32_t*>(&sharedLayers);
+            for(unsigned int i = blockThreadIdx[2]; i < sizeof(TLayers) / sizeof(uint32_t); i += blockThreadExtent[2])
+            {
+                sharedLayerWords[i] = layerWords[i];
+            }
+            alpaka::syncBlockThreads(acc);
+
+            unsigned int nCandidates = alpaka::math::min(acc, *t5DNNCandidatesInGPU.nCandidates, *t5DNNCandidatesInGPU.nMemoryLocations);
+            for(unsigned int candidateIndex = globalThreadIdx[2]; candidateIndex < nCandidates; candidateIndex += gridThreadExtent[2])
+            {
+                float inference = T5DNN::evaluate(acc, &t5DNNCandidatesInGPU.inputs[T5DNN::nInputFeatures * candidateIndex], sharedLayers);
+                // T5-building cut, a passing candidate also passes the T5-in-TC cut
+                bool pass = (inference > dnnWeights->lstWP2);
+
+                storeQuintupletInGPU(acc, modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, quintupletsInGPU, rangesInGPU,
+                                     t5DNNCandidatesInGPU.tripletIndices[2 * candidateIndex], t5DNNCandidatesInGPU.tripletIndices[2 * candidateIndex + 1],
+                                     t5DNNCandidatesInGPU.innerRadius[candidateIndex], t5DNNCandidatesInGPU.bridgeRadius[candidateIndex], t5DNNCandidatesInGPU.outerRadius[candidateIndex],
+                                     t5DNNCandidatesInGPU.regressionG[candidateIndex], t5DNNCandidatesInGPU.regressionF[candidateIndex], t5DNNCandidatesInGPU.regressionRadius[candidateIndex],
+                                     t5DNNCandidatesInGPU.rzChiSquared[candidateIndex], t5DNNCandidatesInGPU.chiSquared[candidateIndex], t5DNNCandidatesInGPU.nonAnchorChiSquared[candidateIndex],
+                                     t5DNNCandidatesInGPU.TightCutFlag[candidateIndex], pass);
+            }
+        }
+    };
+
     struct createEligibleModulesListForQuintupletsGPU
     {
         template<typename TAcc>
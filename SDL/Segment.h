@@ -45,6 +45,9 @@ namespace SDL
         float* circleCenterX;
         float* circleCenterY;
         float* circleRadius;
+        unsigned int* outgoingSegmentIndices; //segments grouped by inner MD, see buildOutgoingSegmentIndex
+        unsigned int* nOutgoingTriplets; //triplets starting at each segment, see buildOutgoingTripletIndex
+        unsigned int* outgoingTripletOffsets;
 
         template<typename TBuff>
         void setData(TBuff& segmentsbuf)
@@ -83,6 +86,9 @@ namespace SDL
             circleCenterX = alpaka::getPtrNative(segmentsbuf.circleCenterX_buf);
             circleCenterY = alpaka::getPtrNative(segmentsbuf.circleCenterY_buf);
             circleRadius = alpaka::getPtrNative(segmentsbuf.circleRadius_buf);
+            outgoingSegmentIndices = alpaka::getPtrNative(segmentsbuf.outgoingSegmentIndices_buf);
+            nOutgoingTriplets = alpaka::getPtrNative(segmentsbuf.nOutgoingTriplets_buf);
+            outgoingTripletOffsets = alpaka::getPtrNative(segmentsbuf.outgoingTripletOffsets_buf);
         }
     };
 
@@ -123,6 +129,9 @@ namespace SDL
         Buf<TAcc, float> circleCenterX_buf;
         Buf<TAcc, float> circleCenterY_buf;
         Buf<TAcc, float> circleRadius_buf;
+        Buf<TAcc, unsigned int> outgoingSegmentIndices_buf;
+        Buf<TAcc, unsigned int> nOutgoingTriplets_buf;
+        Buf<TAcc, unsigned int> outgoingTripletOffsets_buf;
 
         template<typename TQueue, typename TDevAcc>
         segmentsBuffer(unsigned int nMemoryLocationsIn,
@@ -163,7 +172,10 @@ namespace SDL
             score_buf(allocBufWrapper<float>(devAccIn, maxPixelSegments, queue)),
             circleCenterX_buf(allocBufWrapper<float>(devAccIn, maxPixelSegments, queue)),
             circleCenterY_buf(allocBufWrapper<float>(devAccIn, maxPixelSegments, queue)),
-            circleRadius_buf(allocBufWrapper<float>(devAccIn, maxPixelSegments, queue))
+            circleRadius_buf(allocBufWrapper<float>(devAccIn, maxPixelSegments, queue)),
+            outgoingSegmentIndices_buf(allocBufWrapper<unsigned int>(devAccIn, nMemoryLocationsIn, queue)),
+            nOutgoingTriplets_buf(allocBufWrapper<unsigned int>(devAccIn, nMemoryLocationsIn, queue)),
+            outgoingTripletOffsets_buf(allocBufWrapper<unsigned int>(devAccIn, nMemoryLocationsIn, queue))
         {
             alpaka::memset(queue, nSegments_buf, 0u, nLowerModules + 1);
             alpaka::memset(queue, totOccupancySegments_buf, 0u, nLowerModules + 1);
@@ -308,7 +320,7 @@ namespace SDL
         }
         else
         {
-            sdLumForInnerMini = mdsInGPU.dphis[innerMDIndex] * 15.0f / mdsInGPU.dzs[innerMDIndex];
+            sdLumForInnerMini = __H2F(mdsInGPU.dphis[innerMDIndex]) * 15.0f / mdsInGPU.dzs[innerMDIndex];
         }
 
         if (modulesInGPU.subdets[outerLowerModuleIndex] == SDL::Barrel)
@@ -317,7 +329,7 @@ namespace SDL
         }
         else
         {
-            sdLumForOuterMini = mdsInGPU.dphis[outerMDIndex] * 15.0f / mdsInGPU.dzs[outerMDIndex];
+            sdLumForOuterMini = __H2F(mdsInGPU.dphis[outerMDIndex]) * 15.0f / mdsInGPU.dzs[outerMDIndex];
         }
 
         // Unique stuff for the segment dudes alone
@@ -414,6 +426,23 @@ namespace SDL
         segmentsInGPU.circleRadius[pixelSegmentArrayIndex] = circleRadius;
     };
 
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE float segmentBarrelZGeom(struct SDL::modules& modulesInGPU, uint16_t& innerLowerModuleIndex)
+    {
+        return modulesInGPU.layers[innerLowerModuleIndex] <= 2 ? 2.f * pixelPSZpitch : 2.f * strip2SZpitch;
+    };
+
+    // Window of the outer anchor z in the barrel segment algorithm, returns the slope the later cuts are based on.
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE float segmentBarrelZWindow(TAcc const & acc, float zIn, float rtIn, float rtOut, float zGeom, float& zLo, float& zHi)
+    {
+        float sdSlope = alpaka::math::asin(acc, alpaka::math::min(acc, rtOut * k2Rinv1GeVf / ptCut, sinAlphaMax));
+        float dzDrtScale = alpaka::math::tan(acc, sdSlope)/sdSlope; //FIXME: need appropriate value
+
+        zLo = zIn + (zIn - deltaZLum) * (rtOut / rtIn - 1.f) * (zIn > 0.f ? 1.f : dzDrtScale) - zGeom; //slope-correction only on outer end
+        zHi = zIn + (zIn + deltaZLum) * (rtOut / rtIn - 1.f) * (zIn < 0.f ? 1.f : dzDrtScale) + zGeom;
+        return sdSlope;
+    };
+
     template<typename TAcc>
     ALPAKA_FN_ACC ALPAKA_FN_INLINE bool runSegmentDefaultAlgoBarrel(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, uint16_t& innerLowerModuleIndex, uint16_t& outerLowerModuleIndex, unsigned int& innerMDIndex, unsigned int& outerMDIndex, float& zIn, float& zOut, float& rtIn, float& rtOut, float& dPhi, float& dPhiMin, float& dPhiMax, float& dPhiChange, float& dPhiChangeMin, float& dPhiChangeMax, float& dAlphaInnerMDSegment, float& dAlphaOuterMDSegment, float&dAlphaInnerMDOuterMD, float& zLo, float& zHi, float& sdCut, float& dAlphaInnerMDSegmentThreshold, float& dAlphaOuterMDSegmentThreshold, float& dAlphaInnerMDOuterMDThreshold)
     {
@@ -433,14 +462,10 @@ namespace SDL
         zOut = mdsInGPU.anchorZ[outerMDIndex];
         rtOut = mdsInGPU.anchorRt[outerMDIndex];
 
-        float sdSlope = alpaka::math::asin(acc, alpaka::math::min(acc, rtOut * k2Rinv1GeVf / ptCut, sinAlphaMax));
         float sdPVoff = 0.1f/rtOut;
-        float dzDrtScale = alpaka::math::tan(acc, sdSlope)/sdSlope; //FIXME: need appropriate value
 
-        const float zGeom = modulesInGPU.layers[innerLowerModuleIndex] <= 2 ? 2.f * pixelPSZpitch : 2.f * strip2SZpitch;
-
-        zLo = zIn + (zIn - deltaZLum) * (rtOut / rtIn - 1.f) * (zIn > 0.f ? 1.f : dzDrtScale) - zGeom; //slope-correction only on outer end
-        zHi = zIn + (zIn + deltaZLum) * (rtOut / rtIn - 1.f) * (zIn < 0.f ? 1.f : dzDrtScale) + zGeom;
+        const float zGeom = segmentBarrelZGeom(modulesInGPU, innerLowerModuleIndex);
+        float sdSlope = segmentBarrelZWindow(acc, zIn, rtIn, rtOut, zGeom, zLo, zHi);
 
         pass =  pass and ((zOut >= zLo) && (zOut <= zHi));
         if(not pass) return pass;
@@ -460,8 +485,8 @@ namespace SDL
         float dAlphaThresholdValues[3];
         dAlphaThreshold(acc, dAlphaThresholdValues, modulesInGPU, mdsInGPU, xIn, yIn, zIn, rtIn, xOut, yOut, zOut, rtOut, innerLowerModuleIndex, outerLowerModuleIndex, innerMDIndex, outerMDIndex);
 
-        float innerMDAlpha = mdsInGPU.dphichanges[innerMDIndex];
-        float outerMDAlpha = mdsInGPU.dphichanges[outerMDIndex];
+        float innerMDAlpha = __H2F(mdsInGPU.dphichanges[innerMDIndex]);
+        float outerMDAlpha = __H2F(mdsInGPU.dphichanges[outerMDIndex]);
         dAlphaInnerMDSegment = innerMDAlpha - dPhiChange;
         dAlphaOuterMDSegment = outerMDAlpha - dPhiChange;
         dAlphaInnerMDOuterMD = innerMDAlpha - outerMDAlpha;
@@ -557,8 +582,8 @@ namespace SDL
         dAlphaOuterMDSegmentThreshold = dAlphaThresholdValues[1];
         dAlphaInnerMDOuterMDThreshold = dAlphaThresholdValues[2];
 
-        float innerMDAlpha = mdsInGPU.dphichanges[innerMDIndex];
-        float outerMDAlpha = mdsInGPU.dphichanges[outerMDIndex];
+        float innerMDAlpha = __H2F(mdsInGPU.dphichanges[innerMDIndex]);
+        float outerMDAlpha = __H2F(mdsInGPU.dphichanges[outerMDIndex]);
         dAlphaInnerMDSegment = innerMDAlpha - dPhiChange;
         dAlphaOuterMDSegment = outerMDAlpha - dPhiChange;
         dAlphaInnerMDOuterMD = innerMDAlpha - outerMDAlpha;
@@ -590,6 +615,96 @@ namespace SDL
         }
     };
 
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void createSegmentFromMDs(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::segments& segmentsInGPU, struct SDL::objectRanges& rangesInGPU, uint16_t& innerLowerModuleIndex, uint16_t& outerLowerModuleIndex, unsigned int innerMDIndex, unsigned int outerMDIndex)
+    {
+        float zIn, zOut, rtIn, rtOut, dPhi, dPhiMin, dPhiMax, dPhiChange, dPhiChangeMin, dPhiChangeMax, dAlphaInnerMDSegment, dAlphaOuterMDSegment, dAlphaInnerMDOuterMD;
+
+        unsigned int innerMiniDoubletAnchorHitIndex = mdsInGPU.anchorHitIndices[innerMDIndex];
+        unsigned int outerMiniDoubletAnchorHitIndex = mdsInGPU.anchorHitIndices[outerMDIndex];
+        dPhiMin = 0;
+        dPhiMax = 0;
+        dPhiChangeMin = 0;
+        dPhiChangeMax = 0;
+        float zLo, zHi, rtLo, rtHi, sdCut , dAlphaInnerMDSegmentThreshold, dAlphaOuterMDSegmentThreshold, dAlphaInnerMDOuterMDThreshold;
+        bool pass = runSegmentDefaultAlgo(acc, modulesInGPU, mdsInGPU, innerLowerModuleIndex, outerLowerModuleIndex, innerMDIndex, outerMDIndex, zIn, zOut, rtIn, rtOut, dPhi, dPhiMin, dPhiMax, dPhiChange, dPhiChangeMin, dPhiChangeMax, dAlphaInnerMDSegment, dAlphaOuterMDSegment, dAlphaInnerMDOuterMD, zLo, zHi, rtLo, rtHi, sdCut, dAlphaInnerMDSegmentThreshold, dAlphaOuterMDSegmentThreshold, dAlphaInnerMDOuterMDThreshold);
+
+        int totOccupancySegments = atomicIncrementAggregated(acc, segmentsInGPU.totOccupancySegments, innerLowerModuleIndex, pass);
+        if(pass)
+        {
+            if(totOccupancySegments >= (rangesInGPU.segmentModuleOccupancy[innerLowerModuleIndex]))
+            {
+#ifdef Warnings
+                printf("Segment excess alert! Module index = %d\n",innerLowerModuleIndex);
+#endif
+            }
+            else
+            {
+                unsigned int segmentIdx = rangesInGPU.segmentModuleIndices[innerLowerModuleIndex] + totOccupancySegments;
+
+                addSegmentToMemory(segmentsInGPU,innerMDIndex, outerMDIndex,innerLowerModuleIndex, outerLowerModuleIndex, innerMiniDoubletAnchorHitIndex, outerMiniDoubletAnchorHitIndex, dPhi, dPhiMin, dPhiMax, dPhiChange, dPhiChangeMin, dPhiChangeMax, segmentIdx);
+            }
+        }
+    };
+
+    // Tries an inner MD with nOuterMDs consecutive MDs of the outer module, at most candidateBatchSize.
+    // The first cut of the algorithm, the z window in the barrel and the z compatibility in the endcap, is evaluated
+    // over the whole batch first and only the pairs passing it run the full algorithm, which repeats it.
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void createSegmentsFromMDBatch(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::segments& segmentsInGPU, struct SDL::objectRanges& rangesInGPU, uint16_t& innerLowerModuleIndex, uint16_t& outerLowerModuleIndex, unsigned int innerMDIndex, unsigned int firstOuterMDIndex, unsigned int nOuterMDs)
+    {
+        float zIn = mdsInGPU.anchorZ[innerMDIndex];
+        float rtIn = mdsInGPU.anchorRt[innerMDIndex];
+        bool pass[candidateBatchSize];
+        if(modulesInGPU.subdets[innerLowerModuleIndex] == SDL::Barrel and modulesInGPU.subdets[outerLowerModuleIndex] == SDL::Barrel)
+        {
+            const float zGeom = segmentBarrelZGeom(modulesInGPU, innerLowerModuleIndex);
+            for(unsigned int i = 0; i < nOuterMDs; i++)
+            {
+                float zOut = mdsInGPU.anchorZ[firstOuterMDIndex + i];
+                float zLo, zHi;
+                segmentBarrelZWindow(acc, zIn, rtIn, mdsInGPU.anchorRt[firstOuterMDIndex + i], zGeom, zLo, zHi);
+                pass[i] = (zOut >= zLo) & (zOut <= zHi);
+            }
+        }
+        else
+        {
+            for(unsigned int i = 0; i < nOuterMDs; i++)
+            {
+                pass[i] = (zIn * mdsInGPU.anchorZ[firstOuterMDIndex + i] >= 0);
+            }
+        }
+
+        for(unsigned int i = 0; i < nOuterMDs; i++)
+        {
+            if(pass[i])
+            {
+                createSegmentFromMDs(acc, modulesInGPU, mdsInGPU, segmentsInGPU, rangesInGPU, innerLowerModuleIndex, outerLowerModuleIndex, innerMDIndex, firstOuterMDIndex + i);
+            }
+        }
+    };
+
+#ifdef PHI_SORTED_MDS
+    // Largest |dPhi| between the anchors of an inner MD and an outer MD that can pass the segment cuts.
+    // Both the barrel and the endcap cut |dPhi| against sdCut, which only depends on the outer anchor rt, so the
+    // anchor rt extent of the outer module bounds it for every inner MD.
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE float segmentPhiWindow(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, uint16_t& innerLowerModuleIndex, uint16_t& outerLowerModuleIndex)
+    {
+        float rtOutMin = mdsInGPU.anchorRtMins[outerLowerModuleIndex];
+        float rtOutMax = mdsInGPU.anchorRtMaxs[outerLowerModuleIndex];
+        float window = alpaka::math::asin(acc, alpaka::math::min(acc, rtOutMax * k2Rinv1GeVf / ptCut, sinAlphaMax));
+        if(modulesInGPU.subdets[innerLowerModuleIndex] == SDL::Barrel and modulesInGPU.subdets[outerLowerModuleIndex] == SDL::Barrel)
+        {
+            float sdMuls = miniMulsPtScaleBarrel[modulesInGPU.layers[innerLowerModuleIndex]-1] * 3.f/ptCut;
+            float sdPVoff = 0.1f/rtOutMin;
+            window += alpaka::math::sqrt(acc, sdMuls * sdMuls + sdPVoff * sdPVoff);
+        }
+        // Small margin for the rounding of the phi difference.
+        return window + 1e-4f;
+    };
+#endif
+
     struct createSegmentsInGPUv2
     {
         template<typename TAcc>
@@ -609,61 +724,151 @@ namespace SDL
             Vec const gridBlockExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Blocks>(acc);
             Vec const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
 
-            for(uint16_t innerLowerModuleIndex = globalBlockIdx[2]; innerLowerModuleIndex < (*modulesInGPU.nLowerModules); innerLowerModuleIndex += gridBlockExtent[2])
+            // Each block takes chunks of up to activeChunkSize(SegmentStage) inner MDs of a module
+            for(unsigned int chunk = globalBlockIdx[2]; chunk < rangesInGPU.nActiveChunks[SDL::SegmentStage]; chunk += gridBlockExtent[2])
             {
+                unsigned int firstInnerMD;
+                uint16_t innerLowerModuleIndex = activeChunkModule(rangesInGPU, SDL::SegmentStage, *modulesInGPU.nLowerModules, chunk, firstInnerMD);
                 unsigned int nInnerMDs = mdsInGPU.nMDs[innerLowerModuleIndex];
-                if (nInnerMDs == 0) continue;
+                unsigned int lastInnerMD = alpaka::math::min(acc, firstInnerMD + SDL::activeChunkSize(SDL::SegmentStage), nInnerMDs);
 
                 unsigned int nConnectedModules = modulesInGPU.nConnectedModules[innerLowerModuleIndex];
+                unsigned int moduleMapOffset = modulesInGPU.moduleMapOffsets[innerLowerModuleIndex];
 
                 for(uint16_t outerLowerModuleArrayIdx = blockThreadIdx[1]; outerLowerModuleArrayIdx< nConnectedModules; outerLowerModuleArrayIdx+= blockThreadExtent[1])
                 {
-                    uint16_t outerLowerModuleIndex = modulesInGPU.moduleMap[innerLowerModuleIndex * MAX_CONNECTED_MODULES + outerLowerModuleArrayIdx];
+                    uint16_t outerLowerModuleIndex = modulesInGPU.moduleMap[moduleMapOffset + outerLowerModuleArrayIdx];
 
                     unsigned int nOuterMDs = mdsInGPU.nMDs[outerLowerModuleIndex];
 
                     int limit = nInnerMDs*nOuterMDs;
 
                     if (limit == 0) continue;
-                    for(int hitIndex = blockThreadIdx[2]; hitIndex < limit; hitIndex += blockThreadExtent[2])
+#ifdef PHI_SORTED_MDS
+                    // Only the outer MDs inside the dPhi window of each inner MD are tried, taken from the phi
+                    // ordered view of the outer module. The window can wrap around +-pi.
+                    unsigned int outerFirst = rangesInGPU.mdRanges[outerLowerModuleIndex * 2];
+                    unsigned int outerEnd = outerFirst + nOuterMDs;
+                    float window = segmentPhiWindow(acc, modulesInGPU, mdsInGPU, innerLowerModuleIndex, outerLowerModuleIndex);
+                    for(unsigned int innerMDArrayIdx = firstInnerMD + blockThreadIdx[2]; innerMDArrayIdx < lastInnerMD; innerMDArrayIdx += blockThreadExtent[2])
                     {
-                        int innerMDArrayIdx = hitIndex / nOuterMDs;
-                        int outerMDArrayIdx = hitIndex % nOuterMDs;
-                        if(outerMDArrayIdx >= nOuterMDs) continue;
-
                         unsigned int innerMDIndex = rangesInGPU.mdRanges[innerLowerModuleIndex * 2] + innerMDArrayIdx;
-                        unsigned int outerMDIndex = rangesInGPU.mdRanges[outerLowerModuleIndex * 2] + outerMDArrayIdx;
-
-                        float zIn, zOut, rtIn, rtOut, dPhi, dPhiMin, dPhiMax, dPhiChange, dPhiChangeMin, dPhiChangeMax, dAlphaInnerMDSegment, dAlphaOuterMDSegment, dAlphaInnerMDOuterMD;
-
-                        unsigned int innerMiniDoubletAnchorHitIndex = mdsInGPU.anchorHitIndices[innerMDIndex];
-                        unsigned int outerMiniDoubletAnchorHitIndex = mdsInGPU.anchorHitIndices[outerMDIndex];
-                        dPhiMin = 0;
-                        dPhiMax = 0;
-                        dPhiChangeMin = 0;
-                        dPhiChangeMax = 0;
-                        float zLo, zHi, rtLo, rtHi, sdCut , dAlphaInnerMDSegmentThreshold, dAlphaOuterMDSegmentThreshold, dAlphaInnerMDOuterMDThreshold;
-                        bool pass = runSegmentDefaultAlgo(acc, modulesInGPU, mdsInGPU, innerLowerModuleIndex, outerLowerModuleIndex, innerMDIndex, outerMDIndex, zIn, zOut, rtIn, rtOut, dPhi, dPhiMin, dPhiMax, dPhiChange, dPhiChangeMin, dPhiChangeMax, dAlphaInnerMDSegment, dAlphaOuterMDSegment, dAlphaInnerMDOuterMD, zLo, zHi, rtLo, rtHi, sdCut, dAlphaInnerMDSegmentThreshold, dAlphaOuterMDSegmentThreshold, dAlphaInnerMDOuterMDThreshold);
+                        float phiIn = mdsInGPU.anchorPhi[innerMDIndex];
 
-                        if(pass)
+                        unsigned int first[2] = {outerFirst, outerEnd};
+                        unsigned int last[2] = {outerEnd, outerEnd};
+                        if(window < float(M_PI))
                         {
-                            unsigned int totOccupancySegments = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &segmentsInGPU.totOccupancySegments[innerLowerModuleIndex], 1);
-                            if(totOccupancySegments >= (rangesInGPU.segmentModuleOccupancy[innerLowerModuleIndex]))
+                            float phiLow = phiIn - window;
+                            float phiHigh = phiIn + window;
+                            if(phiLow < -float(M_PI))
                             {
-#ifdef Warnings
-                                printf("Segment excess alert! Module index = %d\n",innerLowerModuleIndex);
-#endif
+                                last[0] = phiLowerBound(mdsInGPU.phiSortedAnchorPhis, outerFirst, nOuterMDs, phiHigh);
+                                first[1] = phiLowerBound(mdsInGPU.phiSortedAnchorPhis, outerFirst, nOuterMDs, phiLow + 2.f * float(M_PI));
+                            }
+                            else if(phiHigh > float(M_PI))
+                            {
+                                last[0] = phiLowerBound(mdsInGPU.phiSortedAnchorPhis, outerFirst, nOuterMDs, phiHigh - 2.f * float(M_PI));
+                                first[1] = phiLowerBound(mdsInGPU.phiSortedAnchorPhis, outerFirst, nOuterMDs, phiLow);
                             }
                             else
                             {
-                                unsigned int segmentModuleIdx = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &segmentsInGPU.nSegments[innerLowerModuleIndex], 1);
-                                unsigned int segmentIdx = rangesInGPU.segmentModuleIndices[innerLowerModuleIndex] + segmentModuleIdx;
+                                first[0] = phiLowerBound(mdsInGPU.phiSortedAnchorPhis, outerFirst, nOuterMDs, phiLow);
+                                last[0] = phiLowerBound(mdsInGPU.phiSortedAnchorPhis, outerFirst, nOuterMDs, phiHigh);
+                            }
+                        }
 
-                                addSegmentToMemory(segmentsInGPU,innerMDIndex, outerMDIndex,innerLowerModuleIndex, outerLowerModuleIndex, innerMiniDoubletAnchorHitIndex, outerMiniDoubletAnchorHitIndex, dPhi, dPhiMin, dPhiMax, dPhiChange, dPhiChangeMin, dPhiChangeMax, segmentIdx);
+                        for(int range = 0; range < 2; range++)
+                        {
+                            for(unsigned int sortedIdx = first[range]; sortedIdx < last[range]; sortedIdx++)
+                            {
+                                createSegmentFromMDs(acc, modulesInGPU, mdsInGPU, segmentsInGPU, rangesInGPU, innerLowerModuleIndex, outerLowerModuleIndex, innerMDIndex, mdsInGPU.phiSortedIndices[sortedIdx]);
                             }
                         }
                     }
+#else
+                    // Each inner MD is paired with batches of up to nElements consecutive outer MDs
+                    unsigned int const nElements = candidateBatch(acc);
+                    unsigned int nOuterBatches = (nOuterMDs + nElements - 1) / nElements;
+                    for(unsigned int batchIndex = firstInnerMD*nOuterBatches + blockThreadIdx[2]; batchIndex < lastInnerMD*nOuterBatches; batchIndex += blockThreadExtent[2])
+                    {
+                        unsigned int innerMDArrayIdx = batchIndex / nOuterBatches;
+                        unsigned int firstOuterMDArrayIdx = (batchIndex % nOuterBatches) * nElements;
+
+                        unsigned int innerMDIndex = rangesInGPU.mdRanges[innerLowerModuleIndex * 2] + innerMDArrayIdx;
+                        unsigned int firstOuterMDIndex = rangesInGPU.mdRanges[outerLowerModuleIndex * 2] + firstOuterMDArrayIdx;
+                        unsigned int nBatchMDs = alpaka::math::min(acc, nElements, nOuterMDs - firstOuterMDArrayIdx);
+
+                        createSegmentsFromMDBatch(acc, modulesInGPU, mdsInGPU, segmentsInGPU, rangesInGPU, innerLowerModuleIndex, outerLowerModuleIndex, innerMDIndex, firstOuterMDIndex, nBatchMDs);
+                    }
+#endif
+                }
+            }
+        }
+    };
+
+    // Index from each mini-doublet to the segments that start at it, in CSR form: the segments of MD m are
+    // outgoingSegmentIndices[outgoingSegmentOffsets[m] .. outgoingSegmentOffsets[m] + nOutgoingSegments[m]).
+    // Segments start at an MD of their inner module, so each block builds the index of one module at a time
+    // within the segment range of that module.
+    struct buildOutgoingSegmentIndex
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::modules modulesInGPU,
+                struct SDL::miniDoublets mdsInGPU,
+                struct SDL::segments segmentsInGPU,
+                struct SDL::objectRanges rangesInGPU) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalBlockIdx = alpaka::getIdx<alpaka::Grid, alpaka::Blocks>(acc);
+            Vec const blockThreadIdx = alpaka::getIdx<alpaka::Block, alpaka::Threads>(acc);
+            Vec const gridBlockExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Blocks>(acc);
+            Vec const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
+
+            for(uint16_t lowerModuleIndex = globalBlockIdx[2]; lowerModuleIndex < (*modulesInGPU.nLowerModules); lowerModuleIndex += gridBlockExtent[2])
+            {
+                unsigned int mdFirst = rangesInGPU.miniDoubletModuleIndices[lowerModuleIndex];
+                unsigned int nMDs = mdsInGPU.nMDs[lowerModuleIndex];
+                unsigned int segmentFirst = rangesInGPU.segmentModuleIndices[lowerModuleIndex];
+                unsigned int nSegments = segmentsInGPU.nSegments[lowerModuleIndex];
+
+                for(unsigned int mdIndex = mdFirst + blockThreadIdx[2]; mdIndex < mdFirst + nMDs; mdIndex += blockThreadExtent[2])
+                {
+                    mdsInGPU.nOutgoingSegments[mdIndex] = 0;
+                }
+                alpaka::syncBlockThreads(acc);
+
+                for(unsigned int segmentIndex = segmentFirst + blockThreadIdx[2]; segmentIndex < segmentFirst + nSegments; segmentIndex += blockThreadExtent[2])
+                {
+                    alpaka::atomicOp<alpaka::AtomicAdd>(acc, &mdsInGPU.nOutgoingSegments[segmentsInGPU.mdIndices[2 * segmentIndex]], 1u);
+                }
+                alpaka::syncBlockThreads(acc);
+
+                // The counts are cleared again so that they can serve as fill cursors.
+                if(blockThreadIdx[2] == 0)
+                {
+                    unsigned int offset = segmentFirst;
+                    for(unsigned int mdIndex = mdFirst; mdIndex < mdFirst + nMDs; mdIndex++)
+                    {
+                        mdsInGPU.outgoingSegmentOffsets[mdIndex] = offset;
+                        offset += mdsInGPU.nOutgoingSegments[mdIndex];
+                        mdsInGPU.nOutgoingSegments[mdIndex] = 0;
+                    }
+                }
+                alpaka::syncBlockThreads(acc);
+
+                for(unsigned int segmentIndex = segmentFirst + blockThreadIdx[2]; segmentIndex < segmentFirst + nSegments; segmentIndex += blockThreadExtent[2])
+                {
+                    unsigned int mdIndex = segmentsInGPU.mdIndices[2 * segmentIndex];
+                    unsigned int position = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &mdsInGPU.nOutgoingSegments[mdIndex], 1u);
+                    segmentsInGPU.outgoingSegmentIndices[mdsInGPU.outgoingSegmentOffsets[mdIndex] + position] = segmentIndex;
                 }
+                alpaka::syncBlockThreads(acc);
             }
         }
     };
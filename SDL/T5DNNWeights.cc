@@ -0,0 +1,294 @@
+#include "T5DNNWeights.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+SDL::T5DNNWeights* SDL::t5DNNWeights = nullptr;
+
+void SDL::createT5DNNWeights()
+{
+    if (SDL::t5DNNWeights == nullptr)
+    {
+        SDL::t5DNNWeights = new SDL::T5DNNWeights();
+    }
+}
+
+void SDL::freeT5DNNWeights()
+{
+    if (SDL::t5DNNWeights != nullptr)
+    {
+        delete SDL::t5DNNWeights;
+        SDL::t5DNNWeights = nullptr;
+    }
+}
+
+namespace
+{
+    uint32_t fnv1a(const char* data, size_t nBytes, uint32_t hash = 2166136261u)
+    {
+        for (size_t i = 0; i < nBytes; i++)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // The float weights and working points in file order
+    std::vector<std::pair<float*, size_t>> fileArrays(T5DNN::weights& w)
+    {
+        return {{&w.lstWP1, 1}, {&w.lstWP2, 1},
+                {w.dense.wgtT0, T5DNN::nInputFeatures * T5DNN::nHiddenFeatures}, {w.dense.b0, T5DNN::nHiddenFeatures},
+                {w.dense.wgtT2, T5DNN::nHiddenFeatures * T5DNN::nHiddenFeatures}, {w.dense.b2, T5DNN::nHiddenFeatures},
+                {w.dense.wgtT4, T5DNN::nHiddenFeatures}, {w.dense.b4, 1}};
+    }
+}
+
+SDL::T5DNNWeights::T5DNNWeights() :
+    weights_buf(allocBufWrapper<T5DNN::weights>(devAcc, 1)),
+    loaded(false),
+    weightsHost_buf(allocBufWrapper<T5DNN::weights>(devHost, 1))
+{
+}
+
+SDL::T5DNNWeights::~T5DNNWeights()
+{
+}
+
+void SDL::T5DNNWeights::loadBuiltin(bool quantised)
+{
+    QueueAcc queue(devAcc);
+
+    Vec const threadsPerBlock = createVec(1,1,256);
+    Vec const blocksPerGrid = createVec(1,1,1);
+    WorkDiv const fillBuiltinT5DNNWeights_workDiv = createWorkDiv(blocksPerGrid, threadsPerBlock, Vec::all(1));
+
+    SDL::fillBuiltinT5DNNWeights fillBuiltinT5DNNWeights_kernel;
+    auto const fillBuiltinT5DNNWeightsTask(alpaka::createTaskKernel<Acc>(
+        fillBuiltinT5DNNWeights_workDiv,
+        fillBuiltinT5DNNWeights_kernel,
+        alpaka::getPtrNative(weights_buf)));
+
+    alpaka::enqueue(queue, fillBuiltinT5DNNWeightsTask);
+    alpaka::memcpy(queue, weightsHost_buf, weights_buf, 1);
+    alpaka::wait(queue);
+
+    fillDevice(quantised);
+}
+
+void SDL::T5DNNWeights::load(std::string filename, bool quantised)
+{
+    std::ifstream ifile(filename, std::ios::binary);
+    if (not ifile.is_open())
+    {
+        throw std::runtime_error("T5 DNN weight file " + filename + " not present");
+    }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(ifile)), std::istreambuf_iterator<char>());
+
+    T5DNN::weights& w = *alpaka::getPtrNative(weightsHost_buf);
+    auto arrays = fileArrays(w);
+    size_t nFloats = 0;
+    for (auto& array : arrays)
+    {
+        nFloats += array.second;
+    }
+    const size_t nHeaderBytes = 4 * sizeof(uint32_t);
+    const size_t nBytes = nHeaderBytes + nFloats * sizeof(float) + sizeof(uint32_t);
+    if (bytes.size() < nHeaderBytes)
+    {
+        throw std::runtime_error("T5 DNN weight file " + filename + " is truncated");
+    }
+
+    uint32_t header[4];
+    std::memcpy(header, bytes.data(), nHeaderBytes);
+    if (header[0] != fileMagic)
+    {
+        throw std::runtime_error("T5 DNN weight file " + filename + " is not a weight file");
+    }
+    if (header[1] != fileVersion)
+    {
+        throw std::runtime_error("T5 DNN weight file " + filename + " has version " + std::to_string(header[1]) + ", expected " + std::to_string(fileVersion));
+    }
+    if (header[2] != T5DNN::nInputFeatures or header[3] != T5DNN::nHiddenFeatures)
+    {
+        throw std::runtime_error("T5 DNN weight file " + filename + " is for a " + std::to_string(header[2]) + "x" + std::to_string(header[3]) + " network, expected " + std::to_string(T5DNN::nInputFeatures) + "x" + std::to_string(T5DNN::nHiddenFeatures));
+    }
+    if (bytes.size() != nBytes)
+    {
+        throw std::runtime_error("T5 DNN weight file " + filename + " has " + std::to_string(bytes.size()) + " bytes, expected " + std::to_string(nBytes));
+    }
+    uint32_t hash;
+    std::memcpy(&hash, bytes.data() + nBytes - sizeof(uint32_t), sizeof(uint32_t));
+    if (hash != fnv1a(bytes.data(), nBytes - sizeof(uint32_t)))
+    {
+        throw std::runtime_error("T5 DNN weight file " + filename + " is corrupted (hash mismatch)");
+    }
+
+    size_t offset = nHeaderBytes;
+    for (auto& array : arrays)
+    {
+        std::memcpy(array.first, bytes.data() + offset, array.second * sizeof(float));
+        for (size_t i = 0; i < array.second; i++)
+        {
+            if (not std::isfinite(array.first[i]))
+            {
+                throw std::runtime_error("T5 DNN weight file " + filename + " contains non-finite values");
+            }
+        }
+        offset += array.second * sizeof(float);
+    }
+
+    fillDevice(quantised);
+}
+
+// Writes the float weights in use, e.g. to export the compiled-in network as a weight file.
+void SDL::T5DNNWeights::write(std::string filename)
+{
+    if (not loaded)
+    {
+        loadBuiltin();
+    }
+    T5DNN::weights& w = *alpaka::getPtrNative(weightsHost_buf);
+    std::vector<char> bytes(4 * sizeof(uint32_t));
+    uint32_t header[4] = {fileMagic, fileVersion, T5DNN::nInputFeatures, T5DNN::nHiddenFeatures};
+    std::memcpy(bytes.data(), header, sizeof(header));
+    for (auto& array : fileArrays(w))
+    {
+        const char* data = reinterpret_cast<const char*>(array.first);
+        bytes.insert(bytes.end(), data, data + array.second * sizeof(float));
+    }
+    uint32_t hash = fnv1a(bytes.data(), bytes.size());
+
+    std::ofstream ofile(filename, std::ios::binary);
+    ofile.write(bytes.data(), bytes.size());
+    ofile.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+    if (not ofile)
+    {
+        throw std::runtime_error("Could not write the T5 DNN weight file " + filename);
+    }
+}
+
+// Symmetric int8 quantisation of the weights of the three dense layers with one scale per output.
+void SDL::T5DNNWeights::quantise()
+{
+    T5DNN::weights& w = *alpaka::getPtrNative(weightsHost_buf);
+    auto quantiseLayer = [](const float* wgtT, unsigned int nIn, unsigned int nOut, float* scale, int8_t* qWgtT)
+    {
+        for (unsigned int col = 0; col < nOut; col++)
+        {
+            float maxAbs = 0.f;
+            for (unsigned int inner = 0; inner < nIn; inner++)
+            {
+                maxAbs = std::max(maxAbs, std::fabs(wgtT[inner * nOut + col]));
+            }
+            scale[col] = (maxAbs > 0.f) ? maxAbs / 127.f : 1.f;
+            for (unsigned int inner = 0; inner < nIn; inner++)
+            {
+                qWgtT[inner * nOut + col] = static_cast<int8_t>(std::lround(wgtT[inner * nOut + col] / scale[col]));
+            }
+        }
+    };
+    T5DNN::denseLayers& dense = w.dense;
+    T5DNN::quantisedLayers& quantised = w.quantisedDense;
+    quantiseLayer(dense.wgtT0, T5DNN::nInputFeatures, T5DNN::nHiddenFeatures, quantised.scale0, quantised.qWgtT0);
+    quantiseLayer(dense.wgtT2, T5DNN::nHiddenFeatures, T5DNN::nHiddenFeatures, quantised.scale2, quantised.qWgtT2);
+    quantiseLayer(dense.wgtT4, T5DNN::nHiddenFeatures, 1, quantised.scale4, quantised.qWgtT4);
+    std::copy(std::begin(dense.b0), std::end(dense.b0), quantised.b0);
+    std::copy(std::begin(dense.b2), std::end(dense.b2), quantised.b2);
+    std::copy(std::begin(dense.b4), std::end(dense.b4), quantised.b4);
+}
+
+// Compares the DNN output with the int8 and the float weights on synthetic T5s from prompt tracks
+// crossing five consecutive barrel layers. This only checks the quantisation itself, the physics
+// performance of the quantised network still has to be checked on the usual validation samples.
+bool SDL::T5DNNWeights::validateQuantised()
+{
+    T5DNN::weights& w = *alpaka::getPtrNative(weightsHost_buf);
+    auto sigmoid = [](float logit) { return std::exp(logit) / (std::exp(logit) + 1); };
+    const float k2Rinv1GeV = (2.99792458e-3 * 3.8) / 2; // as SDL::k2Rinv1GeVf
+    const float layerRadii[6] = {21.8f, 34.6f, 50.8f, 68.6f, 88.5f, 108.3f};
+    std::mt19937 generator(12345);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+    float maxDifference = 0.f;
+    double sumDifference = 0.;
+    unsigned int nChanged = 0;
+    float x[T5DNN::nInputFeatures];
+    for (unsigned int n = 0; n < nValidationInputs; n++)
+    {
+        float eta = -1.f + 2.f * uniform(generator);
+        float phi = float(M_PI) * (2.f * uniform(generator) - 1.f);
+        float pt = 0.8f * std::pow(50.f / 0.8f, uniform(generator));
+        float charge = (uniform(generator) < 0.5f) ? 1.f : -1.f;
+        unsigned int firstLayer = (uniform(generator) < 0.5f) ? 1 : 2;
+        float radius = pt / (2 * k2Rinv1GeV);
+
+        float hits[5][5]; // eta, phi, z, r, layer
+        for (unsigned int i = 0; i < 5; i++)
+        {
+            float r = layerRadii[firstLayer - 1 + i];
+            hits[i][0] = eta;
+            hits[i][1] = phi + charge * std::asin(r / (2 * radius));
+            hits[i][2] = r * std::sinh(eta);
+            hits[i][3] = r;
+            hits[i][4] = float(firstLayer + i);
+        }
+        // Same order as T5DNN::fillInputs
+        unsigned int k = 0;
+        x[k++] = std::log10(2 * k2Rinv1GeV * radius);
+        for (unsigned int i : {0, 1, 2})
+            for (unsigned int j = 0; j < 5; j++)
+                x[k++] = hits[i][j];
+        x[k++] = std::log10(2 * k2Rinv1GeV * radius);
+        for (unsigned int i : {2, 3, 4})
+            for (unsigned int j = 0; j < 5; j++)
+                x[k++] = hits[i][j];
+        x[k++] = std::log10(2 * radius * 3.8112f * 1.602f / (2 * 100 * 5.39f));
+        x[k++] = hits[1][0];
+        x[k++] = hits[1][1];
+        x[k++] = std::log10(radius);
+        x[k++] = std::log10(radius);
+        x[k++] = std::log10(radius);
+
+        float reference = sigmoid(T5DNN::floatLogit(x, w.dense));
+        float quantised = sigmoid(T5DNN::quantisedLogit(x, w.quantisedDense));
+        float difference = std::fabs(quantised - reference);
+        maxDifference = std::max(maxDifference, difference);
+        sumDifference += difference;
+        if ((reference > w.lstWP2) != (quantised > w.lstWP2))
+            nChanged++;
+    }
+    std::cout << "T5 DNN int8 weights: output difference " << sumDifference / nValidationInputs << " on average, "
+              << maxDifference << " at most, " << nChanged << "/" << nValidationInputs << " LSTWP2 decisions changed" << std::endl;
+    return maxDifference <= maxQuantisationError and nChanged <= maxChangedDecisions * nValidationInputs;
+}
+
+void SDL::T5DNNWeights::fillDevice(bool quantised)
+{
+    T5DNN::weights& w = *alpaka::getPtrNative(weightsHost_buf);
+    quantise();
+    w.quantised = 0;
+    if (quantised)
+    {
+        if (validateQuantised())
+        {
+            w.quantised = 1;
+        }
+        else
+        {
+            std::cout << "WARNING: T5 DNN int8 weights failed the validation, using the float weights" << std::endl;
+        }
+    }
+
+    QueueAcc queue(devAcc);
+    alpaka::memcpy(queue, weights_buf, weightsHost_buf, 1);
+    alpaka::wait(queue);
+    loaded = true;
+}
@@ -0,0 +1,100 @@
+#ifndef T5DNNWeights_h
+#define T5DNNWeights_h
+
+#include <string>
+
+#include "Constants.h"
+#include "NeuralNetwork.h"
+
+namespace SDL
+{
+    // Device copy of the T5 DNN weights and working points, taken from NeuralNetworkWeights.h
+    // or read at loadMaps time from a binary weight file, so that a retrained network needs no rebuild.
+    //
+    // Weight file format, little endian:
+    //   uint32 magic 0x4e443554 ("T5DN"), uint32 version (1),
+    //   uint32 nInputFeatures (38), uint32 nHiddenFeatures (32),
+    //   float LSTWP1, float LSTWP2,
+    //   float wgtT0[nInputFeatures][nHiddenFeatures], float b0[nHiddenFeatures],
+    //   float wgtT2[nHiddenFeatures][nHiddenFeatures], float b2[nHiddenFeatures],
+    //   float wgtT4[nHiddenFeatures], float b4,
+    //   uint32 FNV-1a hash of all the preceding bytes.
+    class T5DNNWeights
+    {
+        public:
+            static constexpr uint32_t fileMagic = 0x4e443554;
+            static constexpr uint32_t fileVersion = 1;
+            // Largest change of the DNN output, and fraction of changed LSTWP2 decisions,
+            // allowed for the int8 weights on the validation inputs
+            static constexpr float maxQuantisationError = 0.05f;
+            static constexpr float maxChangedDecisions = 0.001f;
+            static constexpr unsigned int nValidationInputs = 10000;
+
+            Buf<Acc, T5DNN::weights> weights_buf;
+            bool loaded;
+
+            T5DNNWeights();
+            ~T5DNNWeights();
+
+            // The int8 weights are used if quantised is set and they pass the validation against the float weights.
+            void loadBuiltin(bool quantised = false);
+            void load(std::string filename, bool quantised = false);
+            void write(std::string filename);
+
+            const T5DNN::weights* getWeights() { return alpaka::getPtrNative(weights_buf); }
+            // Whether the kernels read the int8 layers, from the host copy of the weights
+            bool isQuantised() { return alpaka::getPtrNative(weightsHost_buf)->quantised; }
+
+        private:
+            Buf<alpaka::DevCpu, T5DNN::weights> weightsHost_buf;
+
+            void quantise();
+            bool validateQuantised();
+            void fillDevice(bool quantised);
+    };
+
+    // Copies the weights compiled into NeuralNetworkWeights.h, which live in device memory, into the weight set.
+    struct fillBuiltinT5DNNWeights
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(TAcc const & acc, T5DNN::weights* dnnWeights) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+            Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+
+            constexpr unsigned int nIn = T5DNN::nInputFeatures;
+            constexpr unsigned int nHidden = T5DNN::nHiddenFeatures;
+            for(unsigned int i = globalThreadIdx[2]; i < nIn * nHidden; i += gridThreadExtent[2])
+            {
+                dnnWeights->dense.wgtT0[i] = T5DNN::wgtT_0[i / nHidden][i % nHidden];
+            }
+            for(unsigned int i = globalThreadIdx[2]; i < nHidden * nHidden; i += gridThreadExtent[2])
+            {
+                dnnWeights->dense.wgtT2[i] = T5DNN::wgtT_2[i / nHidden][i % nHidden];
+            }
+            for(unsigned int i = globalThreadIdx[2]; i < nHidden; i += gridThreadExtent[2])
+            {
+                dnnWeights->dense.b0[i] = T5DNN::bias_0[i];
+                dnnWeights->dense.b2[i] = T5DNN::bias_2[i];
+                dnnWeights->dense.wgtT4[i] = T5DNN::wgtT_4[i][0];
+            }
+            if(globalThreadIdx[2] == 0)
+            {
+                dnnWeights->dense.b4[0] = T5DNN::bias_4[0];
+                dnnWeights->lstWP1 = T5DNN::LSTWP1;
+                dnnWeights->lstWP2 = T5DNN::LSTWP2;
+            }
+        }
+    };
+
+    // The device buffers are allocated at the first call, not at static initialisation.
+    void createT5DNNWeights();
+    void freeT5DNNWeights();
+    extern T5DNNWeights* t5DNNWeights;
+}
+
+#endif
@@ -12,6 +12,16 @@
 
 namespace SDL
 {
+#ifdef HIT_OWNERSHIP_TC
+    constexpr bool hitOwnershipTC = true;
+#else
+    constexpr bool hitOwnershipTC = false;
+#endif
+
+    // Fraction of its hits a candidate has to own to be kept in the hit ownership selection.
+    // A pLS sharing one of its four hits is rejected, as in crossCleanpLS.
+    constexpr float minOwnedHitFraction = 0.8f;
+
     struct trackCandidates
     {
         short* trackCandidateType; // 4-T5 5-pT3 7-pT5 8-pLS
@@ -388,6 +398,190 @@ namespace SDL
         }
     };
 
+    // Hit ownership selection, used instead of the cross cleaning chain with HIT_OWNERSHIP_TC.
+    // Every candidate claims its hits with an atomic max of its key, and is kept if it owns enough of them.
+    // The key orders the candidates by type, as the cross cleaning does (pT5 > pT3 > T5 > pLS),
+    // then by score (lower is better) and index.
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE unsigned long long hitOwnershipKey(unsigned int typeRank, float score, unsigned int index)
+    {
+        return (static_cast<unsigned long long>(typeRank) << 62) | (static_cast<unsigned long long>(~orderedScoreBits(score)) << 30) | static_cast<unsigned long long>(index & 0x3FFFFFFFu);
+    };
+
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void claimHits(TAcc const & acc, unsigned long long* hitOwners, const unsigned int* hits, unsigned int nHits, unsigned long long key)
+    {
+        for (unsigned int i = 0; i < nHits; i++)
+        {
+            alpaka::atomicOp<alpaka::AtomicMax>(acc, &hitOwners[hits[i]], key);
+        }
+    };
+
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE bool ownsEnoughHits(const unsigned long long* hitOwners, const unsigned int* hits, unsigned int nHits, unsigned long long key)
+    {
+        unsigned int nOwned = 0;
+        for (unsigned int i = 0; i < nHits; i++)
+        {
+            if (hitOwners[hits[i]] == key)
+                nOwned++;
+        }
+        return nOwned >= minOwnedHitFraction * nHits;
+    };
+
+    // Slots of hits in the hit ownership array. The hits are compared by ntuple index, so that the pseudo-hits of
+    // pLSs built on the same pixel hits share their slots. The pixel hits come after the outer tracker hits.
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void fillHitOwnerSlots(struct SDL::hits& hitsInGPU, const unsigned int* hits, unsigned int nHits, uint16_t pixelModuleIndex, unsigned int outerHitIdxRange, unsigned int* slots)
+    {
+        for (unsigned int i = 0; i < nHits; i++)
+        {
+            unsigned int hit = hits[i];
+            slots[i] = hitsInGPU.idxs[hit] + ((hitsInGPU.moduleIndices[hit] == pixelModuleIndex) ? outerHitIdxRange : 0);
+        }
+    };
+
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void fillpLSHitOwnerSlots(unsigned int pixelArrayIndex, struct SDL::segments& segmentsInGPU, unsigned int outerHitIdxRange, unsigned int* slots)
+    {
+        const uint4& hits = segmentsInGPU.pLSHitsIdxs[pixelArrayIndex];
+        slots[0] = outerHitIdxRange + hits.x;
+        slots[1] = outerHitIdxRange + hits.y;
+        slots[2] = outerHitIdxRange + hits.z;
+        slots[3] = outerHitIdxRange + hits.w;
+    };
+
+    // Runs the claim (select = false) or the selection (select = true) step over all candidates.
+    // pT5s are already track candidates and only claim their hits. The pLSs claim only pixel hits and
+    // the T5s only outer tracker hits, so pLS-T5 duplicates are left to crossCleanpLS.
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE void resolveHitOwnership(
+            TAcc const & acc,
+            bool select,
+            struct SDL::modules& modulesInGPU,
+            struct SDL::objectRanges& rangesInGPU,
+            struct SDL::pixelQuintuplets& pixelQuintupletsInGPU,
+            struct SDL::pixelTriplets& pixelTripletsInGPU,
+            struct SDL::quintuplets& quintupletsInGPU,
+            struct SDL::segments& segmentsInGPU,
+            struct SDL::hits& hitsInGPU,
+            unsigned int outerHitIdxRange,
+            unsigned long long* hitOwners)
+    {
+        using Dim = alpaka::Dim<TAcc>;
+        using Idx = alpaka::Idx<TAcc>;
+        using Vec = alpaka::Vec<Dim, Idx>;
+
+        Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
+        Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+
+        // The pixel objects are spread over the last two dimensions
+        unsigned int flatThreadIdx = globalThreadIdx[1] * gridThreadExtent[2] + globalThreadIdx[2];
+        unsigned int flatThreadExtent = gridThreadExtent[1] * gridThreadExtent[2];
+
+        uint16_t pixelModuleIndex = *modulesInGPU.nLowerModules;
+        unsigned int slots[14];
+
+        if (not select)
+        {
+            unsigned int nPixelQuintuplets = *pixelQuintupletsInGPU.nPixelQuintuplets;
+            for (unsigned int pixelQuintupletIndex = flatThreadIdx; pixelQuintupletIndex < nPixelQuintuplets; pixelQuintupletIndex += flatThreadExtent)
+            {
+                if (pixelQuintupletsInGPU.isDup[pixelQuintupletIndex])
+                    continue;
+
+                unsigned long long key = hitOwnershipKey(3, __H2F(pixelQuintupletsInGPU.score[pixelQuintupletIndex]), pixelQuintupletIndex);
+                fillHitOwnerSlots(hitsInGPU, &pixelQuintupletsInGPU.hitIndices[14 * pixelQuintupletIndex], 14, pixelModuleIndex, outerHitIdxRange, slots);
+                claimHits(acc, hitOwners, slots, 14, key);
+            }
+        }
+
+        unsigned int nPixelTriplets = *pixelTripletsInGPU.nPixelTriplets;
+        for (unsigned int pixelTripletIndex = flatThreadIdx; pixelTripletIndex < nPixelTriplets; pixelTripletIndex += flatThreadExtent)
+        {
+            if (pixelTripletsInGPU.isDup[pixelTripletIndex])
+                continue;
+
+            unsigned long long key = hitOwnershipKey(2, __H2F(pixelTripletsInGPU.score[pixelTripletIndex]), pixelTripletIndex);
+            fillHitOwnerSlots(hitsInGPU, &pixelTripletsInGPU.hitIndices[10 * pixelTripletIndex], 10, pixelModuleIndex, outerHitIdxRange, slots);
+            if (not select)
+                claimHits(acc, hitOwners, slots, 10, key);
+            else if (not ownsEnoughHits(hitOwners, slots, 10, key))
+                pixelTripletsInGPU.isDup[pixelTripletIndex] = true;
+        }
+
+        unsigned int nPixels = segmentsInGPU.nSegments[pixelModuleIndex];
+        for (unsigned int pixelArrayIndex = flatThreadIdx; pixelArrayIndex < nPixels; pixelArrayIndex += flatThreadExtent)
+        {
+            if (!segmentsInGPU.isQuad[pixelArrayIndex] || segmentsInGPU.isDup[pixelArrayIndex])
+                continue;
+
+            fillpLSHitOwnerSlots(pixelArrayIndex, segmentsInGPU, outerHitIdxRange, slots);
+            unsigned long long key = hitOwnershipKey(0, segmentsInGPU.score[pixelArrayIndex], pixelArrayIndex);
+            if (not select)
+                claimHits(acc, hitOwners, slots, 4, key);
+            else if (not ownsEnoughHits(hitOwners, slots, 4, key))
+                segmentsInGPU.isDup[pixelArrayIndex] = true;
+        }
+
+        for (int lowerModuleIndex = globalThreadIdx[1]; lowerModuleIndex < *modulesInGPU.nLowerModules; lowerModuleIndex += gridThreadExtent[1])
+        {
+            if (rangesInGPU.quintupletModuleIndices[lowerModuleIndex] == -1)
+                continue;
+
+            unsigned int nQuints = quintupletsInGPU.nQuintuplets[lowerModuleIndex];
+            for (unsigned int jdx = globalThreadIdx[2]; jdx < nQuints; jdx += gridThreadExtent[2])
+            {
+                unsigned int quintupletIndex = rangesInGPU.quintupletModuleIndices[lowerModuleIndex] + jdx;
+                if (quintupletsInGPU.isDup[quintupletIndex] or quintupletsInGPU.partOfPT5[quintupletIndex])
+                    continue;
+                if (!(quintupletsInGPU.TightCutFlag[quintupletIndex]))
+                    continue;
+
+                unsigned long long key = hitOwnershipKey(1, __H2F(quintupletsInGPU.score_rphisum[quintupletIndex]), quintupletIndex);
+                fillHitOwnerSlots(hitsInGPU, &quintupletsInGPU.hitIndices[10 * quintupletIndex], 10, pixelModuleIndex, outerHitIdxRange, slots);
+                if (not select)
+                    claimHits(acc, hitOwners, slots, 10, key);
+                else if (not ownsEnoughHits(hitOwners, slots, 10, key))
+                    quintupletsInGPU.isDup[quintupletIndex] = true;
+            }
+        }
+    };
+
+    struct claimHitsInGPU
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::modules modulesInGPU,
+                struct SDL::objectRanges rangesInGPU,
+                struct SDL::pixelQuintuplets pixelQuintupletsInGPU,
+                struct SDL::pixelTriplets pixelTripletsInGPU,
+                struct SDL::quintuplets quintupletsInGPU,
+                struct SDL::segments segmentsInGPU,
+                struct SDL::hits hitsInGPU,
+                unsigned int outerHitIdxRange,
+                unsigned long long* hitOwners) const
+        {
+            resolveHitOwnership(acc, false, modulesInGPU, rangesInGPU, pixelQuintupletsInGPU, pixelTripletsInGPU, quintupletsInGPU, segmentsInGPU, hitsInGPU, outerHitIdxRange, hitOwners);
+        }
+    };
+
+    struct selectTrackCandidatesByHitOwnershipInGPU
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::modules modulesInGPU,
+                struct SDL::objectRanges rangesInGPU,
+                struct SDL::pixelQuintuplets pixelQuintupletsInGPU,
+                struct SDL::pixelTriplets pixelTripletsInGPU,
+                struct SDL::quintuplets quintupletsInGPU,
+                struct SDL::segments segmentsInGPU,
+                struct SDL::hits hitsInGPU,
+                unsigned int outerHitIdxRange,
+                unsigned long long* hitOwners) const
+        {
+            resolveHitOwnership(acc, true, modulesInGPU, rangesInGPU, pixelQuintupletsInGPU, pixelTripletsInGPU, quintupletsInGPU, segmentsInGPU, hitsInGPU, outerHitIdxRange, hitOwners);
+        }
+    };
+
     struct addpT3asTrackCandidatesInGPU
     {
         template<typename TAcc>
@@ -25,6 +25,7 @@ namespace SDL
         bool* partOfPT5;
         bool* partOfT5;
         bool* partOfPT3;
+        unsigned int* outgoingTripletIndices; //triplets grouped by inner segment, see buildOutgoingTripletIndex
 
 #ifdef CUT_VALUE_DEBUG
         //debug variables
@@ -60,6 +61,7 @@ namespace SDL
             partOfPT5 = alpaka::getPtrNative(tripletsbuf.partOfPT5_buf);
             partOfT5 = alpaka::getPtrNative(tripletsbuf.partOfT5_buf);
             partOfPT3 = alpaka::getPtrNative(tripletsbuf.partOfPT3_buf);
+            outgoingTripletIndices = alpaka::getPtrNative(tripletsbuf.outgoingTripletIndices_buf);
 #ifdef CUT_VALUE_DEBUG
             zOut = alpaka::getPtrNative(tripletsbuf.zOut_buf);
             rtOut = alpaka::getPtrNative(tripletsbuf.rtOut_buf);
@@ -96,6 +98,7 @@ namespace SDL
         Buf<TAcc, bool> partOfPT5_buf;
         Buf<TAcc, bool> partOfT5_buf;
         Buf<TAcc, bool> partOfPT3_buf;
+        Buf<TAcc, unsigned int> outgoingTripletIndices_buf;
 
 #ifdef CUT_VALUE_DEBUG
         Buf<TAcc, float> zOut_buf;
@@ -132,7 +135,8 @@ namespace SDL
             pt_beta_buf(allocBufWrapper<FPX>(devAccIn, maxTriplets, queue)),
             partOfPT5_buf(allocBufWrapper<bool>(devAccIn, maxTriplets, queue)),
             partOfT5_buf(allocBufWrapper<bool>(devAccIn, maxTriplets, queue)),
-            partOfPT3_buf(allocBufWrapper<bool>(devAccIn, maxTriplets, queue))
+            partOfPT3_buf(allocBufWrapper<bool>(devAccIn, maxTriplets, queue)),
+            outgoingTripletIndices_buf(allocBufWrapper<unsigned int>(devAccIn, maxTriplets, queue))
 #ifdef CUT_VALUE_DEBUG
             ,zOut_buf(allocBufWrapper<float>(devAccIn, maxTriplets, queue)),
             rtOut_buf(allocBufWrapper<float>(devAccIn, maxTriplets, queue)),
@@ -208,87 +212,99 @@ namespace SDL
 #endif
     };
 
-    template<typename TAcc>
-    ALPAKA_FN_ACC ALPAKA_FN_INLINE bool passRZConstraint(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::segments& segmentsInGPU, uint16_t& innerInnerLowerModuleIndex, uint16_t& middleLowerModuleIndex, uint16_t& outerOuterLowerModuleIndex, unsigned int& firstMDIndex, unsigned int& secondMDIndex, unsigned int& thirdMDIndex) 
+    // Largest |residual| of the middle anchor z to the straight line through the outer anchors, by the layers
+    // following Philip's layer number prescription. Negative for the layer combinations that never pass.
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE float rzConstraintCut(int layer1, int layer2, int layer3)
     {
-        //get the rt and z
-        const float& r1 = mdsInGPU.anchorRt[firstMDIndex];
-        const float& r2 = mdsInGPU.anchorRt[secondMDIndex];
-        const float& r3 = mdsInGPU.anchorRt[thirdMDIndex];
-
-        const float& z1 = mdsInGPU.anchorZ[firstMDIndex];
-        const float& z2 = mdsInGPU.anchorZ[secondMDIndex];
-        const float& z3 = mdsInGPU.anchorZ[thirdMDIndex];
-            
-        //following Philip's layer number prescription
-        const int layer1 = modulesInGPU.sdlLayers[innerInnerLowerModuleIndex];
-        const int layer2 = modulesInGPU.sdlLayers[middleLowerModuleIndex];
-        const int layer3 = modulesInGPU.sdlLayers[outerOuterLowerModuleIndex];
-
-        const float residual = z2 - ( (z3 - z1) / (r3 - r1) * (r2 - r1) + z1);
-
         if (layer1 == 12 and layer2 == 13 and layer3 == 14)
         {
-            return false;
+            return -1.f;
         }
         else if (layer1 == 1 and layer2 == 2 and layer3 == 3)
         {
-            return alpaka::math::abs(acc, residual) < 0.53f;
+            return 0.53f;
         }
         else if (layer1 == 1 and layer2 == 2 and layer3 == 7)
         {
-            return alpaka::math::abs(acc, residual) < 1;
+            return 1.f;
         }
         else if (layer1 == 13 and layer2 == 14 and layer3 == 15)
         {
-            return false;
+            return -1.f;
         }
         else if (layer1 == 14 and layer2 == 15 and layer3 == 16)
         {
-            return false;
+            return -1.f;
         }
         else if (layer1 == 1 and layer2 == 7 and layer3 == 8)
         {
-            return alpaka::math::abs(acc, residual) < 1;
+            return 1.f;
         }
         else if (layer1 == 2 and layer2 == 3 and layer3 == 4)
         {
-            return alpaka::math::abs(acc, residual) < 1.21f;
+            return 1.21f;
         }
         else if (layer1 == 2 and layer2 == 3 and layer3 == 7)
         {
-            return alpaka::math::abs(acc, residual) < 1.f;
+            return 1.f;
         }
         else if (layer1 == 2 and layer2 == 7 and layer3 == 8)
         {
-            return alpaka::math::abs(acc, residual) < 1.f;
+            return 1.f;
         }
         else if (layer1 == 3 and layer2 == 4 and layer3 == 5)
         {
-            return alpaka::math::abs(acc, residual) < 2.7f;
+            return 2.7f;
         }
         else if (layer1 == 4 and layer2 == 5 and layer3 == 6)
         {
-            return alpaka::math::abs(acc, residual) < 3.06f;
+            return 3.06f;
         }
         else if (layer1 == 7 and layer2 == 8 and layer3 == 9)
         {
-            return alpaka::math::abs(acc, residual) < 1;
+            return 1.f;
         }
         else if (layer1 == 8 and layer2 == 9 and layer3 == 10)
         {
-            return alpaka::math::abs(acc, residual) < 1;
+            return 1.f;
         }
         else if (layer1 == 9 and layer2 == 10 and layer3 == 11)
         {
-            return alpaka::math::abs(acc, residual) < 1;
+            return 1.f;
         }
         else
         {
-            return alpaka::math::abs(acc, residual) < 5;
+            return 5.f;
         }
     };
 
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE float rzConstraintResidual(float r1, float r2, float r3, float z1, float z2, float z3)
+    {
+        return z2 - ( (z3 - z1) / (r3 - r1) * (r2 - r1) + z1);
+    };
+
+    template<typename TAcc>
+    ALPAKA_FN_ACC ALPAKA_FN_INLINE bool passRZConstraint(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::segments& segmentsInGPU, uint16_t& innerInnerLowerModuleIndex, uint16_t& middleLowerModuleIndex, uint16_t& outerOuterLowerModuleIndex, unsigned int& firstMDIndex, unsigned int& secondMDIndex, unsigned int& thirdMDIndex) 
+    {
+        //get the rt and z
+        const float& r1 = mdsInGPU.anchorRt[firstMDIndex];
+        const float& r2 = mdsInGPU.anchorRt[secondMDIndex];
+        const float& r3 = mdsInGPU.anchorRt[thirdMDIndex];
+
+        const float& z1 = mdsInGPU.anchorZ[firstMDIndex];
+        const float& z2 = mdsInGPU.anchorZ[secondMDIndex];
+        const float& z3 = mdsInGPU.anchorZ[thirdMDIndex];
+            
+        //following Philip's layer number prescription
+        const int layer1 = modulesInGPU.sdlLayers[innerInnerLowerModuleIndex];
+        const int layer2 = modulesInGPU.sdlLayers[middleLowerModuleIndex];
+        const int layer3 = modulesInGPU.sdlLayers[outerOuterLowerModuleIndex];
+
+        const float residual = rzConstraintResidual(r1, r2, r3, z1, z2, z3);
+
+        return alpaka::math::abs(acc, residual) < rzConstraintCut(layer1, layer2, layer3);
+    };
+
     template<typename TAcc>
     ALPAKA_FN_ACC ALPAKA_FN_INLINE bool passPointingConstraintBBB(TAcc const & acc, struct SDL::modules& modulesInGPU, struct SDL::miniDoublets& mdsInGPU, struct SDL::segments& segmentsInGPU, uint16_t& innerInnerLowerModuleIndex, uint16_t& middleLowerModuleIndex, uint16_t& outerOuterLowerModuleIndex, unsigned int& firstMDIndex, unsigned int& secondMDIndex, unsigned int& thirdMDIndex, float& zOut, float& rtOut)
     {
@@ -1300,9 +1316,7 @@ namespace SDL
                 struct SDL::miniDoublets mdsInGPU,
                 struct SDL::segments segmentsInGPU,
                 struct SDL::triplets tripletsInGPU,
-                struct SDL::objectRanges rangesInGPU,
-                uint16_t *index_gpu,
-                uint16_t nonZeroModules) const
+                struct SDL::objectRanges rangesInGPU) const
         {
             using Dim = alpaka::Dim<TAcc>;
             using Idx = alpaka::Idx<TAcc>;
@@ -1310,53 +1324,82 @@ namespace SDL
 
             Vec const globalThreadIdx = alpaka::getIdx<alpaka::Grid, alpaka::Threads>(acc);
             Vec const gridThreadExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Threads>(acc);
+            unsigned int const nElements = candidateBatch(acc);
 
-            for(uint16_t innerLowerModuleArrayIdx = globalThreadIdx[0]; innerLowerModuleArrayIdx < nonZeroModules; innerLowerModuleArrayIdx += gridThreadExtent[0])
+            // Each chunk holds up to activeChunkSize(TripletStage) inner segments of a module
+            for(unsigned int chunk = globalThreadIdx[0]; chunk < rangesInGPU.nActiveChunks[SDL::TripletStage]; chunk += gridThreadExtent[0])
             {
-                uint16_t innerInnerLowerModuleIndex = index_gpu[innerLowerModuleArrayIdx];
-                if(innerInnerLowerModuleIndex >= *modulesInGPU.nLowerModules) continue;
-
-                uint16_t nConnectedModules = modulesInGPU.nConnectedModules[innerInnerLowerModuleIndex];
-                if(nConnectedModules == 0) continue;
+                unsigned int firstInnerSegment;
+                uint16_t innerInnerLowerModuleIndex = activeChunkModule(rangesInGPU, SDL::TripletStage, *modulesInGPU.nLowerModules, chunk, firstInnerSegment);
 
                 unsigned int nInnerSegments = segmentsInGPU.nSegments[innerInnerLowerModuleIndex];
-                for(int innerSegmentArrayIndex = globalThreadIdx[1]; innerSegmentArrayIndex < nInnerSegments; innerSegmentArrayIndex += gridThreadExtent[1])
+                unsigned int lastInnerSegment = alpaka::math::min(acc, firstInnerSegment + SDL::activeChunkSize(SDL::TripletStage), nInnerSegments);
+                for(unsigned int innerSegmentArrayIndex = firstInnerSegment + globalThreadIdx[1]; innerSegmentArrayIndex < lastInnerSegment; innerSegmentArrayIndex += gridThreadExtent[1])
                 {
                     unsigned int innerSegmentIndex = rangesInGPU.segmentRanges[innerInnerLowerModuleIndex * 2] + innerSegmentArrayIndex;
 
                     // middle lower module - outer lower module of inner segment
                     uint16_t middleLowerModuleIndex = segmentsInGPU.outerLowerModuleIndices[innerSegmentIndex];
 
-                    unsigned int nOuterSegments = segmentsInGPU.nSegments[middleLowerModuleIndex];
-                    for(int outerSegmentArrayIndex = globalThreadIdx[2]; outerSegmentArrayIndex < nOuterSegments; outerSegmentArrayIndex += gridThreadExtent[2])
+                    // Only the segments starting at the outer MD of the inner segment can form a triplet with it
+                    unsigned int middleMDIndex = segmentsInGPU.mdIndices[2 * innerSegmentIndex + 1];
+                    unsigned int nOuterSegments = mdsInGPU.nOutgoingSegments[middleMDIndex];
+                    unsigned int outgoingSegmentOffset = mdsInGPU.outgoingSegmentOffsets[middleMDIndex];
+
+                    const int layer1 = modulesInGPU.sdlLayers[innerInnerLowerModuleIndex];
+                    const int layer2 = modulesInGPU.sdlLayers[middleLowerModuleIndex];
+                    unsigned int firstMDIndex = segmentsInGPU.mdIndices[2 * innerSegmentIndex];
+                    const float r1 = mdsInGPU.anchorRt[firstMDIndex];
+                    const float z1 = mdsInGPU.anchorZ[firstMDIndex];
+                    const float r2 = mdsInGPU.anchorRt[middleMDIndex];
+                    const float z2 = mdsInGPU.anchorZ[middleMDIndex];
+
+                    // Batches of up to nElements outer segments per thread. The RZ constraint is evaluated over the
+                    // whole batch first and only the candidates passing it run the full algorithm, which repeats it.
+                    for(unsigned int firstOuterSegmentArrayIndex = globalThreadIdx[2] * nElements; firstOuterSegmentArrayIndex < nOuterSegments; firstOuterSegmentArrayIndex += gridThreadExtent[2] * nElements)
                     {
-                        unsigned int outerSegmentIndex = rangesInGPU.segmentRanges[2 * middleLowerModuleIndex] + outerSegmentArrayIndex;
-                    
-                        uint16_t outerOuterLowerModuleIndex = segmentsInGPU.outerLowerModuleIndices[outerSegmentIndex];
+                        unsigned int nBatchSegments = alpaka::math::min(acc, nElements, nOuterSegments - firstOuterSegmentArrayIndex);
+                        const unsigned int* outerSegmentIndices = segmentsInGPU.outgoingSegmentIndices + outgoingSegmentOffset + firstOuterSegmentArrayIndex;
 
-                        float zOut,rtOut,deltaPhiPos,deltaPhi,betaIn,betaOut, pt_beta;
-                        float zLo, zHi, rtLo, rtHi, zLoPointed, zHiPointed, sdlCut, betaInCut, betaOutCut, deltaBetaCut, kZ;
-
-                        bool success = runTripletConstraintsAndAlgo(acc, modulesInGPU, mdsInGPU, segmentsInGPU, innerInnerLowerModuleIndex, middleLowerModuleIndex, outerOuterLowerModuleIndex, innerSegmentIndex, outerSegmentIndex, zOut, rtOut, deltaPhiPos, deltaPhi, betaIn, betaOut, pt_beta, zLo, zHi, rtLo, rtHi, zLoPointed, zHiPointed, sdlCut, betaInCut, betaOutCut, deltaBetaCut, kZ);
+                        bool pass[candidateBatchSize];
+                        for(unsigned int i = 0; i < nBatchSegments; i++)
+                        {
+                            unsigned int thirdMDIndex = segmentsInGPU.mdIndices[2 * outerSegmentIndices[i] + 1];
+                            const int layer3 = modulesInGPU.sdlLayers[segmentsInGPU.outerLowerModuleIndices[outerSegmentIndices[i]]];
+                            const float residual = rzConstraintResidual(r1, r2, mdsInGPU.anchorRt[thirdMDIndex], z1, z2, mdsInGPU.anchorZ[thirdMDIndex]);
+                            pass[i] = alpaka::math::abs(acc, residual) < rzConstraintCut(layer1, layer2, layer3);
+                        }
 
-                        if(success)
+                        for(unsigned int i = 0; i < nBatchSegments; i++)
                         {
-                            unsigned int totOccupancyTriplets = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &tripletsInGPU.totOccupancyTriplets[innerInnerLowerModuleIndex], 1);
-                            if(totOccupancyTriplets >= (rangesInGPU.tripletModuleOccupancy[innerInnerLowerModuleIndex]))
+                            if(not pass[i]) continue;
+                            unsigned int outerSegmentIndex = outerSegmentIndices[i];
+
+                            uint16_t outerOuterLowerModuleIndex = segmentsInGPU.outerLowerModuleIndices[outerSegmentIndex];
+
+                            float zOut,rtOut,deltaPhiPos,deltaPhi,betaIn,betaOut, pt_beta;
+                            float zLo, zHi, rtLo, rtHi, zLoPointed, zHiPointed, sdlCut, betaInCut, betaOutCut, deltaBetaCut, kZ;
+
+                            bool success = runTripletConstraintsAndAlgo(acc, modulesInGPU, mdsInGPU, segmentsInGPU, innerInnerLowerModuleIndex, middleLowerModuleIndex, outerOuterLowerModuleIndex, innerSegmentIndex, outerSegmentIndex, zOut, rtOut, deltaPhiPos, deltaPhi, betaIn, betaOut, pt_beta, zLo, zHi, rtLo, rtHi, zLoPointed, zHiPointed, sdlCut, betaInCut, betaOutCut, deltaBetaCut, kZ);
+
+                            int totOccupancyTriplets = atomicIncrementAggregated(acc, tripletsInGPU.totOccupancyTriplets, innerInnerLowerModuleIndex, success);
+                            if(success)
                             {
+                                if(totOccupancyTriplets >= (rangesInGPU.tripletModuleOccupancy[innerInnerLowerModuleIndex]))
+                                {
 #ifdef Warnings
-                                printf("Triplet excess alert! Module index = %d\n",innerInnerLowerModuleIndex);
+                                    printf("Triplet excess alert! Module index = %d\n",innerInnerLowerModuleIndex);
 #endif
-                            }
-                            else
-                            {
-                                unsigned int tripletModuleIndex = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &tripletsInGPU.nTriplets[innerInnerLowerModuleIndex], 1);
-                                unsigned int tripletIndex = rangesInGPU.tripletModuleIndices[innerInnerLowerModuleIndex] + tripletModuleIndex;
+                                }
+                                else
+                                {
+                                    unsigned int tripletIndex = rangesInGPU.tripletModuleIndices[innerInnerLowerModuleIndex] + totOccupancyTriplets;
 #ifdef CUT_VALUE_DEBUG
-                                addTripletToMemory(modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, innerSegmentIndex, outerSegmentIndex, innerInnerLowerModuleIndex, middleLowerModuleIndex, outerOuterLowerModuleIndex, zOut, rtOut, deltaPhiPos, deltaPhi, betaIn, betaOut,pt_beta, zLo,zHi, rtLo, rtHi, zLoPointed, zHiPointed, sdlCut, betaInCut, betaOutCut, deltaBetaCut, kZ, tripletIndex);
+                                    addTripletToMemory(modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, innerSegmentIndex, outerSegmentIndex, innerInnerLowerModuleIndex, middleLowerModuleIndex, outerOuterLowerModuleIndex, zOut, rtOut, deltaPhiPos, deltaPhi, betaIn, betaOut,pt_beta, zLo,zHi, rtLo, rtHi, zLoPointed, zHiPointed, sdlCut, betaInCut, betaOutCut, deltaBetaCut, kZ, tripletIndex);
 #else
-                                addTripletToMemory(modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, innerSegmentIndex, outerSegmentIndex, innerInnerLowerModuleIndex, middleLowerModuleIndex, outerOuterLowerModuleIndex, betaIn, betaOut, pt_beta, tripletIndex);
+                                    addTripletToMemory(modulesInGPU, mdsInGPU, segmentsInGPU, tripletsInGPU, innerSegmentIndex, outerSegmentIndex, innerInnerLowerModuleIndex, middleLowerModuleIndex, outerOuterLowerModuleIndex, betaIn, betaOut, pt_beta, tripletIndex);
 #endif
+                                }
                             }
                         }
                     }
@@ -1365,6 +1408,71 @@ namespace SDL
         }
     };
 
+    // Index from each segment to the triplets that start at it, in CSR form: the triplets of segment s are
+    // outgoingTripletIndices[outgoingTripletOffsets[s] .. outgoingTripletOffsets[s] + nOutgoingTriplets[s]).
+    // Built one module at a time like buildOutgoingSegmentIndex.
+    struct buildOutgoingTripletIndex
+    {
+        template<typename TAcc>
+        ALPAKA_FN_ACC void operator()(
+                TAcc const & acc,
+                struct SDL::modules modulesInGPU,
+                struct SDL::segments segmentsInGPU,
+                struct SDL::triplets tripletsInGPU,
+                struct SDL::objectRanges rangesInGPU) const
+        {
+            using Dim = alpaka::Dim<TAcc>;
+            using Idx = alpaka::Idx<TAcc>;
+            using Vec = alpaka::Vec<Dim, Idx>;
+
+            Vec const globalBlockIdx = alpaka::getIdx<alpaka::Grid, alpaka::Blocks>(acc);
+            Vec const blockThreadIdx = alpaka::getIdx<alpaka::Block, alpaka::Threads>(acc);
+            Vec const gridBlockExtent = alpaka::getWorkDiv<alpaka::Grid, alpaka::Blocks>(acc);
+            Vec const blockThreadExtent = alpaka::getWorkDiv<alpaka::Block, alpaka::Threads>(acc);
+
+            for(uint16_t lowerModuleIndex = globalBlockIdx[2]; lowerModuleIndex < (*modulesInGPU.nLowerModules); lowerModuleIndex += gridBlockExtent[2])
+            {
+                unsigned int segmentFirst = rangesInGPU.segmentModuleIndices[lowerModuleIndex];
+                unsigned int nSegments = segmentsInGPU.nSegments[lowerModuleIndex];
+                unsigned int tripletFirst = rangesInGPU.tripletModuleIndices[lowerModuleIndex];
+                unsigned int nTriplets = tripletsInGPU.nTriplets[lowerModuleIndex];
+
+                for(unsigned int segmentIndex = segmentFirst + blockThreadIdx[2]; segmentIndex < segmentFirst + nSegments; segmentIndex += blockThreadExtent[2])
+                {
+                    segmentsInGPU.nOutgoingTriplets[segmentIndex] = 0;
+                }
+                alpaka::syncBlockThreads(acc);
+
+                for(unsigned int tripletIndex = tripletFirst + blockThreadIdx[2]; tripletIndex < tripletFirst + nTriplets; tripletIndex += blockThreadExtent[2])
+                {
+                    alpaka::atomicOp<alpaka::AtomicAdd>(acc, &segmentsInGPU.nOutgoingTriplets[tripletsInGPU.segmentIndices[2 * tripletIndex]], 1u);
+                }
+                alpaka::syncBlockThreads(acc);
+
+                // The counts are cleared again so that they can serve as fill cursors.
+                if(blockThreadIdx[2] == 0)
+                {
+                    unsigned int offset = tripletFirst;
+                    for(unsigned int segmentIndex = segmentFirst; segmentIndex < segmentFirst + nSegments; segmentIndex++)
+                    {
+                        segmentsInGPU.outgoingTripletOffsets[segmentIndex] = offset;
+                        offset += segmentsInGPU.nOutgoingTriplets[segmentIndex];
+                        segmentsInGPU.nOutgoingTriplets[segmentIndex] = 0;
+                    }
+                }
+                alpaka::syncBlockThreads(acc);
+
+                for(unsigned int tripletIndex = tripletFirst + blockThreadIdx[2]; tripletIndex < tripletFirst + nTriplets; tripletIndex += blockThreadExtent[2])
+                {
+                    unsigned int segmentIndex = tripletsInGPU.segmentIndices[2 * tripletIndex];
+                    unsigned int position = alpaka::atomicOp<alpaka::AtomicAdd>(acc, &segmentsInGPU.nOutgoingTriplets[segmentIndex], 1u);
+                    tripletsInGPU.outgoingTripletIndices[segmentsInGPU.outgoingTripletOffsets[segmentIndex] + position] = tripletIndex;
+                }
+                alpaka::syncBlockThreads(acc);
+            }
+        }
+    };
+
     struct createTripletArrayRanges
     {
         template<typename TAcc>
@@ -54,6 +54,10 @@ int main(int argc, char** argv)
         ("d,debug"           , "Run debug job. i.e. overrides output option to 'debug.root' and 'recreate's the file.")
         ("l,lower_level"     , "write lower level objects ntuple results")
         ("G,gnn_ntuple"      , "write gnn input variable ntuple")
+        ("M,memory"          , "Print the memory footprint of each event (allocated and used bytes per buffer, device and process peak memory)")
+        ("t5dnn_weights"     , "Binary T5 DNN weight file to use instead of the compiled-in weights", cxxopts::value<std::string>())
+        ("t5dnn_int8"        , "Run the T5 DNN with int8 weights (if they pass the validation against the float weights)")
+        ("write_t5dnn_weights", "Write the T5 DNN weights in use to the given binary weight file", cxxopts::value<std::string>())
         ("j,nsplit_jobs"     , "Enable splitting jobs by N blocks (--job_index must be set)", cxxopts::value<int>())
         ("I,job_index"       , "job_index of split jobs (--nsplit_jobs must be set. index starts from 0. i.e. 0, 1, 2, 3, etc...)", cxxopts::value<int>())
         ("h,help"            , "Print help");
@@ -259,6 +263,16 @@ int main(int argc, char** argv)
         ana.gnn_ntuple = false;
     }
 
+    //_______________________________________________________________________________
+    // --t5dnn_weights, --t5dnn_int8 and --write_t5dnn_weights
+    ana.t5dnn_weights_path = result.count("t5dnn_weights") ? result["t5dnn_weights"].as<std::string>() : "";
+    ana.t5dnn_int8 = result.count("t5dnn_int8") > 0;
+    ana.write_t5dnn_weights_path = result.count("write_t5dnn_weights") ? result["write_t5dnn_weights"].as<std::string>() : "";
+
+    //_______________________________________________________________________________
+    // --memory
+    ana.print_memory = result.count("memory") > 0;
+
     // Printing out the option settings overview
     std::cout << "=========================================================" << std::endl;
     std::cout << " Setting of the analysis job based on provided arguments " << std::endl;
@@ -310,6 +324,12 @@ void run_sdl()
     loadMaps();
     float timeForMapLoading = full_timer.RealTime()*1000;
 
+    if (not ana.write_t5dnn_weights_path.empty())
+    {
+        SDL::t5DNNWeights->write(ana.write_t5dnn_weights_path);
+        std::cout << "T5 DNN weights written to " << ana.write_t5dnn_weights_path << std::endl;
+    }
+
     if (ana.do_write_ntuple)
     {
         createOutputBranches();
@@ -324,25 +344,22 @@ void run_sdl()
     std::vector<std::vector<float>> out_trkY;
     std::vector<std::vector<float>> out_trkZ;
     std::vector<std::vector<unsigned int>> out_hitId;
-    std::vector<std::vector<unsigned int>> out_hitIdxs;
-    std::vector<std::vector<unsigned int>> out_hitIndices_vec0;
-    std::vector<std::vector<unsigned int>> out_hitIndices_vec1;
-    std::vector<std::vector<unsigned int>> out_hitIndices_vec2;
-    std::vector<std::vector<unsigned int>> out_hitIndices_vec3;
-    std::vector<std::vector<float>> out_deltaPhi_vec;
-    std::vector<std::vector<float>> out_ptIn_vec;
-    std::vector<std::vector<float>> out_ptErr_vec;
-    std::vector<std::vector<float>> out_px_vec;
-    std::vector<std::vector<float>> out_py_vec;
-    std::vector<std::vector<float>> out_pz_vec;
-    std::vector<std::vector<float>> out_eta_vec;
-    std::vector<std::vector<float>> out_etaErr_vec;
-    std::vector<std::vector<float>> out_phi_vec;
-    std::vector<std::vector<int>> out_charge_vec;
-    std::vector<std::vector<unsigned int>> out_seedIdx_vec;
-    std::vector<std::vector<int>> out_superbin_vec;
-    std::vector<std::vector<int8_t>> out_pixelType_vec;
-    std::vector<std::vector<char>> out_isQuad_vec;
+    std::vector<std::vector<float>> out_see_px;
+    std::vector<std::vector<float>> out_see_py;
+    std::vector<std::vector<float>> out_see_pz;
+    std::vector<std::vector<float>> out_see_dxy;
+    std::vector<std::vector<float>> out_see_dz;
+    std::vector<std::vector<float>> out_see_ptErr;
+    std::vector<std::vector<float>> out_see_etaErr;
+    std::vector<std::vector<float>> out_see_stateTrajGlbX;
+    std::vector<std::vector<float>> out_see_stateTrajGlbY;
+    std::vector<std::vector<float>> out_see_stateTrajGlbZ;
+    std::vector<std::vector<float>> out_see_stateTrajGlbPx;
+    std::vector<std::vector<float>> out_see_stateTrajGlbPy;
+    std::vector<std::vector<float>> out_see_stateTrajGlbPz;
+    std::vector<std::vector<int>> out_see_q;
+    std::vector<std::vector<std::vector<int>>> out_see_hitIdx;
+    std::vector<std::vector<unsigned int>> out_seedIdx;
     std::vector<int> evt_num;
     std::vector<TString> file_name;
 
@@ -360,25 +377,22 @@ void run_sdl()
                                               out_trkY,
                                               out_trkZ,
                                               out_hitId,
-                                              out_hitIdxs,
-                                              out_hitIndices_vec0,
-                                              out_hitIndices_vec1,
-                                              out_hitIndices_vec2,
-                                              out_hitIndices_vec3,
-                                              out_deltaPhi_vec,
-                                              out_ptIn_vec,
-                                              out_ptErr_vec,
-                                              out_px_vec,
-                                              out_py_vec,
-                                              out_pz_vec,
-                                              out_eta_vec,
-                                              out_etaErr_vec,
-                                              out_phi_vec,
-                                              out_charge_vec,
-                                              out_seedIdx_vec,
-                                              out_superbin_vec,
-                                              out_pixelType_vec,
-                                              out_isQuad_vec);
+                                              out_see_px,
+                                              out_see_py,
+                                              out_see_pz,
+                                              out_see_dxy,
+                                              out_see_dz,
+                                              out_see_ptErr,
+                                              out_see_etaErr,
+                                              out_see_stateTrajGlbX,
+                                              out_see_stateTrajGlbY,
+                                              out_see_stateTrajGlbZ,
+                                              out_see_stateTrajGlbPx,
+                                              out_see_stateTrajGlbPy,
+                                              out_see_stateTrajGlbPz,
+                                              out_see_q,
+                                              out_see_hitIdx,
+                                              out_seedIdx);
         evt_num.push_back(ana.looper.getCurrentEventIndex());
         file_name.push_back(ana.looper.getCurrentFileName());
     }
@@ -424,25 +438,22 @@ void run_sdl()
                                                            out_trkY.at(evt),
                                                            out_trkZ.at(evt),
                                                            out_hitId.at(evt),
-                                                           out_hitIdxs.at(evt),
-                                                           out_hitIndices_vec0.at(evt),
-                                                           out_hitIndices_vec1.at(evt),
-                                                           out_hitIndices_vec2.at(evt),
-                                                           out_hitIndices_vec3.at(evt),
-                                                           out_deltaPhi_vec.at(evt),
-                                                           out_ptIn_vec.at(evt),
-                                                           out_ptErr_vec.at(evt),
-                                                           out_px_vec.at(evt),
-                                                           out_py_vec.at(evt),
-                                                           out_pz_vec.at(evt),
-                                                           out_eta_vec.at(evt),
-                                                           out_etaErr_vec.at(evt),
-                                                           out_phi_vec.at(evt),
-                                                           out_charge_vec.at(evt),
-                                                           out_seedIdx_vec.at(evt),
-                                                           out_superbin_vec.at(evt),
-                                                           out_pixelType_vec.at(evt),
-                                                           out_isQuad_vec.at(evt));
+                                                           out_see_px.at(evt),
+                                                           out_see_py.at(evt),
+                                                           out_see_pz.at(evt),
+                                                           out_see_dxy.at(evt),
+                                                           out_see_dz.at(evt),
+                                                           out_see_ptErr.at(evt),
+                                                           out_see_etaErr.at(evt),
+                                                           out_see_stateTrajGlbX.at(evt),
+                                                           out_see_stateTrajGlbY.at(evt),
+                                                           out_see_stateTrajGlbZ.at(evt),
+                                                           out_see_stateTrajGlbPx.at(evt),
+                                                           out_see_stateTrajGlbPy.at(evt),
+                                                           out_see_stateTrajGlbPz.at(evt),
+                                                           out_see_q.at(evt),
+                                                           out_see_hitIdx.at(evt),
+                                                           out_seedIdx.at(evt));
 
             timing_MD = runMiniDoublet(events.at(omp_get_thread_num()), evt);
             timing_LS = runSegment(events.at(omp_get_thread_num()));
@@ -485,6 +496,15 @@ void run_sdl()
                 }
             }
 
+            if (ana.print_memory)
+            {
+                #pragma omp critical
+                {
+                    std::cout << "Memory usage of event " << evt << std::endl;
+                    events.at(omp_get_thread_num())->printMemoryUsage();
+                }
+            }
+
             // Clear this event
             TStopwatch my_timer;
             my_timer.Start();
@@ -530,6 +550,10 @@ void run_sdl()
 
     SDL::freeModules();
     SDL::freeEndcap();
+    SDL::freeT5DNNWeights();
+#ifdef SDL_CACHE_ALLOC
+    SDL::freeCachedBlocks();
+#endif
 
     delete ana.output_tfile;
 }
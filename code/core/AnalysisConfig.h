@@ -120,6 +120,16 @@ public:
     // Boolean to write gnn ntuple
     bool gnn_ntuple;
 
+    // Boolean to print the per-event memory footprint
+    bool print_memory;
+
+    // T5 DNN weight file to load (compiled-in weights if empty) and whether to use the int8 weights
+    std::string t5dnn_weights_path;
+    bool t5dnn_int8;
+
+    // T5 DNN weight file to write the weights in use to
+    std::string write_t5dnn_weights_path;
+
     // String to hold the MAKETARGET setting from compile
     std::string compilation_target;
 
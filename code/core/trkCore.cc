@@ -36,6 +36,19 @@ void loadMaps()
         SDL::moduleConnectionMap_pLStoLayer_neg[i].load( get_absolute_path_after_check_file_exists( path.Data() ).Data() );
     }
 
+    // T5 DNN weights, the compiled-in ones unless a weight file is given
+    SDL::createT5DNNWeights();
+    if (not ana.t5dnn_weights_path.empty())
+    {
+        TString t5dnnWeights = get_absolute_path_after_check_file_exists(ana.t5dnn_weights_path);
+        std::cout << "T5 DNN weights: " << t5dnnWeights << std::endl;
+        SDL::t5DNNWeights->load(t5dnnWeights.Data(), ana.t5dnn_int8);
+    }
+    else
+    {
+        SDL::t5DNNWeights->loadBuiltin(ana.t5dnn_int8);
+    }
+
     // WARNING: initModules must come after above load commands!! keep it at the last line here!
     SDL::initModules(centroid.Data());
 }
@@ -615,297 +628,129 @@ void addInputsToLineSegmentTrackingPreLoad(std::vector<std::vector<float>> &out_
                                            std::vector<std::vector<float>> &out_trkY,
                                            std::vector<std::vector<float>> &out_trkZ,
                                            std::vector<std::vector<unsigned int>> &out_hitId,
-                                           std::vector<std::vector<unsigned int>> &out_hitIdxs,
-                                           std::vector<std::vector<unsigned int>> &out_hitIndices_vec0,
-                                           std::vector<std::vector<unsigned int>> &out_hitIndices_vec1,
-                                           std::vector<std::vector<unsigned int>> &out_hitIndices_vec2,
-                                           std::vector<std::vector<unsigned int>> &out_hitIndices_vec3,
-                                           std::vector<std::vector<float>> &out_deltaPhi_vec,
-                                           std::vector<std::vector<float>> &out_ptIn_vec,
-                                           std::vector<std::vector<float>> &out_ptErr_vec,
-                                           std::vector<std::vector<float>> &out_px_vec,
-                                           std::vector<std::vector<float>> &out_py_vec,
-                                           std::vector<std::vector<float>> &out_pz_vec,
-                                           std::vector<std::vector<float>> &out_eta_vec,
-                                           std::vector<std::vector<float>> &out_etaErr_vec,
-                                           std::vector<std::vector<float>> &out_phi_vec,
-                                           std::vector<std::vector<int>> &out_charge_vec,
-                                           std::vector<std::vector<unsigned int>> &out_seedIdx_vec,
-                                           std::vector<std::vector<int>> &out_superbin_vec,
-                                           std::vector<std::vector<int8_t>> &out_pixelType_vec,
-                                           std::vector<std::vector<char>> &out_isQuad_vec)
+                                           std::vector<std::vector<float>> &out_see_px,
+                                           std::vector<std::vector<float>> &out_see_py,
+                                           std::vector<std::vector<float>> &out_see_pz,
+                                           std::vector<std::vector<float>> &out_see_dxy,
+                                           std::vector<std::vector<float>> &out_see_dz,
+                                           std::vector<std::vector<float>> &out_see_ptErr,
+                                           std::vector<std::vector<float>> &out_see_etaErr,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbX,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbY,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbZ,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbPx,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbPy,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbPz,
+                                           std::vector<std::vector<int>> &out_see_q,
+                                           std::vector<std::vector<std::vector<int>>> &out_see_hitIdx,
+                                           std::vector<std::vector<unsigned int>> &out_seedIdx)
 {
-
-    unsigned int count = 0;
+    // Only the raw seed tracks are stored here; the pixel pseudo-hits and pLS are built on the device by SDL::Event::addHitAndPixelSeedToEvent.
     auto n_see = trk.see_stateTrajGlbPx().size();
-    std::vector<float> px_vec;
-    px_vec.reserve(n_see);
-    std::vector<float> py_vec;
-    py_vec.reserve(n_see);
-    std::vector<float> pz_vec;
-    pz_vec.reserve(n_see);
-    std::vector<unsigned int> hitIndices_vec0;
-    hitIndices_vec0.reserve(n_see);
-    std::vector<unsigned int> hitIndices_vec1;
-    hitIndices_vec1.reserve(n_see);
-    std::vector<unsigned int> hitIndices_vec2;
-    hitIndices_vec2.reserve(n_see);
-    std::vector<unsigned int> hitIndices_vec3;
-    hitIndices_vec3.reserve(n_see);
-    std::vector<float> ptIn_vec;
-    ptIn_vec.reserve(n_see);
-    std::vector<float> ptErr_vec;
-    ptErr_vec.reserve(n_see);
-    std::vector<float> etaErr_vec;
-    etaErr_vec.reserve(n_see);
-    std::vector<float> eta_vec;
-    eta_vec.reserve(n_see);
-    std::vector<float> phi_vec;
-    phi_vec.reserve(n_see);
-    std::vector<int> charge_vec;
-    charge_vec.reserve(n_see);
-    std::vector<unsigned int> seedIdx_vec;
-    seedIdx_vec.reserve(n_see);
-    std::vector<float> deltaPhi_vec;
-    deltaPhi_vec.reserve(n_see);
-    std::vector<float> trkX = trk.ph2_x();
-    std::vector<float> trkY = trk.ph2_y();
-    std::vector<float> trkZ = trk.ph2_z();
-    std::vector<unsigned int> hitId = trk.ph2_detId();
-    std::vector<unsigned int> hitIdxs(trk.ph2_detId().size());
-
-    std::vector<int> superbin_vec;
-    std::vector<int8_t> pixelType_vec;
-    std::vector<char> isQuad_vec;
-    std::iota(hitIdxs.begin(), hitIdxs.end(), 0);
-    const int hit_size = trkX.size();
+    std::vector<float> see_px;
+    see_px.reserve(n_see);
+    std::vector<float> see_py;
+    see_py.reserve(n_see);
+    std::vector<float> see_pz;
+    see_pz.reserve(n_see);
+    std::vector<float> see_dxy;
+    see_dxy.reserve(n_see);
+    std::vector<float> see_dz;
+    see_dz.reserve(n_see);
+    std::vector<float> see_ptErr;
+    see_ptErr.reserve(n_see);
+    std::vector<float> see_etaErr;
+    see_etaErr.reserve(n_see);
+    std::vector<float> see_stateTrajGlbX;
+    see_stateTrajGlbX.reserve(n_see);
+    std::vector<float> see_stateTrajGlbY;
+    see_stateTrajGlbY.reserve(n_see);
+    std::vector<float> see_stateTrajGlbZ;
+    see_stateTrajGlbZ.reserve(n_see);
+    std::vector<float> see_stateTrajGlbPx;
+    see_stateTrajGlbPx.reserve(n_see);
+    std::vector<float> see_stateTrajGlbPy;
+    see_stateTrajGlbPy.reserve(n_see);
+    std::vector<float> see_stateTrajGlbPz;
+    see_stateTrajGlbPz.reserve(n_see);
+    std::vector<int> see_q;
+    see_q.reserve(n_see);
+    std::vector<std::vector<int>> see_hitIdx;
+    see_hitIdx.reserve(n_see);
+    std::vector<unsigned int> seedIdx;
+    seedIdx.reserve(n_see);
 
     for (auto &&[iSeed, _] : iter::enumerate(trk.see_stateTrajGlbPx()))
     {
-
-        //// track algorithm; partial copy from TrackBase.h
-        // enum class TrackAlgorithm {
-        //    undefAlgorithm = 0,
-        //    ctf = 1,
-        //    duplicateMerge = 2,
-        //    cosmics = 3,
-        //    initialStep = 4,
-        //    lowPtTripletStep = 5,
-        //    pixelPairStep = 6,
-        //    detachedTripletStep = 7,
-        //    mixedTripletStep = 8,
-        //    pixelLessStep = 9,
-        //    tobTecStep = 10,
-        //    jetCoreRegionalStep = 11,
-        //    conversionStep = 12,
-        //    muonSeededStepInOut = 13,
-        //    muonSeededStepOutIn = 14,
-        //    outInEcalSeededConv = 15, inOutEcalSeededConv = 16,
-        //    nuclInter = 17,
-        //    standAloneMuon = 18, globalMuon = 19, cosmicStandAloneMuon = 20, cosmicGlobalMuon = 21,
-        //    // Phase1
-        //    highPtTripletStep = 22, lowPtQuadStep = 23, detachedQuadStep = 24,
-        //    reservedForUpgrades1 = 25, reservedForUpgrades2 = 26,
-        //    bTagGhostTracks = 27,
-        //    beamhalo = 28,
-        //    gsf = 29
-        //};
+        // Only the initialStep (4) and highPtTripletStep (22) seeds are used, see TrackBase.h for the other algorithms.
         bool good_seed_type = false;
         if (trk.see_algo()[iSeed] == 4) good_seed_type = true;
-        // if (trk.see_algo()[iSeed] == 5) good_seed_type = true;
-        // if (trk.see_algo()[iSeed] == 7) good_seed_type = true;
         if (trk.see_algo()[iSeed] == 22) good_seed_type = true;
-        // if (trk.see_algo()[iSeed] == 23) good_seed_type = true;
-        // if (trk.see_algo()[iSeed] == 24) good_seed_type = true;
         if (not good_seed_type) continue;
 
-        TVector3 p3LH(trk.see_stateTrajGlbPx()[iSeed], trk.see_stateTrajGlbPy()[iSeed], trk.see_stateTrajGlbPz()[iSeed]);
-        float ptIn = p3LH.Pt();
-        float eta = p3LH.Eta();
-        float ptErr = trk.see_ptErr()[iSeed];
-
-        if ((ptIn > PT_CUT - 2 * ptErr))
-        {
-            TVector3 r3LH(trk.see_stateTrajGlbX()[iSeed], trk.see_stateTrajGlbY()[iSeed], trk.see_stateTrajGlbZ()[iSeed]);
-            TVector3 p3PCA(trk.see_px()[iSeed], trk.see_py()[iSeed], trk.see_pz()[iSeed]);
-            TVector3 r3PCA(calculateR3FromPCA(p3PCA, trk.see_dxy()[iSeed], trk.see_dz()[iSeed]));
-            TVector3 seedSD_mdRef_r3 = r3PCA;
-            TVector3 seedSD_mdOut_r3 = r3LH;
-            TVector3 seedSD_r3 = r3LH;
-            TVector3 seedSD_p3 = p3LH;
-
-            float pixelSegmentDeltaPhiChange = r3LH.DeltaPhi(p3LH);
-            float etaErr = trk.see_etaErr()[iSeed];
-            float px = p3LH.X();
-            float py = p3LH.Y();
-            float pz = p3LH.Z();
-            int charge = trk.see_q()[iSeed];
-            unsigned int seedIdx = iSeed;
-
-            // get pixel superbin
-            // int ptbin = -1;
-            int pixtype = -1;
-            if (ptIn >= 2.0)
-            { /*ptbin = 1;*/
-                pixtype = 0;
-            }
-            else if (ptIn >= (PT_CUT - 2 * ptErr) and ptIn < 2.0)
-            {
-                // ptbin = 0;
-                if (pixelSegmentDeltaPhiChange >= 0)
-                {
-                    pixtype = 1;
-                }
-                else
-                {
-                    pixtype = 2;
-                }
-            }
-            else
-            {
-                continue;
-            }
-
-            unsigned int hitIdx0 = hit_size + count;
-            count++;
-
-            unsigned int hitIdx1 = hit_size + count;
-            count++;
-
-            unsigned int hitIdx2 = hit_size + count;
-            count++;
-
-            unsigned int hitIdx3;
-            if (trk.see_hitIdx()[iSeed].size() <= 3)
-            {
-                hitIdx3 = hitIdx2;
-            }
-            else
-            {
-                hitIdx3 = hit_size + count;
-                count++;
-            }
-
-            trkX.push_back(r3PCA.X());
-            trkY.push_back(r3PCA.Y());
-            trkZ.push_back(r3PCA.Z());
-            trkX.push_back(p3PCA.Pt());
-            float p3PCA_Eta = p3PCA.Eta();
-            trkY.push_back(p3PCA_Eta);
-            float p3PCA_Phi = p3PCA.Phi();
-            trkZ.push_back(p3PCA_Phi);
-            trkX.push_back(r3LH.X());
-            trkY.push_back(r3LH.Y());
-            trkZ.push_back(r3LH.Z());
-            hitId.push_back(1);
-            hitId.push_back(1);
-            hitId.push_back(1);
-            if (trk.see_hitIdx()[iSeed].size() > 3)
-            {
-                trkX.push_back(r3LH.X());
-                trkY.push_back(trk.see_dxy()[iSeed]);
-                trkZ.push_back(trk.see_dz()[iSeed]);
-                hitId.push_back(1);
-            }
-            px_vec.push_back(px);
-            py_vec.push_back(py);
-            pz_vec.push_back(pz);
-
-            hitIndices_vec0.push_back(hitIdx0);
-            hitIndices_vec1.push_back(hitIdx1);
-            hitIndices_vec2.push_back(hitIdx2);
-            hitIndices_vec3.push_back(hitIdx3);
-            ptIn_vec.push_back(ptIn);
-            ptErr_vec.push_back(ptErr);
-            etaErr_vec.push_back(etaErr);
-            eta_vec.push_back(eta);
-            float phi = p3LH.Phi();
-            phi_vec.push_back(phi);
-            charge_vec.push_back(charge);
-            seedIdx_vec.push_back(seedIdx);
-            deltaPhi_vec.push_back(pixelSegmentDeltaPhiChange);
-
-            // For matching with sim tracks
-            hitIdxs.push_back(trk.see_hitIdx()[iSeed][0]);
-            hitIdxs.push_back(trk.see_hitIdx()[iSeed][1]);
-            hitIdxs.push_back(trk.see_hitIdx()[iSeed][2]);
-            char isQuad = false;
-            if (trk.see_hitIdx()[iSeed].size() > 3)
-            {
-                isQuad = true;
-                hitIdxs.push_back(trk.see_hitIdx()[iSeed].size() > 3 ? trk.see_hitIdx()[iSeed][3] : trk.see_hitIdx()[iSeed][2]);
-            }
-            // if (pt < 0){ ptbin = 0;}
-            float neta = 25.;
-            float nphi = 72.;
-            float nz = 25.;
-            int etabin = (p3PCA_Eta + 2.6) / ((2 * 2.6) / neta);
-            int phibin = (p3PCA_Phi + 3.14159265358979323846) / ((2. * 3.14159265358979323846) / nphi);
-            int dzbin = (trk.see_dz()[iSeed] + 30) / (2 * 30 / nz);
-            int isuperbin = /*(nz * nphi * neta) * ptbin + (removed since pt bin is determined by pixelType)*/ (nz * nphi) * etabin + (nz)*phibin + dzbin;
-            // if(isuperbin<0 || isuperbin>=44900){printf("isuperbin %d %d %d %d %f\n",isuperbin,etabin,phibin,dzbin,p3PCA.Eta());}
-            superbin_vec.push_back(isuperbin);
-            pixelType_vec.push_back(pixtype);
-            isQuad_vec.push_back(isQuad);
-        }
+        see_px.push_back(trk.see_px()[iSeed]);
+        see_py.push_back(trk.see_py()[iSeed]);
+        see_pz.push_back(trk.see_pz()[iSeed]);
+        see_dxy.push_back(trk.see_dxy()[iSeed]);
+        see_dz.push_back(trk.see_dz()[iSeed]);
+        see_ptErr.push_back(trk.see_ptErr()[iSeed]);
+        see_etaErr.push_back(trk.see_etaErr()[iSeed]);
+        see_stateTrajGlbX.push_back(trk.see_stateTrajGlbX()[iSeed]);
+        see_stateTrajGlbY.push_back(trk.see_stateTrajGlbY()[iSeed]);
+        see_stateTrajGlbZ.push_back(trk.see_stateTrajGlbZ()[iSeed]);
+        see_stateTrajGlbPx.push_back(trk.see_stateTrajGlbPx()[iSeed]);
+        see_stateTrajGlbPy.push_back(trk.see_stateTrajGlbPy()[iSeed]);
+        see_stateTrajGlbPz.push_back(trk.see_stateTrajGlbPz()[iSeed]);
+        see_q.push_back(trk.see_q()[iSeed]);
+        see_hitIdx.push_back(trk.see_hitIdx()[iSeed]);
+        seedIdx.push_back(iSeed);
+    }
 
-    } // iter::enumerate(trk.see_stateTrajGlbPx
-
-    out_trkX.push_back(trkX);
-    out_trkY.push_back(trkY);
-    out_trkZ.push_back(trkZ);
-    out_hitId.push_back(hitId);
-    out_hitIdxs.push_back(hitIdxs);
-    out_hitIndices_vec0.push_back(hitIndices_vec0);
-    out_hitIndices_vec1.push_back(hitIndices_vec1);
-    out_hitIndices_vec2.push_back(hitIndices_vec2);
-    out_hitIndices_vec3.push_back(hitIndices_vec3);
-    out_deltaPhi_vec.push_back(deltaPhi_vec);
-    out_ptIn_vec.push_back(ptIn_vec);
-    out_ptErr_vec.push_back(ptErr_vec);
-    out_px_vec.push_back(px_vec);
-    out_py_vec.push_back(py_vec);
-    out_pz_vec.push_back(pz_vec);
-    out_eta_vec.push_back(eta_vec);
-    out_etaErr_vec.push_back(etaErr_vec);
-    out_phi_vec.push_back(phi_vec);
-    out_charge_vec.push_back(charge_vec);
-    out_seedIdx_vec.push_back(seedIdx_vec);
-    out_superbin_vec.push_back(superbin_vec);
-    out_pixelType_vec.push_back(pixelType_vec);
-    out_isQuad_vec.push_back(isQuad_vec);
-
-    //    float hit_loading_elapsed = my_timer.RealTime();
-    //    if (ana.verbose >= 2) std::cout << "Loading inputs processing time: " << hit_loading_elapsed << " secs" << std::endl;
-    //    return hit_loading_elapsed;
+    out_trkX.push_back(trk.ph2_x());
+    out_trkY.push_back(trk.ph2_y());
+    out_trkZ.push_back(trk.ph2_z());
+    out_hitId.push_back(trk.ph2_detId());
+    out_see_px.push_back(see_px);
+    out_see_py.push_back(see_py);
+    out_see_pz.push_back(see_pz);
+    out_see_dxy.push_back(see_dxy);
+    out_see_dz.push_back(see_dz);
+    out_see_ptErr.push_back(see_ptErr);
+    out_see_etaErr.push_back(see_etaErr);
+    out_see_stateTrajGlbX.push_back(see_stateTrajGlbX);
+    out_see_stateTrajGlbY.push_back(see_stateTrajGlbY);
+    out_see_stateTrajGlbZ.push_back(see_stateTrajGlbZ);
+    out_see_stateTrajGlbPx.push_back(see_stateTrajGlbPx);
+    out_see_stateTrajGlbPy.push_back(see_stateTrajGlbPy);
+    out_see_stateTrajGlbPz.push_back(see_stateTrajGlbPz);
+    out_see_q.push_back(see_q);
+    out_see_hitIdx.push_back(see_hitIdx);
+    out_seedIdx.push_back(seedIdx);
 }
 
 //___________________________________________________________________________________________________________________________________________________________________________________________
-float addInputsToEventPreLoad(SDL::Event* event,
+float addInputsToEventPreLoad(SDL::Event *event,
                               bool useOMP,
                               std::vector<float> trkX,
                               std::vector<float> trkY,
                               std::vector<float> trkZ,
                               std::vector<unsigned int> hitId,
-                              std::vector<unsigned int> hitIdxs,
-                              std::vector<unsigned int> hitIndices_vec0,
-                              std::vector<unsigned int> hitIndices_vec1,
-                              std::vector<unsigned int> hitIndices_vec2,
-                              std::vector<unsigned int> hitIndices_vec3,
-                              std::vector<float> deltaPhi_vec,
-                              std::vector<float> ptIn_vec,
-                              std::vector<float> ptErr_vec,
-                              std::vector<float> px_vec,
-                              std::vector<float> py_vec,
-                              std::vector<float> pz_vec,
-                              std::vector<float> eta_vec,
-                              std::vector<float> etaErr_vec,
-                              std::vector<float> phi_vec,
-                              std::vector<int> charge_vec,
-                              std::vector<unsigned int> seedIdx_vec,
-                              std::vector<int> superbin_vec,
-                              std::vector<int8_t> pixelType_vec,
-                              std::vector<char> isQuad_vec)
+                              std::vector<float> see_px,
+                              std::vector<float> see_py,
+                              std::vector<float> see_pz,
+                              std::vector<float> see_dxy,
+                              std::vector<float> see_dz,
+                              std::vector<float> see_ptErr,
+                              std::vector<float> see_etaErr,
+                              std::vector<float> see_stateTrajGlbX,
+                              std::vector<float> see_stateTrajGlbY,
+                              std::vector<float> see_stateTrajGlbZ,
+                              std::vector<float> see_stateTrajGlbPx,
+                              std::vector<float> see_stateTrajGlbPy,
+                              std::vector<float> see_stateTrajGlbPz,
+                              std::vector<int> see_q,
+                              std::vector<std::vector<int>> see_hitIdx,
+                              std::vector<unsigned int> seedIdx)
 {
     TStopwatch my_timer;
 
@@ -914,26 +759,28 @@ float addInputsToEventPreLoad(SDL::Event* event,
 
     my_timer.Start();
 
-    event->addHitToEvent(trkX, trkY, trkZ, hitId, hitIdxs);
-
-    event->addPixelSegmentToEvent(hitIndices_vec0,
-                                  hitIndices_vec1,
-                                  hitIndices_vec2,
-                                  hitIndices_vec3,
-                                  deltaPhi_vec,
-                                  ptIn_vec,
-                                  ptErr_vec,
-                                  px_vec,
-                                  py_vec,
-                                  pz_vec,
-                                  eta_vec,
-                                  etaErr_vec,
-                                  phi_vec,
-                                  charge_vec,
-                                  seedIdx_vec,
-                                  superbin_vec,
-                                  pixelType_vec,
-                                  isQuad_vec);
+    event->addHitAndPixelSeedToEvent(trkX,
+                                     trkY,
+                                     trkZ,
+                                     hitId,
+                                     see_px,
+                                     see_py,
+                                     see_pz,
+                                     see_dxy,
+                                     see_dz,
+                                     see_ptErr,
+                                     see_etaErr,
+                                     see_stateTrajGlbX,
+                                     see_stateTrajGlbY,
+                                     see_stateTrajGlbZ,
+                                     see_stateTrajGlbPx,
+                                     see_stateTrajGlbPy,
+                                     see_stateTrajGlbPz,
+                                     see_q,
+                                     see_hitIdx,
+                                     seedIdx,
+                                     false);
+
     float hit_loading_elapsed = my_timer.RealTime();
 
     if (ana.verbose >= 2)
@@ -51,25 +51,22 @@ void addInputsToLineSegmentTrackingPreLoad(std::vector<std::vector<float>> &out_
                                            std::vector<std::vector<float>> &out_trkY,
                                            std::vector<std::vector<float>> &out_trkZ,
                                            std::vector<std::vector<unsigned int>> &out_hitId,
-                                           std::vector<std::vector<unsigned int>> &out_hitIdxs,
-                                           std::vector<std::vector<unsigned int>> &out_hitIndices_vec0,
-                                           std::vector<std::vector<unsigned int>> &out_hitIndices_vec1,
-                                           std::vector<std::vector<unsigned int>> &out_hitIndices_vec2,
-                                           std::vector<std::vector<unsigned int>> &out_hitIndices_vec3,
-                                           std::vector<std::vector<float>> &out_deltaPhi_vec,
-                                           std::vector<std::vector<float>> &out_ptIn_vec,
-                                           std::vector<std::vector<float>> &out_ptErr_vec,
-                                           std::vector<std::vector<float>> &out_px_vec,
-                                           std::vector<std::vector<float>> &out_py_vec,
-                                           std::vector<std::vector<float>> &out_pz_vec,
-                                           std::vector<std::vector<float>> &out_eta_vec,
-                                           std::vector<std::vector<float>> &out_etaErr_vec,
-                                           std::vector<std::vector<float>> &out_phi_vec,
-                                           std::vector<std::vector<int>> &out_charge_vec,
-                                           std::vector<std::vector<unsigned int>> &out_seedIdx_vec,
-                                           std::vector<std::vector<int>> &out_superbin_vec,
-                                           std::vector<std::vector<int8_t>> &out_pixelType_vec,
-                                           std::vector<std::vector<char>> &out_isQuad_vec);
+                                           std::vector<std::vector<float>> &out_see_px,
+                                           std::vector<std::vector<float>> &out_see_py,
+                                           std::vector<std::vector<float>> &out_see_pz,
+                                           std::vector<std::vector<float>> &out_see_dxy,
+                                           std::vector<std::vector<float>> &out_see_dz,
+                                           std::vector<std::vector<float>> &out_see_ptErr,
+                                           std::vector<std::vector<float>> &out_see_etaErr,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbX,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbY,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbZ,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbPx,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbPy,
+                                           std::vector<std::vector<float>> &out_see_stateTrajGlbPz,
+                                           std::vector<std::vector<int>> &out_see_q,
+                                           std::vector<std::vector<std::vector<int>>> &out_see_hitIdx,
+                                           std::vector<std::vector<unsigned int>> &out_seedIdx);
 
 float addInputsToEventPreLoad(SDL::Event *event,
                               bool useOMP,
@@ -77,25 +74,22 @@ float addInputsToEventPreLoad(SDL::Event *event,
                               std::vector<float> trkY,
                               std::vector<float> trkZ,
                               std::vector<unsigned int> hitId,
-                              std::vector<unsigned int> hitIdxs,
-                              std::vector<unsigned int> hitIndices_vec0,
-                              std::vector<unsigned int> hitIndices_vec1,
-                              std::vector<unsigned int> hitIndices_vec2,
-                              std::vector<unsigned int> hitIndices_vec3,
-                              std::vector<float> deltaPhi_vec,
-                              std::vector<float> ptIn_vec,
-                              std::vector<float> ptErr_vec,
-                              std::vector<float> px_vec,
-                              std::vector<float> py_vec,
-                              std::vector<float> pz_vec,
-                              std::vector<float> eta_vec,
-                              std::vector<float> etaErr_vec,
-                              std::vector<float> phi_vec,
-                              std::vector<int> charge_vec,
-                              std::vector<unsigned int> seedIdx_vec,
-                              std::vector<int> superbin_vec,
-                              std::vector<int8_t> pixelType_vec,
-                              std::vector<char> isQuad_vec);
+                              std::vector<float> see_px,
+                              std::vector<float> see_py,
+                              std::vector<float> see_pz,
+                              std::vector<float> see_dxy,
+                              std::vector<float> see_dz,
+                              std::vector<float> see_ptErr,
+                              std::vector<float> see_etaErr,
+                              std::vector<float> see_stateTrajGlbX,
+                              std::vector<float> see_stateTrajGlbY,
+                              std::vector<float> see_stateTrajGlbZ,
+                              std::vector<float> see_stateTrajGlbPx,
+                              std::vector<float> see_stateTrajGlbPy,
+                              std::vector<float> see_stateTrajGlbPz,
+                              std::vector<int> see_q,
+                              std::vector<std::vector<int>> see_hitIdx,
+                              std::vector<unsigned int> seedIdx);
 
 void printTimingInformation(std::vector<std::vector<float>>& timing_information, float fullTime, float fullavg);
 
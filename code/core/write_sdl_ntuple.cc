@@ -737,13 +737,13 @@ void setGnnNtupleMiniDoublet(SDL::Event* event, unsigned int MD)
 
     // Obtain where the actual hit is located in terms of their layer, module, rod, and ring number
     unsigned int anchitidx = hitsInGPU.idxs[hit0];
-    int subdet = trk.ph2_subdet()[hitsInGPU.idxs[anchitidx]];
+    int subdet = trk.ph2_subdet()[anchitidx];
     int is_endcap = subdet == 4;
     int layer = trk.ph2_layer()[anchitidx] + 6 * (is_endcap); // this accounting makes it so that you have layer 1 2 3 4 5 6 in the barrel, and 7 8 9 10 11 in the endcap. (becuase endcap is ph2_subdet == 4)
     int detId = trk.ph2_detId()[anchitidx];
 
     // Obtaining dPhiChange
-    float dphichange = miniDoubletsInGPU.dphichanges[MD];
+    float dphichange = __H2F(miniDoubletsInGPU.dphichanges[MD]);
 
     // Computing pt
     const float kRinv1GeVf = (2.99792458e-3 * 3.8);
@@ -1038,8 +1038,8 @@ std::tuple<float, float, float, vector<unsigned int>, vector<unsigned int>> pars
     const float pt = (ptAv_in + ptAv_out) / 2.;
 
     // T5 eta and phi are computed using outer and innermost hits
-    SDL::CPU::Hit hitA(trk.ph2_x()[Hit_0], trk.ph2_y()[Hit_0], trk.ph2_z()[Hit_0]);
-    SDL::CPU::Hit hitB(trk.ph2_x()[Hit_8], trk.ph2_y()[Hit_8], trk.ph2_z()[Hit_8]);
+    SDL::CPU::Hit hitA(hitsInGPU.xs[Hit_0], hitsInGPU.ys[Hit_0], hitsInGPU.zs[Hit_0]);
+    SDL::CPU::Hit hitB(hitsInGPU.xs[Hit_8], hitsInGPU.ys[Hit_8], hitsInGPU.zs[Hit_8]);
     const float phi = hitA.phi();
     const float eta = hitB.eta();
 